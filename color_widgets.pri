@@ -30,9 +30,21 @@ SOURCES += \
     $$PWD/src/QtColorWidgets/bound_color_selector.cpp \
     $$PWD/src/QtColorWidgets/abstract_widget_list.cpp \
     $$PWD/src/QtColorWidgets/color_palette.cpp \
+    $$PWD/src/QtColorWidgets/color_palette_cache.cpp \
+    $$PWD/src/QtColorWidgets/color_palette_commands.cpp \
+    $$PWD/src/QtColorWidgets/color_palette_diff.cpp \
+    $$PWD/src/QtColorWidgets/color_palette_format.cpp \
+    $$PWD/src/QtColorWidgets/color_palette_index.cpp \
     $$PWD/src/QtColorWidgets/color_palette_model.cpp \
+    $$PWD/src/QtColorWidgets/color_palette_proxy.cpp \
+    $$PWD/src/QtColorWidgets/color_palette_remapper.cpp \
     $$PWD/src/QtColorWidgets/color_palette_widget.cpp \
+    $$PWD/src/QtColorWidgets/color_quantizer.cpp \
+    $$PWD/src/QtColorWidgets/scrolling_swatch.cpp \
     $$PWD/src/QtColorWidgets/swatch.cpp \
+    $$PWD/src/QtColorWidgets/swatch_helpers.cpp \
+    $$PWD/src/QtColorWidgets/swatch_tooltip.cpp \
+    $$PWD/src/QtColorWidgets/swatch_view.cpp \
     $$PWD/src/QtColorWidgets/color_utils.cpp \
     $$PWD/src/QtColorWidgets/color_2d_slider.cpp \
     $$PWD/src/QtColorWidgets/color_line_edit.cpp \
@@ -51,10 +63,25 @@ HEADERS += \
     $$PWD/include/QtColorWidgets/abstract_widget_list.hpp \
     $$PWD/include/QtColorWidgets/colorwidgets_global.hpp \
     $$PWD/include/QtColorWidgets/color_palette.hpp \
+    $$PWD/include/QtColorWidgets/color_palette_commands.hpp \
+    $$PWD/include/QtColorWidgets/color_palette_diff.hpp \
+    $$PWD/include/QtColorWidgets/color_palette_format.hpp \
+    $$PWD/include/QtColorWidgets/color_palette_index.hpp \
     $$PWD/include/QtColorWidgets/color_palette_model.hpp \
+    $$PWD/include/QtColorWidgets/color_palette_proxy.hpp \
+    $$PWD/include/QtColorWidgets/color_palette_remapper.hpp \
     $$PWD/include/QtColorWidgets/color_palette_widget.hpp \
+    $$PWD/include/QtColorWidgets/color_quantizer.hpp \
+    $$PWD/include/QtColorWidgets/scrolling_swatch.hpp \
     $$PWD/include/QtColorWidgets/swatch.hpp \
+    $$PWD/include/QtColorWidgets/swatch_view.hpp \
     $$PWD/src/QtColorWidgets/color_utils.hpp \
+    $$PWD/src/QtColorWidgets/color_space.hpp \
+    $$PWD/src/QtColorWidgets/color_palette_cache.hpp \
+    $$PWD/src/QtColorWidgets/color_hash.hpp \
+    $$PWD/src/QtColorWidgets/parallel.hpp \
+    $$PWD/src/QtColorWidgets/swatch_helpers.hpp \
+    $$PWD/src/QtColorWidgets/swatch_tooltip.hpp \
     $$PWD/include/QtColorWidgets/color_2d_slider.hpp \
     $$PWD/include/QtColorWidgets/color_line_edit.hpp \
     $$PWD/include/QtColorWidgets/color_names.hpp
@@ -0,0 +1,106 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "scrolling_swatch_plugin.hpp"
+#include "QtColorWidgets/scrolling_swatch.hpp"
+
+ScrollingSwatch_Plugin::ScrollingSwatch_Plugin(QObject *parent) :
+    QObject(parent), initialized(false)
+{
+}
+
+void ScrollingSwatch_Plugin::initialize(QDesignerFormEditorInterface *)
+{
+    initialized = true;
+}
+
+bool ScrollingSwatch_Plugin::isInitialized() const
+{
+    return initialized;
+}
+
+QWidget* ScrollingSwatch_Plugin::createWidget(QWidget *parent)
+{
+    color_widgets::ScrollingSwatch *wid = new color_widgets::ScrollingSwatch(parent);
+    wid->palette().setColumns(12);
+    for ( int i = 0; i < 6; i++ )
+    {
+        for ( int j = 0; j < wid->palette().columns(); j++ )
+        {
+            float f = float(j)/wid->palette().columns();
+            wid->palette().appendColor(QColor::fromHsvF(i/8.0,1-f,0.5+f/2));
+        }
+    }
+    return wid;
+}
+
+QString ScrollingSwatch_Plugin::name() const
+{
+    return "color_widgets::ScrollingSwatch";
+}
+
+QString ScrollingSwatch_Plugin::group() const
+{
+    return "Color Widgets";
+}
+
+QIcon ScrollingSwatch_Plugin::icon() const
+{
+    color_widgets::ColorPalette w;
+    w.setColumns(6);
+    for ( int i = 0; i < 4; i++ )
+    {
+        for ( int j = 0; j < w.columns(); j++ )
+        {
+            float f = float(j)/w.columns();
+            w.appendColor(QColor::fromHsvF(i/5.0,1-f,0.5+f/2));
+        }
+    }
+    return QIcon(w.preview(QSize(64,64)));
+}
+
+QString ScrollingSwatch_Plugin::toolTip() const
+{
+    return "A scrollable widget that displays large color palettes";
+}
+
+QString ScrollingSwatch_Plugin::whatsThis() const
+{
+    return toolTip();
+}
+
+bool ScrollingSwatch_Plugin::isContainer() const
+{
+    return false;
+}
+
+QString ScrollingSwatch_Plugin::domXml() const
+{
+    return "<ui language=\"c++\">\n"
+           " <widget class=\"color_widgets::ScrollingSwatch\" name=\"scrolling_swatch\">\n"
+           " </widget>\n"
+           "</ui>\n";
+}
+
+QString ScrollingSwatch_Plugin::includeFile() const
+{
+    return "scrolling_swatch.hpp";
+}
@@ -0,0 +1,113 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "swatch_view_plugin.hpp"
+#include <QStandardItemModel>
+#include "QtColorWidgets/swatch_view.hpp"
+#include "QtColorWidgets/color_palette.hpp"
+
+SwatchView_Plugin::SwatchView_Plugin(QObject *parent) :
+    QObject(parent), initialized(false)
+{
+}
+
+void SwatchView_Plugin::initialize(QDesignerFormEditorInterface *)
+{
+    initialized = true;
+}
+
+bool SwatchView_Plugin::isInitialized() const
+{
+    return initialized;
+}
+
+QWidget* SwatchView_Plugin::createWidget(QWidget *parent)
+{
+    color_widgets::SwatchView *wid = new color_widgets::SwatchView(parent);
+    wid->setForcedColumns(12);
+    QStandardItemModel* model = new QStandardItemModel(wid);
+    for ( int i = 0; i < 6; i++ )
+    {
+        for ( int j = 0; j < wid->forcedColumns(); j++ )
+        {
+            float f = float(j)/wid->forcedColumns();
+            QColor color = QColor::fromHsvF(i/8.0,1-f,0.5+f/2);
+            QStandardItem* item = new QStandardItem(color.name());
+            item->setData(color, Qt::DecorationRole);
+            model->appendRow(item);
+        }
+    }
+    wid->setModel(model);
+    return wid;
+}
+
+QString SwatchView_Plugin::name() const
+{
+    return "color_widgets::SwatchView";
+}
+
+QString SwatchView_Plugin::group() const
+{
+    return "Color Widgets";
+}
+
+QIcon SwatchView_Plugin::icon() const
+{
+    color_widgets::ColorPalette w;
+    w.setColumns(6);
+    for ( int i = 0; i < 4; i++ )
+    {
+        for ( int j = 0; j < w.columns(); j++ )
+        {
+            float f = float(j)/w.columns();
+            w.appendColor(QColor::fromHsvF(i/5.0,1-f,0.5+f/2));
+        }
+    }
+    return QIcon(w.preview(QSize(64,64)));
+}
+
+QString SwatchView_Plugin::toolTip() const
+{
+    return "An item view that displays the colors of a model";
+}
+
+QString SwatchView_Plugin::whatsThis() const
+{
+    return toolTip();
+}
+
+bool SwatchView_Plugin::isContainer() const
+{
+    return false;
+}
+
+QString SwatchView_Plugin::domXml() const
+{
+    return "<ui language=\"c++\">\n"
+           " <widget class=\"color_widgets::SwatchView\" name=\"swatch_view\">\n"
+           " </widget>\n"
+           "</ui>\n";
+}
+
+QString SwatchView_Plugin::includeFile() const
+{
+    return "swatch_view.hpp";
+}
@@ -27,8 +27,12 @@
 #include <QVector>
 #include <QObject>
 #include <QPair>
+#include <QImage>
 #include <QPixmap>
 #include "colorwidgets_global.hpp"
+#include "color_palette_index.hpp"
+
+class QMimeData;
 
 namespace color_widgets {
 
@@ -58,6 +62,8 @@ class QCP_EXPORT ColorPalette : public QObject
     Q_PROPERTY(QString fileName READ fileName WRITE setFileName NOTIFY fileNameChanged)
     /**
      * \brief Whether it has been modified and it might be advisable to save it
+     *
+     * Setters which don't change anything leave it untouched.
      */
     Q_PROPERTY(bool dirty READ dirty WRITE setDirty NOTIFY dirtyChanged)
 
@@ -87,7 +93,7 @@ public:
     QVector<QColor> onlyColors() const;
 
     int count() const;
-    int columns();
+    int columns() const;
 
     QString name() const;
 
@@ -108,23 +114,34 @@ public:
 
     /**
      * \brief Use the pixels on an image to set the palette colors
+     *
+     * Pixels are read row by row, ignoring the alpha channel.
+     * \param unique     If \b true, only the first occurrence of each color is added
+     * \param max_colors If greater than 0, stop after adding this many colors
+     *
+     * The palette has as many columns as the image is wide only if all the
+     * pixels have been added.
      */
-    Q_INVOKABLE bool loadImage(const QImage& image);
+    Q_INVOKABLE bool loadImage(const QImage& image, bool unique = false, int max_colors = 0);
 
     /**
-     * \brief Creates a ColorPalette from a Gimp palette (gpl) file
+     * \brief Creates a ColorPalette from the pixels of an image
+     * \see loadImage()
      */
-    static ColorPalette fromImage(const QImage& image);
+    static ColorPalette fromImage(const QImage& image, bool unique = false, int max_colors = 0);
 
     /**
-     * \brief Load contents from a Gimp palette (gpl) file
+     * \brief Load contents from a palette file
+     *
+     * The file format is detected from the file contents,
+     * see PaletteFormat for the supported formats.
      * \returns \b true On Success
      * \note If this function returns \b false, the palette will become empty
      */
     Q_INVOKABLE bool load(const QString& name);
 
     /**
-     * \brief Creates a ColorPalette from a Gimp palette (gpl) file
+     * \brief Creates a ColorPalette from a palette file
      */
     static ColorPalette fromFile(const QString& name);
 
@@ -132,11 +149,102 @@ public:
 
     bool dirty() const;
 
+    /**
+     * \brief Content version of the palette
+     *
+     * Changes whenever the colors, their names or the number of columns
+     * are modified and is preserved by copies, so it can be used to
+     * tell whether anything derived from the palette is up to date.
+     * Revisions are unique within the process.
+     */
+    quint64 revision() const;
+
+    /**
+     * \brief Hash of the palette name, colors, color names and columns
+     *
+     * Changing a single color or appending and removing the last one updates
+     * the hash in amortized constant time, other edits have it recomputed on the next call.
+     * Palettes which compare equal have the same hash.
+     */
+    quint64 contentHash() const;
+
+    /**
+     * \brief Whether the palettes have the same name, colors, color names and columns
+     *
+     * Colors are compared by their RGBA value. The file name and the
+     * dirty flag are not compared.
+     * The hashes are compared first so different palettes are rejected quickly.
+     */
+    bool operator==(const ColorPalette& other) const;
+    bool operator!=(const ColorPalette& other) const;
+
+    /**
+     * \brief Nearest color search index over the colors of the palette
+     *
+     * The index is built on first use and rebuilt after the palette has been
+     * modified, copies of the palette share it until either is modified.
+     * \note Building the index isn't thread-safe, call this once from the
+     * owning thread before querying the index from other threads.
+     */
+    const ColorPaletteIndex& searchIndex(ColorPaletteIndex::Metric metric = ColorPaletteIndex::OkLab) const;
+
+    /**
+     * \brief Search index over the color names of the palette
+     *
+     * Built and shared like searchIndex(), with the same threading caveats.
+     */
+    const ColorPaletteNameIndex& nameIndex() const;
+
+    /**
+     * \brief Mime type of the binary representation of a palette
+     *
+     * The data is a QDataStream (version Qt_5_0) with a magic number, a
+     * format version, the palette name and columns, the number of colors
+     * and for each color its RGBA value and name.
+     */
+    static QString mimeType();
+
+    /**
+     * \brief Creates mime data to drag or copy the palette
+     *
+     * Besides mimeType(), the data has the first color as color data and
+     * the whole palette as GIMP palette text (or the color name if there is
+     * only one color) so it can be used by other applications.
+     * The caller takes ownership of the returned object.
+     */
+    QMimeData* mimeData() const;
+
+    /**
+     * \brief Whether fromMimeData() would find any color in \p data
+     */
+    static bool canDecode(const QMimeData* data);
+
+    /**
+     * \brief Reads the colors from mime data
+     *
+     * Supports mimeType(), GIMP palette text, color data (with the text as
+     * its name) and plain text naming a color.
+     * Decoding can be expensive for large palettes, widgets should call
+     * this once per drag rather than on each move.
+     * \returns An empty palette if \p data has no colors.
+     */
+    static ColorPalette fromMimeData(const QMimeData* data);
+
     /**
      * \brief Returns a preview image of the colors in the palette
      */
     QPixmap preview(const QSize& size, const QColor& background=Qt::transparent) const;
 
+    /**
+     * \brief Renders the colors in the palette to an image
+     *
+     * The colors are laid out in a grid with columns() columns (or a roughly
+     * square grid if columns() is 0) and each cell covers a whole number of
+     * pixels, with no anti-aliasing between adjacent colors.
+     * This can be called from any thread and is suitable to export swatch sheets.
+     */
+    QImage previewImage(const QSize& size, const QColor& background=Qt::transparent) const;
+
 public Q_SLOTS:
     void setColumns(int columns);
 
@@ -167,9 +275,56 @@ public Q_SLOTS:
      * \brief Remove the color at the given index
      */
     void eraseColor(int index);
+    /**
+     * \brief Insert several colors starting at the given index
+     *
+     * Emits colorsChanged() once rather than colorAdded() for each color.
+     */
+    void insertColors(int index, const QVector<QPair<QColor,QString> >& colors);
+    /**
+     * \brief Remove the colors at the given indexes
+     *
+     * Invalid and repeated indexes are ignored.
+     * Emits colorsChanged() once rather than colorRemoved() for each color.
+     */
+    void eraseColors(const QVector<int>& indexes);
+    /**
+     * \brief Insert colors so they end up at the given indexes
+     *
+     * \p indexes must be sorted, without duplicates and refer to the palette
+     * after the insertion, with one index for each color. This is the inverse
+     * of eraseColors(), only the colors after the first index are moved.
+     * Emits colorsChanged() once.
+     */
+    void insertColors(const QVector<int>& indexes, const QVector<QPair<QColor,QString> >& colors);
+    /**
+     * \brief Move the colors at the given indexes next to each other
+     *
+     * The colors keep their relative order and are placed before the color
+     * at index \p to, which refers to the palette before the move and can be
+     * count() to move them to the end. Emits colorsChanged() once.
+     * \returns The index of the first moved color after the move, or -1 if
+     * there is nothing to move.
+     */
+    int moveColors(const QVector<int>& indexes, int to);
+    /**
+     * \brief Move the block of colors starting at \p first back to \p indexes
+     *
+     * This is the inverse of moveColors(), \p first being the index it
+     * returned and \p indexes the ones it has been called with.
+     * Only the colors between the block and the original indexes are moved.
+     * Emits colorsChanged() once.
+     */
+    void restoreMovedColors(int first, const QVector<int>& indexes);
 
     /**
      * \brief Change file name and save
+     *
+     * Files which have been loaded or already exist keep their format,
+     * as several formats share an extension (eg: pal). New files get the
+     * format matching their extension, defaulting to a Gimp palette (gpl).
+     * The existing file is only replaced once the new one has been
+     * completely written.
      * \returns \b true on success
      */
     bool save(const QString& filename);
@@ -0,0 +1,201 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_COLOR_PALETTE_COMMANDS_HPP
+#define COLOR_WIDGETS_COLOR_PALETTE_COMMANDS_HPP
+
+#include <QCoreApplication>
+#include <QUndoCommand>
+#include "color_palette.hpp"
+
+namespace color_widgets {
+
+/**
+ * \brief Base class for undoable edits of a ColorPalette
+ *
+ * Commands only store the affected index and the colors and names
+ * before and after the edit, so they take constant memory regardless of
+ * the size of the palette.
+ *
+ * \note The palette must outlive the command, clear the QUndoStack
+ * when the palette is replaced or destroyed.
+ */
+class QCP_EXPORT ColorPaletteCommand : public QUndoCommand
+{
+    Q_DECLARE_TR_FUNCTIONS(ColorPaletteCommand)
+
+public:
+    ColorPalette* palette() const { return palette_; }
+
+protected:
+    ColorPaletteCommand(ColorPalette* palette, const QString& text, QUndoCommand* parent);
+
+    ColorPalette* palette_;
+};
+
+/**
+ * \brief Changes the color and name at an index
+ *
+ * Consecutive changes to the same color are merged.
+ */
+class QCP_EXPORT SetColorCommand : public ColorPaletteCommand
+{
+public:
+    SetColorCommand(ColorPalette* palette, int index, const QColor& color,
+                    const QString& name, QUndoCommand* parent = nullptr);
+    /**
+     * \brief Changes the color, keeping the name
+     */
+    SetColorCommand(ColorPalette* palette, int index, const QColor& color,
+                    QUndoCommand* parent = nullptr);
+
+    void redo() override;
+    void undo() override;
+    int id() const override;
+    bool mergeWith(const QUndoCommand* other) override;
+
+private:
+    int     index;
+    QRgb    old_color;
+    QString old_name;
+    QRgb    new_color;
+    QString new_name;
+};
+
+/**
+ * \brief Inserts a color, \p index equal to the palette size appends it
+ */
+class QCP_EXPORT InsertColorCommand : public ColorPaletteCommand
+{
+public:
+    InsertColorCommand(ColorPalette* palette, int index, const QColor& color,
+                       const QString& name = QString(), QUndoCommand* parent = nullptr);
+
+    void redo() override;
+    void undo() override;
+
+private:
+    int     index;
+    QRgb    color;
+    QString name;
+};
+
+/**
+ * \brief Removes the color at an index
+ */
+class QCP_EXPORT RemoveColorCommand : public ColorPaletteCommand
+{
+public:
+    RemoveColorCommand(ColorPalette* palette, int index, QUndoCommand* parent = nullptr);
+
+    void redo() override;
+    void undo() override;
+
+private:
+    int     index;
+    QRgb    color;
+    QString name;
+};
+
+/**
+ * \brief Moves a color so it ends up at index \p to
+ */
+class QCP_EXPORT MoveColorCommand : public ColorPaletteCommand
+{
+public:
+    MoveColorCommand(ColorPalette* palette, int from, int to, QUndoCommand* parent = nullptr);
+
+    void redo() override;
+    void undo() override;
+
+private:
+    void move(int from, int to);
+
+    int from;
+    int to;
+};
+
+/**
+ * \brief Inserts several colors at once
+ *
+ * The colors are stored by the command.
+ */
+class QCP_EXPORT InsertColorsCommand : public ColorPaletteCommand
+{
+public:
+    InsertColorsCommand(ColorPalette* palette, int index,
+                        const QVector<QPair<QColor,QString> >& colors,
+                        QUndoCommand* parent = nullptr);
+
+    void redo() override;
+    void undo() override;
+
+private:
+    int index;
+    QVector<QPair<QColor,QString> > colors;
+};
+
+/**
+ * \brief Removes the colors at several indexes at once
+ *
+ * The removed colors are stored by the command.
+ */
+class QCP_EXPORT RemoveColorsCommand : public ColorPaletteCommand
+{
+public:
+    RemoveColorsCommand(ColorPalette* palette, const QVector<int>& indexes,
+                        QUndoCommand* parent = nullptr);
+
+    void redo() override;
+    void undo() override;
+
+private:
+    QVector<int> indexes;
+    QVector<QPair<QColor,QString> > colors;
+};
+
+/**
+ * \brief Moves the colors at several indexes next to each other
+ * \see ColorPalette::moveColors()
+ */
+class QCP_EXPORT MoveColorsCommand : public ColorPaletteCommand
+{
+public:
+    MoveColorsCommand(ColorPalette* palette, const QVector<int>& indexes, int to,
+                      QUndoCommand* parent = nullptr);
+
+    void redo() override;
+    void undo() override;
+
+    /**
+     * \brief Index of the first moved color after redo()
+     */
+    int first() const { return first_; }
+
+private:
+    QVector<int> indexes;
+    int to;
+    int first_;
+};
+
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_COLOR_PALETTE_COMMANDS_HPP
@@ -0,0 +1,95 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_COLOR_PALETTE_DIFF_HPP
+#define COLOR_WIDGETS_COLOR_PALETTE_DIFF_HPP
+
+#include <QVector>
+#include "color_palette.hpp"
+
+namespace color_widgets {
+
+/**
+ * \brief Differences between the colors of two palettes
+ *
+ * The differences are a list of runs of inserted, removed and modified
+ * colors, computed with Myers' algorithm after skipping the common prefix
+ * and suffix, so it takes time proportional to the size of the palettes
+ * times the number of differences.
+ * Colors are compared by their RGBA value and their name.
+ */
+class QCP_EXPORT ColorPaletteDiff
+{
+public:
+    enum Type
+    {
+        Insert, ///< Colors of the new palette not in the old one
+        Remove, ///< Colors of the old palette not in the new one
+        Modify, ///< Colors of the old palette replaced by the same number of new colors
+    };
+
+    /**
+     * \brief Sequence of consecutive colors with the same change
+     */
+    struct Run
+    {
+        Type type;
+        int  oldIndex;  ///< Index of the first affected color in the old palette
+        int  newIndex;  ///< Index of the first affected color in the new palette
+        int  count;     ///< Number of affected colors
+    };
+
+    ColorPaletteDiff();
+    ColorPaletteDiff(const ColorPalette& from, const ColorPalette& to);
+    ColorPaletteDiff(const ColorPaletteDiff& other);
+    ColorPaletteDiff& operator=(const ColorPaletteDiff& other);
+    ~ColorPaletteDiff();
+
+    /**
+     * \brief Runs ordered by index
+     */
+    QVector<Run> runs() const;
+
+    /**
+     * \brief Whether the colors of the two palettes are the same
+     */
+    bool isEmpty() const;
+
+    /**
+     * \brief Three-way merge of two palettes edited from a common \p base
+     *
+     * Changes made by only one side are applied, changes made by both sides
+     * to overlapping colors are conflicts and are resolved in favour of \p ours.
+     * The palette name and columns are merged the same way.
+     * \param conflicts If not null, set to the number of conflicts
+     * \returns The merged palette, with the file name of \p ours
+     */
+    static ColorPalette merge(const ColorPalette& base, const ColorPalette& ours,
+                              const ColorPalette& theirs, int* conflicts = nullptr);
+
+private:
+    class Private;
+    Private* p;
+};
+
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_COLOR_PALETTE_DIFF_HPP
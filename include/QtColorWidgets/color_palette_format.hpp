@@ -0,0 +1,169 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_COLOR_PALETTE_FORMAT_HPP
+#define COLOR_WIDGETS_COLOR_PALETTE_FORMAT_HPP
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QIODevice>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include "colorwidgets_global.hpp"
+
+namespace color_widgets {
+
+class ColorPalette;
+
+/**
+ * \brief A palette file format
+ *
+ * Formats are registered globally and are used by ColorPalette::load(),
+ * ColorPalette::save() and ColorPaletteModel to find and parse palette files.
+ *
+ * The built-in formats are:
+ *      * GIMP Palette (gpl)
+ *      * Adobe Swatch Exchange (ase)
+ *      * Adobe Color Swatch (aco)
+ *      * RIFF Palette (pal)
+ *      * JASC Palette (pal)
+ *      * Paint.NET Palette (txt)
+ *      * Hex color list (hex)
+ *      * CSS custom properties (css)
+ */
+class QCP_EXPORT PaletteFormat
+{
+    Q_DECLARE_TR_FUNCTIONS(PaletteFormat)
+
+public:
+    /**
+     * \brief Number of bytes passed to probe()
+     */
+    static const int probe_size = 64;
+
+    virtual ~PaletteFormat();
+
+    /**
+     * \brief Short identifier, unique among the registered formats
+     */
+    virtual QString id() const = 0;
+
+    /**
+     * \brief Human-readable description used in file dialogs
+     */
+    virtual QString description() const = 0;
+
+    /**
+     * \brief File name extensions (without the dot) commonly used by this format
+     */
+    virtual QStringList extensions() const = 0;
+
+    /**
+     * \brief Whether \p header looks like the beginning of a file in this format
+     * \param header Up to probe_size bytes from the start of the file
+     *
+     * This should be cheap and must not assume \p header is complete.
+     */
+    virtual bool probe(const QByteArray& header) const = 0;
+
+    /**
+     * \brief Whether write() is supported
+     */
+    virtual bool canWrite() const;
+
+    /**
+     * \brief Reads the palette from \p device
+     *
+     * The palette name is only changed if the file specifies one.
+     * \returns \b true On Success
+     */
+    virtual bool read(QIODevice& device, ColorPalette& palette) const = 0;
+
+    /**
+     * \brief Reads only the palette metadata and the number of colors
+     *
+     * The default implementation reads the whole palette and discards the colors.
+     * \returns \b true On Success
+     */
+    virtual bool readHeader(QIODevice& device, ColorPalette& palette, int& count) const;
+
+    /**
+     * \brief Writes the palette to \p device
+     * \returns \b true On Success
+     */
+    virtual bool write(QIODevice& device, const ColorPalette& palette) const = 0;
+
+    /**
+     * \brief File dialog filter for this format (eg: "GIMP Palette (*.gpl)")
+     */
+    QString nameFilter() const;
+
+    /**
+     * \brief Registers a new format
+     *
+     * The registry takes ownership of \p format.
+     * Formats registered later have lower priority when detecting the format
+     * of a file.
+     * \note Formats should be registered before loading palettes from
+     * multiple threads.
+     */
+    static void registerFormat(PaletteFormat* format);
+
+    /**
+     * \brief All the registered formats, in order of priority
+     */
+    static QList<const PaletteFormat*> formats();
+
+    /**
+     * \brief Format with the given id() or \b nullptr
+     */
+    static const PaletteFormat* fromId(const QString& id);
+
+    /**
+     * \brief First format that uses the given file extension or \b nullptr
+     */
+    static const PaletteFormat* fromExtension(const QString& extension);
+
+    /**
+     * \brief Detects the format of the data in \p device
+     * \param device    Open device, only the first probe_size bytes are peeked
+     * \param file_name If not empty, its extension is used to resolve ambiguities
+     * \returns \b nullptr if the format cannot be determined
+     */
+    static const PaletteFormat* detect(QIODevice& device, const QString& file_name = QString());
+
+    /**
+     * \brief Wildcard patterns matching all the registered extensions (eg: "*.gpl")
+     */
+    static QStringList fileNamePatterns();
+
+    /**
+     * \brief File dialog filters for all the registered formats
+     *
+     * The first filter matches all the supported files
+     */
+    static QStringList nameFilters();
+};
+
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_COLOR_PALETTE_FORMAT_HPP
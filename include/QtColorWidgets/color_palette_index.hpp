@@ -0,0 +1,164 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_COLOR_PALETTE_INDEX_HPP
+#define COLOR_WIDGETS_COLOR_PALETTE_INDEX_HPP
+
+#include <QColor>
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include "colorwidgets_global.hpp"
+
+namespace color_widgets {
+
+class ColorPalette;
+
+/**
+ * \brief Nearest color search over the colors of a palette
+ *
+ * The colors are stored in a k-d tree, so queries take logarithmic time
+ * in the number of colors on average.
+ * The index is a snapshot: it isn't updated when the palette changes,
+ * use ColorPalette::searchIndex() to get an index which is rebuilt as needed.
+ *
+ * Results are palette indices, ordered by distance. Colors at the same
+ * distance are ordered by index, so an exact match returns the first
+ * matching color just like a linear search. Alpha is ignored.
+ *
+ * All the query functions are thread-safe.
+ */
+class QCP_EXPORT ColorPaletteIndex
+{
+public:
+    enum Metric
+    {
+        Rgb,        ///< Euclidean distance between 8 bit sRGB components
+        OkLab,      ///< Euclidean distance in OKLab
+        Ciede2000,  ///< CIEDE2000 difference, searched within a bounded radius in CIE L*a*b*
+    };
+
+    /**
+     * \brief A color found by a query
+     */
+    struct Match
+    {
+        int   index;    ///< Index in the palette
+        float distance; ///< Distance in the units of the metric
+    };
+
+    explicit ColorPaletteIndex(Metric metric = OkLab);
+    ColorPaletteIndex(const ColorPalette& palette, Metric metric = OkLab);
+    ColorPaletteIndex(const QVector<QColor>& colors, Metric metric = OkLab);
+    ColorPaletteIndex(const ColorPaletteIndex& other);
+    ColorPaletteIndex& operator=(const ColorPaletteIndex& other);
+    ~ColorPaletteIndex();
+
+    Metric metric() const;
+
+    /**
+     * \brief Number of indexed colors
+     */
+    int count() const;
+
+    /**
+     * \brief Index of the palette color closest to \p color or -1 if the index is empty
+     */
+    int nearest(const QColor& color) const;
+
+    /**
+     * \brief Up to \p k palette colors closest to \p color
+     */
+    QVector<Match> nearest(const QColor& color, int k) const;
+
+    /**
+     * \brief All the palette colors within \p radius of \p color
+     */
+    QVector<Match> withinRadius(const QColor& color, float radius) const;
+
+    /**
+     * \brief Nearest palette color for each pixel of \p image
+     * \returns Palette indices in row-major order, empty if the index is empty
+     *
+     * Rows are processed by multiple threads for large images.
+     */
+    QVector<int> nearest(const QImage& image) const;
+
+    /**
+     * \brief Distance between two colors in the given metric
+     */
+    static float distance(const QColor& a, const QColor& b, Metric metric);
+
+private:
+    class Private;
+    Private* p;
+};
+
+/**
+ * \brief Case-insensitive search over the color names of a palette
+ *
+ * Each word in the names is kept in a sorted table, so finding the names
+ * with a word starting with a given prefix takes logarithmic time.
+ * Like ColorPaletteIndex this is a snapshot of the palette,
+ * use ColorPalette::nameIndex() to get an index which is rebuilt as needed.
+ *
+ * All the query functions are thread-safe.
+ */
+class QCP_EXPORT ColorPaletteNameIndex
+{
+public:
+    ColorPaletteNameIndex();
+    explicit ColorPaletteNameIndex(const ColorPalette& palette);
+    explicit ColorPaletteNameIndex(const QVector<QString>& names);
+    ColorPaletteNameIndex(const ColorPaletteNameIndex& other);
+    ColorPaletteNameIndex& operator=(const ColorPaletteNameIndex& other);
+    ~ColorPaletteNameIndex();
+
+    /**
+     * \brief Number of indexed names
+     */
+    int count() const;
+
+    /**
+     * \brief Palette indices of the names with a word starting with \p prefix
+     * \returns Sorted indices without duplicates
+     */
+    QVector<int> matches(const QString& prefix) const;
+
+    /**
+     * \brief First palette index after \p from whose name matches \p query
+     *
+     * Names with a word starting with \p query are preferred, if there are
+     * none the names containing all the characters of \p query in the same
+     * order are searched, which takes linear time.
+     * The search wraps around to the start of the palette.
+     * \returns -1 if no name matches
+     */
+    int next(const QString& query, int from = -1) const;
+
+private:
+    class Private;
+    Private* p;
+};
+
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_COLOR_PALETTE_INDEX_HPP
@@ -45,6 +45,46 @@ class QCP_EXPORT ColorPaletteModel : public QAbstractListModel
      */
     Q_PROPERTY(QSize iconSize READ iconSize WRITE setIconSize NOTIFY iconSizeChanged)
 
+    /**
+     * \brief File used to cache the parsed palettes between calls to load()
+     *
+     * If empty, palettes are always parsed from their files.
+     */
+    Q_PROPERTY(QString cacheFile READ cacheFile WRITE setCacheFile NOTIFY cacheFileChanged)
+
+    /**
+     * \brief Directory used to store the palette previews between sessions
+     *
+     * Previews are always cached in memory, if this is not empty they are
+     * also stored as images keyed by the file stats and the icon size so
+     * they don't need to be rendered again when the palettes are loaded.
+     */
+    Q_PROPERTY(QString thumbnailCachePath READ thumbnailCachePath WRITE setThumbnailCachePath NOTIFY thumbnailCachePathChanged)
+
+    /**
+     * \brief Whether load() should only read the name and size of the palettes
+     *
+     * The colors are loaded the first time a palette is accessed.
+     * \note cacheFile is not used for lazy loading
+     */
+    Q_PROPERTY(bool lazyLoading READ lazyLoading WRITE setLazyLoading NOTIFY lazyLoadingChanged)
+
+    /**
+     * \brief Maximum number of lazily loaded palettes to keep in memory, 0 for no limit
+     *
+     * When the limit is exceeded, the colors of the least recently used palettes are
+     * dropped and will be loaded again when needed.
+     */
+    Q_PROPERTY(int maxLoadedPalettes READ maxLoadedPalettes WRITE setMaxLoadedPalettes NOTIFY maxLoadedPalettesChanged)
+
+    /**
+     * \brief Whether to keep the model in sync with the palette files
+     *
+     * When enabled, the search paths and the loaded files are watched for
+     * changes and only the files which have been added, modified or removed
+     * are reloaded.
+     */
+    Q_PROPERTY(bool watchFiles READ watchFiles WRITE setWatchFiles NOTIFY watchFilesChanged)
 
 public:
     ColorPaletteModel();
@@ -56,6 +96,11 @@ public:
     QString savePath() const;
     QStringList searchPaths() const;
     QSize iconSize() const;
+    QString cacheFile() const;
+    QString thumbnailCachePath() const;
+    bool lazyLoading() const;
+    int maxLoadedPalettes() const;
+    bool watchFiles() const;
 
     /**
      * \brief Number of palettes
@@ -64,7 +109,8 @@ public:
 
     /**
      * \brief Returns a reference to the first palette with the given name
-     * \pre hasPalette(name)
+     *
+     * Returns an empty palette if there is no such palette.
      */
     const ColorPalette& palette(const QString& name) const;
 
@@ -76,6 +122,8 @@ public:
     /**
      * \brief Get the palette at the given index (row)
      * \pre 0 <= index < count()
+     * \note With lazyLoading, the colors of the returned palette might be
+     * dropped by later calls to palette()
      */
     const ColorPalette& palette(int index) const;
 
@@ -92,6 +140,9 @@ public:
      * If all of the above fail, the palette will be replaced interally
      * but not on the filesystem
      *
+     * Palettes which haven't been saved are not reloaded or removed when
+     * their file changes on disk, until they are updated and saved again.
+     *
      * \returns \b true if the palette has been successfully updated (and saved)
      */
     bool updatePalette(int index, const ColorPalette& palette, bool save = true);
@@ -110,25 +161,85 @@ public:
 
     /**
      * \brief The index of the palette with the given file name
+     *
+     * Paths are compared as absolute paths first and fall back to resolving
+     * symbolic links in \p filename only if that doesn't match.
      * \returns -1 if none is found
      */
     int indexFromFile(const QString& filename) const;
 
+    /**
+     * \brief The index of a palette with the same contents as \p palette
+     *
+     * Palettes are looked up by their content hash and compared as by
+     * ColorPalette::operator==, only the lazy palettes which have never been
+     * loaded and have the same name and number of colors are loaded.
+     * \returns -1 if none is found
+     */
+    int indexFromContent(const ColorPalette& palette) const;
+
+    /**
+     * \brief Whether loadAsync() is still in progress
+     */
+    bool isLoading() const;
+
 public Q_SLOTS:
     void setSavePath(const QString& savePath);
     void setSearchPaths(const QStringList& searchPaths);
     void addSearchPath(const QString& path);
     void setIconSize(const QSize& iconSize);
+    void setCacheFile(const QString& cacheFile);
+    void setThumbnailCachePath(const QString& thumbnailCachePath);
+    void setLazyLoading(bool lazyLoading);
+    void setMaxLoadedPalettes(int maxLoadedPalettes);
+    void setWatchFiles(bool watchFiles);
 
     /**
      * \brief Load palettes files found in the search paths
      */
     void load();
 
+    /**
+     * \brief Load palettes files found in the search paths in background threads
+     *
+     * The model is cleared and the palettes are inserted in batches,
+     * in the same order as load(), as soon as they have been parsed.
+     * Palettes already inserted can be used while the rest are loading.
+     */
+    void loadAsync();
+
+    /**
+     * \brief Stops loadAsync(), the palettes already inserted are kept
+     */
+    void cancelLoad();
+
 Q_SIGNALS:
     void savePathChanged(const QString& savePath);
     void searchPathsChanged(const QStringList& searchPaths);
     void iconSizeChanged(const QSize& iconSize);
+    void cacheFileChanged(const QString& cacheFile);
+    void thumbnailCachePathChanged(const QString& thumbnailCachePath);
+    void lazyLoadingChanged(bool lazyLoading);
+    void maxLoadedPalettesChanged(int maxLoadedPalettes);
+    void watchFilesChanged(bool watchFiles);
+
+    /**
+     * \brief Emitted by loadAsync() after each batch of palettes
+     * \param loaded Number of files processed so far
+     * \param total  Number of files to process, -1 while scanning the search paths
+     */
+    void loadProgress(int loaded, int total);
+
+    /**
+     * \brief Emitted when loadAsync() completes or is canceled
+     */
+    void loadFinished(bool canceled);
+
+private Q_SLOTS:
+    /**
+     * \brief Reloads the files reported by the file system watcher
+     */
+    void reloadChangedFiles();
 
 private:
     class Private;
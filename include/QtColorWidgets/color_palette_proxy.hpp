@@ -0,0 +1,119 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_COLOR_PALETTE_PROXY_HPP
+#define COLOR_WIDGETS_COLOR_PALETTE_PROXY_HPP
+
+#include <QColor>
+#include <QObject>
+#include <QString>
+#include "colorwidgets_global.hpp"
+
+namespace color_widgets {
+
+class ColorPalette;
+
+/**
+ * \brief Sorted and filtered view over the colors of a ColorPalette
+ *
+ * The proxy only stores a permutation of the palette indices, the colors
+ * are always read from the source palette. Like a proxy model, indices in
+ * the view are converted to and from the source with mapToSource() and
+ * mapFromSource(), so edits are applied to the source palette.
+ *
+ * The sort keys are computed once per palette revision (by multiple threads
+ * for large palettes) and the permutation is rebuilt lazily on the first
+ * query after the palette, the sort or the filter change.
+ *
+ * \note The source palette must outlive the proxy.
+ */
+class QCP_EXPORT ColorPaletteProxy
+{
+    Q_GADGET
+
+public:
+    enum SortKey
+    {
+        Unsorted,   ///< Order of the palette
+        Hue,        ///< HSV hue, grays first
+        Saturation, ///< HSV saturation
+        Lightness,  ///< Perceptual lightness (OKLab L)
+        Name,       ///< Case-insensitive color name
+    };
+    Q_ENUM(SortKey)
+
+    explicit ColorPaletteProxy(const ColorPalette* source = nullptr);
+    ColorPaletteProxy(const ColorPaletteProxy& other);
+    ColorPaletteProxy& operator=(const ColorPaletteProxy& other);
+    ~ColorPaletteProxy();
+
+    const ColorPalette* source() const;
+    void setSource(const ColorPalette* source);
+
+    SortKey sortKey() const;
+    void setSortKey(SortKey key);
+
+    Qt::SortOrder sortOrder() const;
+    void setSortOrder(Qt::SortOrder order);
+
+    /**
+     * \brief Only the colors whose name or hex code contain this are shown
+     *
+     * The comparison is case-insensitive, an empty filter shows all the colors.
+     */
+    QString filter() const;
+    void setFilter(const QString& filter);
+
+    /**
+     * \brief Whether the view shows the whole palette in its own order
+     *
+     * In that case no permutation is stored and the mapping functions
+     * return their argument.
+     */
+    bool isIdentity() const;
+
+    /**
+     * \brief Number of colors in the view
+     */
+    int count() const;
+
+    /**
+     * \brief Palette index of the color at \p index in the view, -1 if out of range
+     */
+    int mapToSource(int index) const;
+
+    /**
+     * \brief Index in the view of the palette color at \p source_index
+     * \returns -1 if the color is filtered out or out of range
+     */
+    int mapFromSource(int source_index) const;
+
+    QColor colorAt(int index) const;
+    QString nameAt(int index) const;
+
+private:
+    class Private;
+    Private* p;
+};
+
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_COLOR_PALETTE_PROXY_HPP
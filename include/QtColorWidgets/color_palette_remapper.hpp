@@ -0,0 +1,86 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_COLOR_PALETTE_REMAPPER_HPP
+#define COLOR_WIDGETS_COLOR_PALETTE_REMAPPER_HPP
+
+#include <QImage>
+#include "color_palette.hpp"
+
+namespace color_widgets {
+
+/**
+ * \brief Converts images to use only the colors of a palette
+ *
+ * Nearest colors are looked up in a table with 6 bits per channel, which is
+ * computed once from the palette with the chosen metric.
+ *
+ * Images are processed by multiple threads: independent rows for
+ * NoDither and Bayer, and a wavefront of rows for error diffusion, where each
+ * row trails the one above by a few pixels so the diffused error is complete.
+ * The result is the same regardless of the number of threads.
+ */
+class QCP_EXPORT ColorPaletteRemapper
+{
+public:
+    enum Dither
+    {
+        NoDither,       ///< Nearest color
+        Bayer,          ///< Ordered dithering with an 8x8 Bayer matrix
+        FloydSteinberg, ///< Floyd-Steinberg error diffusion
+        Atkinson,       ///< Atkinson error diffusion, diffuses 3/4 of the error
+    };
+
+    explicit ColorPaletteRemapper(const ColorPalette& palette,
+                                  Dither dither = NoDither,
+                                  ColorPaletteIndex::Metric metric = ColorPaletteIndex::Rgb);
+    ColorPaletteRemapper(const ColorPaletteRemapper& other);
+    ColorPaletteRemapper& operator=(const ColorPaletteRemapper& other);
+    ~ColorPaletteRemapper();
+
+    Dither dither() const;
+    void setDither(Dither dither);
+
+    ColorPaletteIndex::Metric metric() const;
+
+    /**
+     * \brief Palette index of the color used for the given opaque color, without dithering
+     * \returns -1 if the palette is empty
+     */
+    int indexOf(QRgb color) const;
+
+    /**
+     * \brief Remaps \p image, ignoring the alpha channel
+     *
+     * If the palette has at most 256 colors the result has Format_Indexed8
+     * with the palette colorTable(), otherwise it has Format_RGB32.
+     * \returns A null image if \p image is null or the palette is empty
+     */
+    QImage remap(const QImage& image) const;
+
+private:
+    class Private;
+    Private* p;
+};
+
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_COLOR_PALETTE_REMAPPER_HPP
@@ -118,6 +118,14 @@ public:
 
     int currentRow() const;
 
+    /**
+     * \brief Undo stack with the edits made to the current palette
+     *
+     * Use it to create undo and redo actions, it's cleared when a
+     * different palette is selected or the palette is reverted.
+     */
+    QUndoStack* undoStack() const;
+
 public Q_SLOTS:
     void setModel(ColorPaletteModel* model);
     void setColorSize(const QSize& colorSize);
@@ -0,0 +1,95 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_COLOR_QUANTIZER_HPP
+#define COLOR_WIDGETS_COLOR_QUANTIZER_HPP
+
+#include <functional>
+#include <QImage>
+#include "color_palette.hpp"
+
+namespace color_widgets {
+
+/**
+ * \brief Extracts a palette of representative colors from an image
+ *
+ * The pixels are first collected in a histogram with 5 bits per channel,
+ * which is built by multiple threads, then the histogram is reduced to the
+ * requested number of colors with the selected method.
+ *
+ * The result only depends on the image and the settings, not on the
+ * number of threads. The colors are sorted by the number of pixels they
+ * represent, most common first.
+ */
+class QCP_EXPORT ColorQuantizer
+{
+public:
+    enum Method
+    {
+        MedianCut,  ///< Recursively split the color space at the median of its widest channel
+        Octree,     ///< Merge the least used branches of an octree
+        KMeans,     ///< Refine a median cut with k-means clustering in OKLab
+    };
+
+    /**
+     * \brief Called with the progress in [0, 100]
+     * \returns \b false to cancel the operation
+     */
+    typedef std::function<bool(int progress)> ProgressCallback;
+
+    explicit ColorQuantizer(Method method = MedianCut, int max_colors = 16);
+    ColorQuantizer(const ColorQuantizer& other);
+    ColorQuantizer& operator=(const ColorQuantizer& other);
+    ~ColorQuantizer();
+
+    Method method() const;
+    void setMethod(Method method);
+
+    /**
+     * \brief Maximum number of colors in the resulting palette
+     *
+     * The result might have fewer colors if the image doesn't have enough
+     * distinct colors.
+     */
+    int maxColors() const;
+    void setMaxColors(int max_colors);
+
+    /**
+     * \brief Maximum number of refinement passes for KMeans
+     */
+    int iterations() const;
+    void setIterations(int iterations);
+
+    /**
+     * \brief Builds a palette from the pixels of \p image, ignoring the alpha channel
+     * \param progress Optional callback, always called from the calling thread
+     * \returns An empty palette if the image is empty or the operation has been canceled
+     */
+    ColorPalette quantize(const QImage& image, const ProgressCallback& progress = ProgressCallback()) const;
+
+private:
+    class Private;
+    Private* p;
+};
+
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_COLOR_QUANTIZER_HPP
@@ -0,0 +1,170 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_SCROLLING_SWATCH_HPP
+#define COLOR_WIDGETS_SCROLLING_SWATCH_HPP
+
+#include <QAbstractScrollArea>
+#include <QPen>
+#include "color_palette.hpp"
+
+class QUndoStack;
+
+namespace color_widgets {
+
+/**
+ * \brief A scrollable widget drawing a palette
+ *
+ * Unlike Swatch, all the colors have the same size and only the ones in the
+ * viewport are laid out and painted, so it stays responsive with palettes
+ * of hundreds of thousands of colors.
+ * Keyboard navigation scrolls to the selected color and drags close to the
+ * edges scroll the view, so colors can be moved anywhere in the palette.
+ *
+ * It's deliberately minimal: a single selected color, no type-ahead search,
+ * no sorting or filtering and no clipboard shortcuts. Use Swatch for those,
+ * or SwatchView with a model for large color tables.
+ */
+class QCP_EXPORT ScrollingSwatch : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+    /**
+     * \brief Palette shown by the widget
+     */
+    Q_PROPERTY(const ColorPalette& palette READ palette WRITE setPalette NOTIFY paletteChanged)
+    /**
+     * \brief Currently selected color (-1 if no color is selected)
+     */
+    Q_PROPERTY(int selected READ selected WRITE setSelected NOTIFY selectedChanged)
+    /**
+     * \brief Size of a color square
+     */
+    Q_PROPERTY(QSize colorSize READ colorSize WRITE setColorSize NOTIFY colorSizeChanged)
+    /**
+     * \brief Border around the colors
+     */
+    Q_PROPERTY(QPen border READ border WRITE setBorder NOTIFY borderChanged)
+    /**
+     * \brief Forces the widget to display that many columns of colors
+     *
+     * A value of 0 means that the palette columns are used if set,
+     * otherwise as many columns as fit the width of the viewport.
+     */
+    Q_PROPERTY(int forcedColumns READ forcedColumns WRITE setForcedColumns NOTIFY forcedColumnsChanged)
+    /**
+     * \brief Whether the palette can be modified via user interaction
+     * \note Even when this is \b false, it can still be altered programmatically
+     */
+    Q_PROPERTY(bool readOnly READ readOnly WRITE setReadOnly NOTIFY readOnlyChanged)
+    /**
+     * \brief Stack receiving the edits made via user interaction
+     * \see Swatch::undoStack
+     */
+    Q_PROPERTY(QUndoStack* undoStack READ undoStack WRITE setUndoStack NOTIFY undoStackChanged)
+
+public:
+    ScrollingSwatch(QWidget* parent = nullptr);
+    ~ScrollingSwatch();
+
+    QSize sizeHint() const Q_DECL_OVERRIDE;
+
+    const ColorPalette& palette() const;
+    ColorPalette& palette();
+    int selected() const;
+    /**
+     * \brief Color at the currently selected index
+     */
+    QColor selectedColor() const;
+
+    /**
+     * \brief Color index at the given position within the viewport
+     * \returns -1 if the position doesn't represent any color
+     */
+    int indexAt(const QPoint& pos) const;
+
+    /**
+     * \brief Rectangle of the color at the given index, in viewport coordinates
+     */
+    QRect indexRect(int index) const;
+
+    QSize colorSize() const;
+    QPen border() const;
+    int forcedColumns() const;
+    bool readOnly() const;
+    QUndoStack* undoStack() const;
+
+public Q_SLOTS:
+    void setPalette(const ColorPalette& palette);
+    void setSelected(int selected);
+    void clearSelection();
+    void setColorSize(const QSize& colorSize);
+    void setBorder(const QPen& border);
+    void setForcedColumns(int forcedColumns);
+    void setReadOnly(bool readOnly);
+    void setUndoStack(QUndoStack* undoStack);
+    /**
+     * \brief Remove the currently selected color
+     */
+    void removeSelected();
+    /**
+     * \brief Scrolls the view so the color at the given index is visible
+     */
+    void scrollToIndex(int index);
+
+Q_SIGNALS:
+    void paletteChanged(const ColorPalette& palette);
+    void selectedChanged(int selected);
+    void colorSelected(const QColor& color);
+    void colorSizeChanged(const QSize& colorSize);
+    void borderChanged(const QPen& border);
+    void forcedColumnsChanged(int forcedColumns);
+    void readOnlyChanged(bool readOnly);
+    void undoStackChanged(QUndoStack* undoStack);
+    void doubleClicked(int index);
+    void rightClicked(int index);
+
+protected:
+    bool viewportEvent(QEvent* event) Q_DECL_OVERRIDE;
+    void paintEvent(QPaintEvent* event) Q_DECL_OVERRIDE;
+    void resizeEvent(QResizeEvent* event) Q_DECL_OVERRIDE;
+    void scrollContentsBy(int dx, int dy) Q_DECL_OVERRIDE;
+
+    void keyPressEvent(QKeyEvent* event) Q_DECL_OVERRIDE;
+
+    void mousePressEvent(QMouseEvent* event) Q_DECL_OVERRIDE;
+    void mouseReleaseEvent(QMouseEvent* event) Q_DECL_OVERRIDE;
+    void mouseMoveEvent(QMouseEvent* event) Q_DECL_OVERRIDE;
+    void mouseDoubleClickEvent(QMouseEvent* event) Q_DECL_OVERRIDE;
+
+    void dragEnterEvent(QDragEnterEvent* event) Q_DECL_OVERRIDE;
+    void dragMoveEvent(QDragMoveEvent* event) Q_DECL_OVERRIDE;
+    void dragLeaveEvent(QDragLeaveEvent* event) Q_DECL_OVERRIDE;
+    void dropEvent(QDropEvent* event) Q_DECL_OVERRIDE;
+
+private:
+    class Private;
+    Private* p;
+};
+
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_SCROLLING_SWATCH_HPP
@@ -25,6 +25,9 @@
 #include <QWidget>
 #include <QPen>
 #include "color_palette.hpp"
+#include "color_palette_proxy.hpp"
+
+class QUndoStack;
 
 namespace color_widgets {
 
@@ -41,6 +44,10 @@ class QCP_EXPORT Swatch : public QWidget
     Q_PROPERTY(const ColorPalette& palette READ palette WRITE setPalette NOTIFY paletteChanged)
     /**
      * \brief Currently selected color (-1 if no color is selected)
+     *
+     * When several colors are selected this is the one last clicked,
+     * setting it selects only that color.
+     * \see selectedIndexes()
      */
     Q_PROPERTY(int selected READ selected WRITE setSelected NOTIFY selectedChanged)
 
@@ -86,6 +93,40 @@ class QCP_EXPORT Swatch : public QWidget
      */
     Q_PROPERTY(bool readOnly READ readOnly WRITE setReadOnly NOTIFY readOnlyChanged)
 
+    /**
+     * \brief Stack receiving the edits made via user interaction
+     *
+     * When set, edits are pushed as the commands in color_palette_commands.hpp
+     * so they can be undone. The stack is cleared when the palette is replaced.
+     * When null (the default) edits are applied directly.
+     */
+    Q_PROPERTY(QUndoStack* undoStack READ undoStack WRITE setUndoStack NOTIFY undoStackChanged)
+
+    /**
+     * \brief Whether tooltips also show HSV, OKLCh and contrast ratio values
+     *
+     * The values are computed the first time the tooltip of a color is shown.
+     */
+    Q_PROPERTY(bool detailedToolTips READ detailedToolTips WRITE setDetailedToolTips NOTIFY detailedToolTipsChanged)
+
+    /**
+     * \brief Key the colors are shown sorted by, without changing the palette
+     *
+     * \see ColorPaletteProxy::setSortKey()
+     */
+    Q_PROPERTY(color_widgets::ColorPaletteProxy::SortKey sortKey READ sortKey WRITE setSortKey NOTIFY sortKeyChanged)
+
+    /**
+     * \brief Direction of the sort set by setSortKey()
+     */
+    Q_PROPERTY(Qt::SortOrder sortOrder READ sortOrder WRITE setSortOrder NOTIFY sortOrderChanged)
+
+    /**
+     * \brief Only the colors whose name or hex code contain this are shown
+     *
+     * \see ColorPaletteProxy::setFilter()
+     */
+    Q_PROPERTY(QString filter READ filter WRITE setFilter NOTIFY filterChanged)
 
 public:
     enum ColorSizePolicy
@@ -110,6 +151,21 @@ public:
      */
     QColor selectedColor() const;
 
+    /**
+     * \brief All the selected indexes, in increasing order
+     *
+     * Several colors are selected with Shift+click (range), Ctrl+click (toggle)
+     * or by dragging a rubber band from an empty area or while holding Ctrl.
+     * Removing, moving and dragging the selected colors applies to all of them
+     * as a single palette update.
+     */
+    QVector<int> selectedIndexes() const;
+
+    /**
+     * \brief Whether the color at \p index is selected
+     */
+    bool isSelected(int index) const;
+
     /**
      * \brief Color index at the given position within the widget
      * \param p Point in local coordinates
@@ -132,24 +188,90 @@ public:
 
     bool readOnly() const;
 
+    QUndoStack* undoStack() const;
+
+    bool detailedToolTips() const;
+
+    /**
+     * \brief View mapping the cells to the palette indexes
+     *
+     * All the indexes used by the widget interface refer to the palette,
+     * the cells show the colors in the order of the view.
+     * When sorted or filtered, dropped colors are appended to the palette
+     * and moving colors by dragging them does nothing.
+     */
+    const ColorPaletteProxy& proxy() const;
+
+    ColorPaletteProxy::SortKey sortKey() const;
+    Qt::SortOrder sortOrder() const;
+    QString filter() const;
+
 public Q_SLOTS:
     void setPalette(const ColorPalette& palette);
     void setSelected(int selected);
     void clearSelection();
+    /**
+     * \brief Select the given indexes, invalid ones are ignored
+     */
+    void setSelectedIndexes(const QVector<int>& indexes);
+    void selectAll();
+    /**
+     * \brief Select the next color whose name matches what the user typed
+     *
+     * Called when typing on the widget, characters typed in quick succession
+     * are added to the query. Names with a word starting with the query are
+     * found in logarithmic time via ColorPalette::nameIndex(), otherwise names
+     * containing the query characters in order are selected.
+     * Colors hidden by filter() are skipped and matches follow the order of
+     * the cells when sorted.
+     */
+    void keyboardSearch(const QString& search);
+    /**
+     * \brief Select the color closest to \p color
+     *
+     * Strings such as "#ff8800" and SVG color names convert to QColor.
+     * Uses ColorPalette::searchIndex() so it takes logarithmic time on average.
+     * Colors hidden by filter() are skipped.
+     * \returns The selected index or -1 if no color is shown
+     */
+    int selectNearest(const QColor& color);
+    /**
+     * \brief Copy the selected colors to the clipboard
+     *
+     * The clipboard gets ColorPalette::mimeData(), which includes them as
+     * GIMP palette text.
+     */
+    void copySelected();
+    /**
+     * \brief Insert the colors in the clipboard after the current color
+     */
+    void paste();
     void setColorSize(const QSize& colorSize);
     void setColorSizePolicy(ColorSizePolicy colorSizePolicy);
     void setBorder(const QPen& border);
     void setForcedRows(int forcedRows);
     void setForcedColumns(int forcedColumns);
     void setReadOnly(bool readOnly);
+    void setUndoStack(QUndoStack* undoStack);
+    void setDetailedToolTips(bool detailedToolTips);
+    /**
+     * \brief Show the colors sorted by \p sortKey, without changing the palette
+     */
+    void setSortKey(ColorPaletteProxy::SortKey sortKey);
+    void setSortOrder(Qt::SortOrder sortOrder);
+    void setFilter(const QString& filter);
     /**
-     * \brief Remove the currently seleceted color
+     * \brief Remove the currently seleceted colors
      **/
     void removeSelected();
 
 Q_SIGNALS:
     void paletteChanged(const ColorPalette& palette);
     void selectedChanged(int selected);
+    /**
+     * \brief Emitted when the set of selected indexes changes
+     */
+    void selectionChanged();
     void colorSelected(const QColor& color);
     void colorSizeChanged(const QSize& colorSize);
     void colorSizePolicyChanged(ColorSizePolicy colorSizePolicy);
@@ -159,6 +281,11 @@ Q_SIGNALS:
     void forcedColumnsChanged(int forcedColumns);
     void readOnlyChanged(bool readOnly);
     void borderChanged(const QPen& border);
+    void undoStackChanged(QUndoStack* undoStack);
+    void detailedToolTipsChanged(bool detailedToolTips);
+    void sortKeyChanged(ColorPaletteProxy::SortKey sortKey);
+    void sortOrderChanged(Qt::SortOrder sortOrder);
+    void filterChanged(const QString& filter);
 
 protected:
     bool event(QEvent* event) Q_DECL_OVERRIDE;
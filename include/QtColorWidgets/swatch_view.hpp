@@ -0,0 +1,153 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_SWATCH_VIEW_HPP
+#define COLOR_WIDGETS_SWATCH_VIEW_HPP
+
+#include <QAbstractItemView>
+#include <QPen>
+#include "colorwidgets_global.hpp"
+
+namespace color_widgets {
+
+/**
+ * \brief Item view drawing the rows of a model as a grid of colors
+ *
+ * Unlike Swatch and ScrollingSwatch it doesn't hold a ColorPalette, the
+ * colors and names are read from the model, only for the cells in the
+ * viewport, so large application-owned color tables can be shown without
+ * copying them.
+ * Changes to the model repaint only the affected cells: dataChanged()
+ * updates the changed rows, inserting or removing rows updates the cells
+ * from the first affected one.
+ *
+ * Selection, current index, editing triggers and drag and drop follow
+ * QAbstractItemView, with the model providing the mime data.
+ * Selecting by dragging shows a rubber band and the current index is
+ * drawn with a focus frame while the view has focus.
+ */
+class QCP_EXPORT SwatchView : public QAbstractItemView
+{
+    Q_OBJECT
+
+    /**
+     * \brief Size of a color square
+     */
+    Q_PROPERTY(QSize colorSize READ colorSize WRITE setColorSize NOTIFY colorSizeChanged)
+    /**
+     * \brief Border around the colors
+     */
+    Q_PROPERTY(QPen border READ border WRITE setBorder NOTIFY borderChanged)
+    /**
+     * \brief Forces the widget to display that many columns of colors
+     *
+     * A value of 0 means as many columns as fit the width of the viewport.
+     */
+    Q_PROPERTY(int forcedColumns READ forcedColumns WRITE setForcedColumns NOTIFY forcedColumnsChanged)
+    /**
+     * \brief Model role holding the color, as a QColor or a QBrush
+     */
+    Q_PROPERTY(int colorRole READ colorRole WRITE setColorRole NOTIFY colorRoleChanged)
+    /**
+     * \brief Model role holding the color name, shown in tooltips
+     */
+    Q_PROPERTY(int nameRole READ nameRole WRITE setNameRole NOTIFY nameRoleChanged)
+    /**
+     * \brief Model column holding the colors
+     */
+    Q_PROPERTY(int modelColumn READ modelColumn WRITE setModelColumn NOTIFY modelColumnChanged)
+
+public:
+    SwatchView(QWidget* parent = nullptr);
+    ~SwatchView();
+
+    QSize sizeHint() const Q_DECL_OVERRIDE;
+    void setModel(QAbstractItemModel* model) Q_DECL_OVERRIDE;
+
+    QRect visualRect(const QModelIndex& index) const Q_DECL_OVERRIDE;
+    void scrollTo(const QModelIndex& index, ScrollHint hint = EnsureVisible) Q_DECL_OVERRIDE;
+    QModelIndex indexAt(const QPoint& point) const Q_DECL_OVERRIDE;
+
+    /**
+     * \brief Color of the model row at \p row, invalid if out of range
+     */
+    QColor colorAt(int row) const;
+    /**
+     * \brief Color of the current index
+     */
+    QColor currentColor() const;
+
+    QSize colorSize() const;
+    QPen border() const;
+    int forcedColumns() const;
+    int colorRole() const;
+    int nameRole() const;
+    int modelColumn() const;
+
+public Q_SLOTS:
+    void setColorSize(const QSize& colorSize);
+    void setBorder(const QPen& border);
+    void setForcedColumns(int forcedColumns);
+    void setColorRole(int colorRole);
+    void setNameRole(int nameRole);
+    void setModelColumn(int modelColumn);
+
+Q_SIGNALS:
+    void colorSizeChanged(const QSize& colorSize);
+    void borderChanged(const QPen& border);
+    void forcedColumnsChanged(int forcedColumns);
+    void colorRoleChanged(int colorRole);
+    void nameRoleChanged(int nameRole);
+    void modelColumnChanged(int modelColumn);
+    /**
+     * \brief Emitted when the current index changes to a valid one
+     */
+    void colorSelected(const QColor& color);
+
+protected Q_SLOTS:
+    void dataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight,
+                     const QVector<int>& roles = QVector<int>()) Q_DECL_OVERRIDE;
+    void rowsInserted(const QModelIndex& parent, int start, int end) Q_DECL_OVERRIDE;
+    void currentChanged(const QModelIndex& current, const QModelIndex& previous) Q_DECL_OVERRIDE;
+    void updateGeometries() Q_DECL_OVERRIDE;
+
+protected:
+    QModelIndex moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers modifiers) Q_DECL_OVERRIDE;
+    int horizontalOffset() const Q_DECL_OVERRIDE;
+    int verticalOffset() const Q_DECL_OVERRIDE;
+    bool isIndexHidden(const QModelIndex& index) const Q_DECL_OVERRIDE;
+    void setSelection(const QRect& rect, QItemSelectionModel::SelectionFlags command) Q_DECL_OVERRIDE;
+    QRegion visualRegionForSelection(const QItemSelection& selection) const Q_DECL_OVERRIDE;
+
+    void mousePressEvent(QMouseEvent* event) Q_DECL_OVERRIDE;
+    void mouseMoveEvent(QMouseEvent* event) Q_DECL_OVERRIDE;
+    void mouseReleaseEvent(QMouseEvent* event) Q_DECL_OVERRIDE;
+    bool viewportEvent(QEvent* event) Q_DECL_OVERRIDE;
+    void paintEvent(QPaintEvent* event) Q_DECL_OVERRIDE;
+
+private:
+    class Private;
+    Private* p;
+};
+
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_SWATCH_VIEW_HPP
@@ -0,0 +1,67 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_COLOR_HASH_HPP
+#define COLOR_WIDGETS_COLOR_HASH_HPP
+
+#include <QColor>
+#include <QString>
+
+namespace color_widgets {
+namespace detail {
+
+/**
+ * \brief 64 bit FNV-1a hash
+ */
+inline quint64 fnv1a(const char* data, qint64 size, quint64 hash = 14695981039346656037ULL)
+{
+    for ( qint64 i = 0; i < size; i++ )
+    {
+        hash ^= quint8(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline quint64 fnv1a(const QByteArray& data)
+{
+    return fnv1a(data.constData(), data.size());
+}
+
+/**
+ * \brief Hash of a color and its name, as compared by palette diffs and equality
+ */
+inline quint64 palette_entry_hash(const QColor& color, const QString& name)
+{
+    QRgb rgba = color.rgba();
+    quint64 hash = fnv1a(reinterpret_cast<const char*>(&rgba), sizeof(rgba));
+    hash = fnv1a(reinterpret_cast<const char*>(name.constData()), name.size() * 2, hash);
+    // Finalizer so nearby inputs give unrelated outputs
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+} // namespace detail
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_COLOR_HASH_HPP
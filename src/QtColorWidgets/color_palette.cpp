@@ -20,28 +20,243 @@
  *
  */
 #include "QtColorWidgets/color_palette.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstring>
+#include <memory>
+#include <QBuffer>
+#include <QDataStream>
 #include <QFile>
-#include <QTextStream>
-#include <QHash>
-#include <QPainter>
 #include <QFileInfo>
+#include <QMimeData>
+#include <QSaveFile>
+#include "QtColorWidgets/color_palette_format.hpp"
+#include "color_hash.hpp"
+#include "parallel.hpp"
 
 namespace color_widgets {
 
+namespace {
+
+/**
+ * \brief Premultiplied \p color composed over \p background
+ */
+QRgb blend_over(const QColor& color, QRgb background)
+{
+    QRgb src = qPremultiply(color.rgba());
+    int inv = 255 - qAlpha(src);
+    auto mix = [inv](int s, int d) {
+        return s + (d * inv + 127) / 255;
+    };
+    return qRgba(
+        mix(qRed(src), qRed(background)),
+        mix(qGreen(src), qGreen(background)),
+        mix(qBlue(src), qBlue(background)),
+        mix(qAlpha(src), qAlpha(background))
+    );
+}
+
+/**
+ * \brief Number of pixels above which previews are rendered by multiple threads
+ */
+const int parallel_preview_pixels = 512 * 512;
+
+/**
+ * \brief Open addressing hash set of opaque colors
+ *
+ * 0 is used to mark empty slots, which is fine as all the keys have
+ * an alpha of 255.
+ */
+class RgbSet
+{
+public:
+    RgbSet() : slots(64, 0), mask(63) {}
+
+    /**
+     * \brief Inserts \p rgb
+     * \returns \b false if it was already in the set
+     */
+    bool insert(QRgb rgb)
+    {
+        // Keep the load factor below 1/2
+        if ( (size + 1) * 2 > slots.size() )
+            grow();
+
+        for ( quint32 i = hash(rgb); ; i = (i + 1) & mask )
+        {
+            if ( slots[i] == rgb )
+                return false;
+            if ( slots[i] == 0 )
+            {
+                slots[i] = rgb;
+                size++;
+                return true;
+            }
+        }
+    }
+
+private:
+    quint32 hash(QRgb rgb) const
+    {
+        return (rgb * 2654435761u) >> 8 & mask;
+    }
+
+    void grow()
+    {
+        QVector<QRgb> old;
+        std::swap(old, slots);
+        slots.fill(0, old.size() * 2);
+        mask = slots.size() - 1;
+        size = 0;
+        for ( QRgb rgb : old )
+            if ( rgb )
+                insert(rgb);
+    }
+
+    QVector<QRgb> slots;
+    quint32 mask;
+    int size = 0;
+};
+
+/**
+ * \brief Marks the start of the binary mime data, followed by a version number
+ */
+const quint32 mime_magic = 0x51435050; // QCPP
+const quint8 mime_version = 1;
+
+} // namespace
+
 class ColorPalette::Private
 {
 public:
     QVector<QPair<QColor,QString> >   colors;
-    int             columns;
+    int             columns = 0;
     QString         name;
     QString         fileName;
-    bool            dirty;
+    /// Format fileName has been read with, reused when saving to it
+    const PaletteFormat* format = nullptr;
+    bool            dirty = false;
+    quint64         revision = next_revision();
+    /// Search indices built on demand for each metric, shared by copies
+    std::shared_ptr<ColorPaletteIndex> search_index[3];
+    /// Name index built on demand, shared by copies
+    std::shared_ptr<ColorPaletteNameIndex> name_index;
+    /// Sum of the entry hashes, each multiplied by hash_base to the power of its index
+    quint64         entries_hash = 0;
+    /// Whether entries_hash is up to date, edits shifting colors only clear this
+    bool            entries_hashed = true;
+    /// Powers of hash_base by index, grown with the palette so hash updates take amortized constant time
+    QVector<quint64> hash_powers;
+
+    static const quint64 hash_base = 0x100000001b3ULL;
 
     bool valid_index(int index)
     {
         return index >= 0 && index < colors.size();
     }
+
+    /**
+     * \brief Valid indexes from \p indexes, sorted and without duplicates
+     */
+    QVector<int> sorted_indexes(QVector<int> indexes)
+    {
+        std::sort(indexes.begin(), indexes.end());
+        indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+        int first = std::lower_bound(indexes.begin(), indexes.end(), 0) - indexes.begin();
+        int last = std::lower_bound(indexes.begin(), indexes.end(), colors.size()) - indexes.begin();
+        return indexes.mid(first, last - first);
+    }
+
+    /**
+     * \brief Marks the colors as modified in a way that requires rehashing
+     */
+    void touch()
+    {
+        touch_layout();
+        entries_hashed = false;
+    }
+
+    /**
+     * \brief Marks the layout as modified, leaving the colors unchanged
+     */
+    void touch_layout()
+    {
+        revision = next_revision();
+        for ( auto& index : search_index )
+            index.reset();
+        name_index.reset();
+    }
+
+    /**
+     * \brief Marks the entry at \p index as modified, updating the hash in amortized constant time
+     * \param old_hash Hash of the entry before the change
+     */
+    void touch_entry(int index, quint64 old_hash)
+    {
+        touch_layout();
+        if ( entries_hashed )
+            entries_hash += (entry_hash(index) - old_hash) * hash_power(index);
+    }
+
+    /**
+     * \brief Marks the last entry as added, updating the hash in amortized constant time
+     */
+    void touch_appended()
+    {
+        touch_layout();
+        if ( entries_hashed )
+            entries_hash += entry_hash(colors.size() - 1) * hash_power(colors.size() - 1);
+    }
+
+    quint64 entry_hash(int index) const
+    {
+        return detail::palette_entry_hash(colors[index].first, colors[index].second);
+    }
+
+    /**
+     * \brief Sum of the hash terms of the entries from \p first to \p end (excluded)
+     *
+     * Replacing the terms of a span updates the hash in time proportional to the span.
+     */
+    quint64 span_hash(int first, int end)
+    {
+        quint64 hash = 0;
+        for ( int i = first; i < end; i++ )
+            hash += entry_hash(i) * hash_power(i);
+        return hash;
+    }
+
+    quint64 entries_hash_value()
+    {
+        if ( !entries_hashed )
+        {
+            // Horner's rule, from the last entry to the first
+            entries_hash = 0;
+            for ( int i = colors.size() - 1; i >= 0; i-- )
+                entries_hash = entries_hash * hash_base + entry_hash(i);
+            entries_hashed = true;
+        }
+        return entries_hash;
+    }
+
+    /**
+     * \brief hash_base to the power of \p exponent, extending the cached powers as needed
+     */
+    quint64 hash_power(int exponent)
+    {
+        if ( hash_powers.isEmpty() )
+            hash_powers.push_back(1);
+        while ( hash_powers.size() <= exponent )
+            hash_powers.push_back(hash_powers.back() * hash_base);
+        return hash_powers[exponent];
+    }
+
+    static quint64 next_revision()
+    {
+        static std::atomic<quint64> counter(0);
+        return ++counter;
+    }
 };
 
 ColorPalette::ColorPalette(const QVector<QColor>& colors,
@@ -65,6 +280,7 @@ ColorPalette::ColorPalette(const QString& name)
 ColorPalette::ColorPalette(const QVector<QPair<QColor,QString> >& colors,
                            const QString& name,
                            int columns)
+    : p ( new Private )
 {
     setName(name);
     setColumns(columns);
@@ -130,7 +346,7 @@ int ColorPalette::count() const
     return p->colors.size();
 }
 
-int ColorPalette::columns()
+int ColorPalette::columns() const
 {
     return p->columns;
 }
@@ -150,36 +366,49 @@ void ColorPalette::loadColorTable(const QVector<QRgb>& color_table)
         color.setAlpha(255);
         p->colors.push_back(qMakePair(color,QString()));
     }
+    p->touch();
     Q_EMIT colorsChanged(p->colors);
     setDirty(true);
 }
 
-bool ColorPalette::loadImage(const QImage& image)
+bool ColorPalette::loadImage(const QImage& image, bool unique, int max_colors)
 {
     if ( image.isNull() )
         return false;
-    setColumns(image.width());
+
+    QImage rgb = image.convertToFormat(QImage::Format_RGB32);
+    const int width = rgb.width();
+    const int height = rgb.height();
+    const qint64 pixels = qint64(width) * height;
+    const qint64 limit = max_colors > 0 ? qMin<qint64>(max_colors, pixels) : pixels;
 
     p->colors.clear();
-    p->colors.reserve(image.width()*image.height());
-    for ( int y = 0; y < image.height(); y++ )
+    p->colors.reserve(unique ? qMin<qint64>(limit, 4096) : limit);
+
+    RgbSet seen;
+    for ( int y = 0; y < height && p->colors.size() < limit; y++ )
     {
-        for ( int x = 0; x < image.width(); x++ )
+        const QRgb* line = reinterpret_cast<const QRgb*>(rgb.constScanLine(y));
+        for ( int x = 0; x < width && p->colors.size() < limit; x++ )
         {
-            QColor color ( image.pixel(x, y) );
-            color.setAlpha(255);
-            p->colors.push_back(qMakePair(color,QString()));
+            QRgb color = line[x] | 0xff000000;
+            if ( !unique || seen.insert(color) )
+                p->colors.push_back(qMakePair(QColor(color), QString()));
         }
     }
+
+    // Keep the image layout only if every pixel has been used
+    setColumns(p->colors.size() == pixels ? width : 0);
+    p->touch();
     Q_EMIT colorsChanged(p->colors);
     setDirty(true);
     return true;
 }
 
-ColorPalette ColorPalette::fromImage(const QImage& image)
+ColorPalette ColorPalette::fromImage(const QImage& image, bool unique, int max_colors)
 {
     ColorPalette p;
-    p.loadImage(image);
+    p.loadImage(image, unique, max_colors);
     return p;
 }
 
@@ -190,67 +419,26 @@ bool ColorPalette::load(const QString& name)
     p->columns = 0;
     p->dirty = false;
     p->name = QFileInfo(name).baseName();
+    p->touch();
 
     QFile file(name);
+    const PaletteFormat* format = nullptr;
+    if ( file.open(QFile::ReadOnly) )
+        format = PaletteFormat::detect(file, name);
 
-    if ( !file.open(QFile::ReadOnly|QFile::Text) )
-    {
-        emitUpdate();
-        return false;
-    }
-
-    QTextStream stream( &file );
-
-    if ( stream.readLine() != QLatin1String("GIMP Palette") )
+    if ( !format || !format->read(file, *this) )
     {
+        p->format = nullptr;
+        p->colors.clear();
         emitUpdate();
         return false;
     }
+    p->format = format;
 
-    QString line;
-
-    // parse properties
-    QHash<QString,QString> properties;
-    while( !stream.atEnd() )
-    {
-        line = stream.readLine();
-        if ( line.isEmpty() )
-            continue;
-        if ( line[0] == '#' )
-            break;
-        int colon = line.indexOf(':');
-        if ( colon == -1 )
-            break;
-        properties[line.left(colon).toLower()] =
-            line.right(line.size() - colon - 1).trimmed();
-    }
-    /// \todo Store extra properties in the palette object
-    setName(properties[QStringLiteral("name")]);
-    setColumns(properties[QStringLiteral("columns")].toInt());
-
-    // Skip comments
-    if ( !stream.atEnd() && line[0] == '#' )
-        while( !stream.atEnd() )
-        {
-            qint64 pos = stream.pos();
-            line = stream.readLine();
-            if ( !line.isEmpty() && line[0] != '#' )
-            {
-                stream.seek(pos);
-                break;
-            }
-        }
-
-    while( !stream.atEnd() )
-    {
-        int r = 0, g = 0, b = 0;
-        stream >> r >> g >> b;
-        line = stream.readLine().trimmed();
-        p->colors.push_back(qMakePair(QColor(r, g, b), line));
-    }
-
-    Q_EMIT colorsChanged(p->colors);
-    setDirty(false);
+    // The fields above have been changed directly and the format setters
+    // don't emit when the values match the cleared ones (eg: no colors)
+    p->dirty = false;
+    emitUpdate();
 
     return true;
 }
@@ -276,34 +464,36 @@ bool ColorPalette::save()
         filename = unnamed(p->name)+".gpl";
     }
 
-    QFile file(filename);
-    if ( !file.open(QFile::Text|QFile::WriteOnly) )
-        return false;
-
-    QTextStream stream(&file);
-
-    stream << "GIMP Palette\n";
-    stream << "Name: " << unnamed(p->name) << '\n';
-    if ( p->columns )
-        stream << "Columns: " << p->columns << '\n';
-    /// \todo Options to add comments
-    stream << "#\n";
-
-    for ( int i = 0; i < p->colors.size(); i++ )
+    // Existing files keep their format, as several formats share extensions (eg: pal)
+    const PaletteFormat* format = p->format;
+    if ( !format )
     {
-        stream << qSetFieldWidth(3) << p->colors[i].first.red() << qSetFieldWidth(0) << ' '
-               << qSetFieldWidth(3) << p->colors[i].first.green() << qSetFieldWidth(0) << ' '
-               << qSetFieldWidth(3) << p->colors[i].first.blue() << qSetFieldWidth(0) << '\t'
-               << unnamed(p->colors[i].second) << '\n';
+        QFile existing(filename);
+        if ( existing.open(QFile::ReadOnly) )
+            format = PaletteFormat::detect(existing, filename);
     }
+    if ( !format || !format->canWrite() )
+        format = PaletteFormat::fromExtension(QFileInfo(filename).suffix());
+    if ( !format || !format->canWrite() )
+        format = PaletteFormat::fromId(QStringLiteral("gpl"));
+
+    // Written to a temporary file which replaces the original only on success
+    QSaveFile file(filename);
+    if ( !file.open(QFile::WriteOnly) )
+        return false;
 
-    if ( !file.error() )
+    if ( !format->write(file, *this) )
     {
-        setDirty(false);
-        return true;
+        file.cancelWriting();
+        return false;
     }
 
-    return false;
+    if ( !file.commit() )
+        return false;
+
+    p->format = format;
+    setDirty(false);
+    return true;
 }
 
 
@@ -320,6 +510,7 @@ void ColorPalette::setColumns(int columns)
 
     if ( columns != p->columns )
     {
+        p->touch_layout();
         setDirty(true);
         Q_EMIT columnsChanged( p->columns = columns );
     }
@@ -327,16 +518,30 @@ void ColorPalette::setColumns(int columns)
 
 void ColorPalette::setColors(const QVector<QColor>& colors)
 {
+    if ( colors.size() == p->colors.size() )
+    {
+        int i = 0;
+        while ( i < colors.size() && colors[i] == p->colors[i].first && p->colors[i].second.isEmpty() )
+            i++;
+        if ( i == colors.size() )
+            return;
+    }
+
     p->colors.clear();
     Q_FOREACH(const QColor& col, colors)
         p->colors.push_back(qMakePair(col,QString()));
+    p->touch();
     setDirty(true);
     Q_EMIT colorsChanged(p->colors);
 }
 
 void ColorPalette::setColors(const QVector<QPair<QColor,QString> >& colors)
 {
+    if ( colors == p->colors )
+        return;
+
     p->colors = colors;
+    p->touch();
     setDirty(true);
     Q_EMIT colorsChanged(p->colors);
 }
@@ -344,10 +549,12 @@ void ColorPalette::setColors(const QVector<QPair<QColor,QString> >& colors)
 
 void ColorPalette::setColorAt(int index, const QColor& color)
 {
-    if ( !p->valid_index(index) )
+    if ( !p->valid_index(index) || p->colors[index].first == color )
         return;
 
+    quint64 old_hash = p->entry_hash(index);
     p->colors[index].first = color;
+    p->touch_entry(index, old_hash);
 
     setDirty(true);
     Q_EMIT colorChanged(index);
@@ -356,11 +563,14 @@ void ColorPalette::setColorAt(int index, const QColor& color)
 
 void ColorPalette::setColorAt(int index, const QColor& color, const QString& name)
 {
-    if ( !p->valid_index(index) )
+    if ( !p->valid_index(index) ||
+         (p->colors[index].first == color && p->colors[index].second == name) )
         return;
 
+    quint64 old_hash = p->entry_hash(index);
     p->colors[index].first = color;
     p->colors[index].second = name;
+    p->touch_entry(index, old_hash);
     setDirty(true);
     Q_EMIT colorChanged(index);
     Q_EMIT colorsUpdated(p->colors);
@@ -368,10 +578,12 @@ void ColorPalette::setColorAt(int index, const QColor& color, const QString& nam
 
 void ColorPalette::setNameAt(int index, const QString& name)
 {
-    if ( !p->valid_index(index) )
+    if ( !p->valid_index(index) || p->colors[index].second == name )
         return;
 
+    quint64 old_hash = p->entry_hash(index);
     p->colors[index].second = name;
+    p->touch_entry(index, old_hash);
 
     setDirty(true);
     Q_EMIT colorChanged(index);
@@ -382,6 +594,7 @@ void ColorPalette::setNameAt(int index, const QString& name)
 void ColorPalette::appendColor(const QColor& color, const QString& name)
 {
     p->colors.push_back(qMakePair(color,name));
+    p->touch_appended();
     setDirty(true);
     Q_EMIT colorAdded(p->colors.size()-1);
     Q_EMIT colorsUpdated(p->colors);
@@ -393,6 +606,10 @@ void ColorPalette::insertColor(int index, const QColor& color, const QString& na
         return;
 
     p->colors.insert(index, qMakePair(color, name));
+    if ( index == p->colors.size() - 1 )
+        p->touch_appended();
+    else
+        p->touch();
 
     setDirty(true);
     Q_EMIT colorAdded(index);
@@ -404,23 +621,207 @@ void ColorPalette::eraseColor(int index)
     if ( !p->valid_index(index) )
         return;
 
-    p->colors.remove(index);
+    if ( index == p->colors.size() - 1 && p->entries_hashed )
+    {
+        // Removing the last color only drops its term from the hash
+        p->entries_hash -= p->entry_hash(index) * p->hash_power(index);
+        p->colors.remove(index);
+        p->touch_layout();
+    }
+    else
+    {
+        p->colors.remove(index);
+        p->touch();
+    }
 
     setDirty(true);
     Q_EMIT colorRemoved(index);
     Q_EMIT colorsUpdated(p->colors);
 }
 
+void ColorPalette::insertColors(int index, const QVector<QPair<QColor,QString> >& colors)
+{
+    if ( index < 0 || index > p->colors.size() || colors.empty() )
+        return;
+
+    if ( index == p->colors.size() )
+    {
+        p->colors += colors;
+        p->touch_layout();
+        if ( p->entries_hashed )
+        {
+            for ( int i = index; i < p->colors.size(); i++ )
+                p->entries_hash += p->entry_hash(i) * p->hash_power(i);
+        }
+    }
+    else
+    {
+        QVector<QPair<QColor,QString> > result;
+        result.reserve(p->colors.size() + colors.size());
+        result += p->colors.mid(0, index);
+        result += colors;
+        result += p->colors.mid(index);
+        p->colors.swap(result);
+        p->touch();
+    }
+
+    setDirty(true);
+    Q_EMIT colorsChanged(p->colors);
+}
+
+void ColorPalette::eraseColors(const QVector<int>& indexes)
+{
+    QVector<int> sorted = p->sorted_indexes(indexes);
+    if ( sorted.empty() )
+        return;
+
+    int count = p->colors.size();
+    if ( sorted.front() == count - sorted.size() && p->entries_hashed )
+    {
+        // Removing colors from the end only drops their terms from the hash
+        for ( int i : sorted )
+            p->entries_hash -= p->entry_hash(i) * p->hash_power(i);
+        p->colors.resize(sorted.front());
+        p->touch_layout();
+    }
+    else
+    {
+        // Compact the remaining colors in a single pass
+        int out = sorted.front();
+        for ( int in = out, next = 0; in < count; in++ )
+        {
+            if ( next < sorted.size() && sorted[next] == in )
+                next++;
+            else
+                p->colors[out++] = std::move(p->colors[in]);
+        }
+        p->colors.resize(out);
+        p->touch();
+    }
+
+    setDirty(true);
+    Q_EMIT colorsChanged(p->colors);
+}
+
+void ColorPalette::insertColors(const QVector<int>& indexes, const QVector<QPair<QColor,QString> >& colors)
+{
+    int count = p->colors.size() + colors.size();
+    if ( indexes.empty() || indexes.size() != colors.size() || indexes.front() < 0 || indexes.back() >= count )
+        return;
+    for ( int i = 1; i < indexes.size(); i++ )
+        if ( indexes[i] <= indexes[i-1] )
+            return;
+
+    int first = indexes.front();
+    int old_count = p->colors.size();
+    quint64 old_span = p->entries_hashed ? p->span_hash(first, old_count) : 0;
+
+    // Shift the following colors back in a single pass from the end
+    p->colors.resize(count);
+    for ( int out = count - 1, in = old_count - 1, next = colors.size() - 1; next >= 0; out-- )
+    {
+        if ( indexes[next] == out )
+            p->colors[out] = colors[next--];
+        else
+            p->colors[out] = std::move(p->colors[in--]);
+    }
+
+    p->touch_layout();
+    if ( p->entries_hashed )
+        p->entries_hash += p->span_hash(first, count) - old_span;
+
+    setDirty(true);
+    Q_EMIT colorsChanged(p->colors);
+}
+
+int ColorPalette::moveColors(const QVector<int>& indexes, int to)
+{
+    QVector<int> sorted = p->sorted_indexes(indexes);
+    if ( sorted.empty() || to < 0 || to > p->colors.size() )
+        return -1;
+
+    // Moved as a block that doesn't reach outside itself => noop
+    int first = to - std::count_if(sorted.begin(), sorted.end(), [to](int i){ return i < to; });
+    if ( sorted.back() - sorted.front() + 1 == sorted.size() && first == sorted.front() )
+        return first;
+
+    QVector<QPair<QColor,QString> > result;
+    result.reserve(p->colors.size());
+    for ( int i = 0, next = 0; i <= p->colors.size(); i++ )
+    {
+        if ( i == to )
+        {
+            for ( int moved : sorted )
+                result.push_back(p->colors[moved]);
+        }
+        if ( i == p->colors.size() )
+            break;
+        if ( next < sorted.size() && sorted[next] == i )
+            next++;
+        else
+            result.push_back(p->colors[i]);
+    }
+
+    p->colors.swap(result);
+    p->touch();
+    setDirty(true);
+    Q_EMIT colorsChanged(p->colors);
+    return first;
+}
+
+void ColorPalette::restoreMovedColors(int first, const QVector<int>& indexes)
+{
+    QVector<int> sorted = p->sorted_indexes(indexes);
+    int moved_count = sorted.size();
+    if ( sorted.size() != indexes.size() || sorted.empty() || first < 0 || first + moved_count > p->colors.size() )
+        return;
+
+    // Only the colors between the block and its original indexes change place
+    int begin = qMin(first, sorted.front());
+    int end = qMax(first + moved_count, sorted.back() + 1);
+    quint64 old_span = p->entries_hashed ? p->span_hash(begin, end) : 0;
+
+    QVector<QPair<QColor,QString> > moved = p->colors.mid(first, moved_count);
+    QVector<QPair<QColor,QString> > others;
+    others.reserve(end - begin - moved_count);
+    for ( int i = begin; i < end; i++ )
+        if ( i < first || i >= first + moved_count )
+            others.push_back(p->colors[i]);
+
+    for ( int i = begin, next = 0, other = 0; i < end; i++ )
+    {
+        if ( next < moved_count && sorted[next] == i )
+            p->colors[i] = moved[next++];
+        else
+            p->colors[i] = others[other++];
+    }
+
+    p->touch_layout();
+    if ( p->entries_hashed )
+        p->entries_hash += p->span_hash(begin, end) - old_span;
+
+    setDirty(true);
+    Q_EMIT colorsChanged(p->colors);
+}
+
 void ColorPalette::setName(const QString& name)
 {
+    if ( name == p->name )
+        return;
+
     setDirty(true);
-    p->name = name;
+    Q_EMIT nameChanged(p->name = name);
 }
 
 void ColorPalette::setFileName(const QString& name)
 {
+    if ( name == p->fileName )
+        return;
+
+    // A different file gets the format matching its extension
+    p->format = nullptr;
     setDirty(true);
-    p->fileName = name;
+    Q_EMIT fileNameChanged(p->fileName = name);
 }
 
 QString ColorPalette::unnamed(const QString& name) const
@@ -431,30 +832,71 @@ QString ColorPalette::unnamed(const QString& name) const
 
 QPixmap ColorPalette::preview(const QSize& size, const QColor& background) const
 {
-    if ( !size.isValid() || p->colors.empty() )
+    QImage image = previewImage(size, background);
+    if ( image.isNull() )
         return QPixmap();
+    return QPixmap::fromImage(image);
+}
 
-    QPixmap out( size );
-    out.fill(background);
-    QPainter painter(&out);
+QImage ColorPalette::previewImage(const QSize& size, const QColor& background) const
+{
+    if ( size.isEmpty() || p->colors.empty() )
+        return QImage();
 
+    QImage out(size, QImage::Format_ARGB32_Premultiplied);
+    if ( out.isNull() )
+        return QImage();
+
+    int width = size.width();
+    int height = size.height();
     int count = p->colors.size();
     int columns = p->columns;
     if ( !columns )
-        columns = std::ceil( std::sqrt( count * float(size.width()) / size.height() ) );
-    int rows = std::ceil( float(count) / columns );
-    QSizeF color_size(float(size.width()) / columns, float(size.height()) / rows);
-
-    for ( int y = 0, i = 0; y < rows && i < count; y++ )
-    {
-        for ( int x = 0; x < columns && i < count; x++, i++ )
+        columns = std::ceil( std::sqrt( count * float(width) / height ) );
+    columns = qMax(1, columns);
+    int rows = (count + columns - 1) / columns;
+
+    QRgb back = qPremultiply(background.rgba());
+    QVector<QRgb> cells;
+    cells.reserve(rows * columns);
+    for ( int i = 0; i < rows * columns; i++ )
+        cells.push_back(i < count ? blend_over(p->colors[i].first, back) : back);
+
+    // Cell boundaries are integers so adjacent cells never overlap
+    QVector<int> column_of(width);
+    for ( int x = 0; x < width; x++ )
+        column_of[x] = qint64(x) * columns / width;
+
+    // scanLine() isn't safe to call from multiple threads
+    uchar* bits = out.bits();
+    const int stride = out.bytesPerLine();
+    const int bytes = width * sizeof(QRgb);
+    auto render_rows = [&](int begin, int end) {
+        int band = -1;
+        const QRgb* band_line = nullptr;
+        for ( int y = begin; y < end; y++ )
         {
-            painter.fillRect(QRectF(x*color_size.width(), y*color_size.height(),
-                             color_size.width(), color_size.height()),
-                             p->colors[i].first
-                            );
+            QRgb* line = reinterpret_cast<QRgb*>(bits + qint64(y) * stride);
+            int row = qint64(y) * rows / height;
+            if ( row == band )
+            {
+                // Same row of cells as the previous scanline
+                std::memcpy(line, band_line, bytes);
+                continue;
+            }
+
+            const QRgb* row_cells = cells.constData() + row * columns;
+            for ( int x = 0; x < width; x++ )
+                line[x] = row_cells[column_of[x]];
+            band = row;
+            band_line = line;
         }
-    }
+    };
+
+    if ( qint64(width) * height < parallel_preview_pixels )
+        render_rows(0, height);
+    else
+        detail::parallel_for(0, height, 64, render_rows);
 
     return out;
 }
@@ -464,6 +906,57 @@ bool ColorPalette::dirty() const
     return p->dirty;
 }
 
+quint64 ColorPalette::revision() const
+{
+    return p->revision;
+}
+
+quint64 ColorPalette::contentHash() const
+{
+    quint64 hash = p->entries_hash_value();
+    hash ^= quint64(p->colors.size()) << 32 | quint32(p->columns);
+    return detail::fnv1a(reinterpret_cast<const char*>(p->name.constData()), p->name.size() * 2, hash);
+}
+
+bool ColorPalette::operator==(const ColorPalette& other) const
+{
+    if ( p == other.p )
+        return true;
+
+    if ( p->colors.size() != other.p->colors.size() || p->columns != other.p->columns ||
+         contentHash() != other.contentHash() || p->name != other.p->name )
+        return false;
+
+    // Same hash, make sure it isn't a collision
+    for ( int i = 0; i < p->colors.size(); i++ )
+    {
+        if ( p->colors[i].first.rgba() != other.p->colors[i].first.rgba() ||
+             p->colors[i].second != other.p->colors[i].second )
+            return false;
+    }
+    return true;
+}
+
+bool ColorPalette::operator!=(const ColorPalette& other) const
+{
+    return !(*this == other);
+}
+
+const ColorPaletteIndex& ColorPalette::searchIndex(ColorPaletteIndex::Metric metric) const
+{
+    std::shared_ptr<ColorPaletteIndex>& index = p->search_index[metric];
+    if ( !index )
+        index = std::make_shared<ColorPaletteIndex>(onlyColors(), metric);
+    return *index;
+}
+
+const ColorPaletteNameIndex& ColorPalette::nameIndex() const
+{
+    if ( !p->name_index )
+        p->name_index = std::make_shared<ColorPaletteNameIndex>(*this);
+    return *p->name_index;
+}
+
 void ColorPalette::setDirty(bool dirty)
 {
     if ( dirty != p->dirty )
@@ -495,4 +988,123 @@ ColorPalette ColorPalette::fromColorTable(const QVector<QRgb>& table)
     return palette;
 }
 
+QString ColorPalette::mimeType()
+{
+    return QStringLiteral("application/x-color-palette");
+}
+
+QMimeData* ColorPalette::mimeData() const
+{
+    QMimeData* data = new QMimeData;
+
+    QByteArray bytes;
+    QDataStream stream(&bytes, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << mime_magic << mime_version << p->name << qint32(p->columns)
+           << quint32(p->colors.size());
+    for ( const auto& color : p->colors )
+        stream << quint32(color.first.rgba()) << color.second;
+    data->setData(mimeType(), bytes);
+
+    if ( !p->colors.empty() )
+        data->setColorData(p->colors[0].first);
+
+    // Text editors and other applications get a GIMP palette
+    if ( p->colors.size() == 1 )
+    {
+        data->setText(p->colors[0].first.name());
+    }
+    else if ( const PaletteFormat* format = PaletteFormat::fromId(QStringLiteral("gpl")) )
+    {
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        if ( format->write(buffer, *this) )
+            data->setText(QString::fromUtf8(buffer.data()));
+    }
+
+    return data;
+}
+
+bool ColorPalette::canDecode(const QMimeData* data)
+{
+    if ( data->hasFormat(mimeType()) || data->hasColor() )
+        return true;
+    if ( !data->hasText() )
+        return false;
+
+    QString text = data->text();
+    const PaletteFormat* format = PaletteFormat::fromId(QStringLiteral("gpl"));
+    if ( format && format->probe(text.left(PaletteFormat::probe_size).toUtf8()) )
+        return true;
+    return QColor(text.trimmed()).isValid();
+}
+
+ColorPalette ColorPalette::fromMimeData(const QMimeData* data)
+{
+    ColorPalette palette;
+
+    if ( data->hasFormat(mimeType()) )
+    {
+        QDataStream stream(data->data(mimeType()));
+        stream.setVersion(QDataStream::Qt_5_0);
+        quint32 magic = 0;
+        quint8 version = 0;
+        qint32 columns = 0;
+        quint32 count = 0;
+        stream >> magic >> version;
+        if ( magic == mime_magic && version == mime_version )
+        {
+            stream >> palette.p->name >> columns >> count;
+            palette.p->columns = qMax(0, columns);
+            // Each color takes at least 8 bytes, don't trust count any further
+            palette.p->colors.reserve(qMin<qint64>(count, stream.device()->bytesAvailable() / 8));
+            for ( quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++ )
+            {
+                quint32 rgba;
+                QString name;
+                stream >> rgba >> name;
+                if ( stream.status() == QDataStream::Ok )
+                    palette.p->colors.push_back(qMakePair(QColor::fromRgba(rgba), name));
+            }
+            palette.p->touch();
+            return palette;
+        }
+    }
+
+    if ( data->hasText() )
+    {
+        QByteArray text = data->text().toUtf8();
+        const PaletteFormat* format = PaletteFormat::fromId(QStringLiteral("gpl"));
+        if ( format && format->probe(text.left(PaletteFormat::probe_size)) )
+        {
+            QBuffer buffer(&text);
+            buffer.open(QIODevice::ReadOnly);
+            if ( format->read(buffer, palette) )
+            {
+                palette.setDirty(false);
+                return palette;
+            }
+            palette = ColorPalette();
+        }
+    }
+
+    if ( data->hasColor() )
+    {
+        QString name = data->hasText() ? data->text() : QString();
+        palette.p->colors.push_back(qMakePair(data->colorData().value<QColor>(), name));
+        palette.p->touch();
+    }
+    else if ( data->hasText() )
+    {
+        QColor color(data->text().trimmed());
+        if ( color.isValid() )
+        {
+            palette.p->colors.push_back(qMakePair(color, QString()));
+            palette.p->touch();
+        }
+    }
+
+    return palette;
+}
+
 } // namespace color_widgets
@@ -0,0 +1,374 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "color_palette_cache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <QBuffer>
+#include <QDateTime>
+#include <QSaveFile>
+#include "QtColorWidgets/color_palette_format.hpp"
+
+namespace color_widgets {
+namespace detail {
+
+namespace {
+
+const char cache_magic[8] = {'Q', 'C', 'W', 'P', 'A', 'L', 'C', '\0'};
+const quint32 cache_byte_order = 0x01020304;
+const quint32 cache_version = 1;
+
+struct CacheHeader
+{
+    char    magic[8];
+    quint32 byte_order;
+    quint32 version;
+    quint32 entry_count;
+    quint32 color_count;
+    quint64 colors_offset;      ///< QRgb[color_count]
+    quint64 names_offset;       ///< CacheString[color_count]
+    quint64 strings_offset;     ///< UTF-16 string pool
+    quint64 strings_size;       ///< Size of the string pool in characters
+};
+
+struct CacheString
+{
+    quint32 offset;
+    quint32 length;
+};
+
+struct CacheEntry
+{
+    qint64      size;
+    qint64      mtime;
+    quint64     hash;
+    CacheString path;
+    CacheString name;
+    quint32     color_offset;
+    quint32     color_count;
+    qint32      columns;
+    quint32     reserved;
+};
+
+qint64 modification_time(const QFileInfo& file)
+{
+    return file.lastModified().toMSecsSinceEpoch();
+}
+
+/**
+ * \brief Palette data to be written to the cache file
+ */
+struct CacheRecord
+{
+    QString path;
+    qint64  size;
+    qint64  mtime;
+    quint64 hash;
+    QString name;
+    int     columns;
+    QVector<QPair<QColor,QString> > colors;
+};
+
+} // namespace
+
+
+bool load_palette(const QByteArray& data, const QString& path, ColorPalette& palette)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+
+    palette.setName(QFileInfo(path).baseName());
+    palette.setColumns(0);
+
+    const PaletteFormat* format = PaletteFormat::detect(buffer, path);
+    if ( !format || !format->read(buffer, palette) )
+        return false;
+
+    palette.setFileName(path);
+    palette.setDirty(false);
+    return true;
+}
+
+
+class PaletteCache::Private
+{
+public:
+    QFile file;
+    const uchar* data = nullptr;
+    qint64 size = 0;
+    const CacheHeader* header = nullptr;
+    const CacheEntry* entries = nullptr;
+    const QRgb* colors = nullptr;
+    const CacheString* names = nullptr;
+    const ushort* strings = nullptr;
+
+    QVector<CacheRecord> records;
+    bool changed = false;
+
+    QString string(const CacheString& str) const
+    {
+        if ( quint64(str.offset) + str.length > header->strings_size )
+            return QString();
+        return QString::fromUtf16(strings + str.offset, str.length);
+    }
+
+    /**
+     * \brief Compares the path of an entry without copying the string data
+     */
+    int compare(const CacheEntry& entry, const QString& path) const
+    {
+        if ( quint64(entry.path.offset) + entry.path.length > header->strings_size )
+            return -1;
+        QString entry_path = QString::fromRawData(
+            reinterpret_cast<const QChar*>(strings + entry.path.offset),
+            entry.path.length
+        );
+        return entry_path.compare(path);
+    }
+
+    const CacheEntry* find(const QString& path) const
+    {
+        if ( !header )
+            return nullptr;
+
+        const CacheEntry* begin = entries;
+        const CacheEntry* end = entries + header->entry_count;
+        const CacheEntry* it = std::lower_bound(begin, end, path,
+            [this](const CacheEntry& entry, const QString& value) {
+                return compare(entry, value) < 0;
+        });
+        if ( it != end && compare(*it, path) == 0 )
+            return it;
+        return nullptr;
+    }
+
+    bool load(const CacheEntry& entry, const QString& path, ColorPalette& palette) const
+    {
+        if ( quint64(entry.color_offset) + entry.color_count > header->color_count )
+            return false;
+
+        QVector<QPair<QColor,QString> > colors;
+        colors.reserve(entry.color_count);
+        for ( quint32 i = entry.color_offset; i < entry.color_offset + entry.color_count; i++ )
+            colors.push_back(qMakePair(QColor::fromRgba(this->colors[i]), string(names[i])));
+
+        palette.setName(string(entry.name));
+        palette.setColumns(entry.columns);
+        palette.setColors(colors);
+        palette.setFileName(path);
+        palette.setDirty(false);
+        return true;
+    }
+
+    bool validate()
+    {
+        if ( size < qint64(sizeof(CacheHeader)) )
+            return false;
+
+        header = reinterpret_cast<const CacheHeader*>(data);
+        if ( std::memcmp(header->magic, cache_magic, sizeof(cache_magic)) != 0 ||
+             header->byte_order != cache_byte_order ||
+             header->version != cache_version )
+            return false;
+
+        quint64 entries_end = sizeof(CacheHeader) + quint64(header->entry_count) * sizeof(CacheEntry);
+        if ( entries_end > header->colors_offset ||
+             header->colors_offset + quint64(header->color_count) * sizeof(QRgb) > header->names_offset ||
+             header->names_offset + quint64(header->color_count) * sizeof(CacheString) > header->strings_offset ||
+             header->strings_offset + header->strings_size * sizeof(ushort) > quint64(size) )
+            return false;
+
+        entries = reinterpret_cast<const CacheEntry*>(data + sizeof(CacheHeader));
+        colors = reinterpret_cast<const QRgb*>(data + header->colors_offset);
+        names = reinterpret_cast<const CacheString*>(data + header->names_offset);
+        strings = reinterpret_cast<const ushort*>(data + header->strings_offset);
+        return true;
+    }
+
+    void close()
+    {
+        if ( data )
+            file.unmap(const_cast<uchar*>(data));
+        file.close();
+        data = nullptr;
+        header = nullptr;
+        size = 0;
+    }
+};
+
+PaletteCache::PaletteCache(const QString& file_name)
+    : p(new Private)
+{
+    p->file.setFileName(file_name);
+}
+
+PaletteCache::~PaletteCache()
+{
+    p->close();
+    delete p;
+}
+
+bool PaletteCache::open()
+{
+    p->close();
+
+    if ( !p->file.open(QFile::ReadOnly) )
+        return false;
+
+    p->size = p->file.size();
+    p->data = p->file.map(0, p->size);
+    if ( !p->data || !p->validate() )
+    {
+        p->close();
+        return false;
+    }
+
+    return true;
+}
+
+bool PaletteCache::load(const QFileInfo& file, ColorPalette& palette, quint64& hash) const
+{
+    QString path = file.absoluteFilePath();
+    const CacheEntry* entry = p->find(path);
+    if ( !entry || entry->size != file.size() || entry->mtime != modification_time(file) )
+        return false;
+
+    hash = entry->hash;
+    return p->load(*entry, path, palette);
+}
+
+bool PaletteCache::load(const QFileInfo& file, quint64 hash, ColorPalette& palette) const
+{
+    QString path = file.absoluteFilePath();
+    const CacheEntry* entry = p->find(path);
+    if ( !entry || entry->hash != hash )
+        return false;
+
+    return p->load(*entry, path, palette);
+}
+
+void PaletteCache::store(const QFileInfo& file, quint64 hash, const ColorPalette& palette, bool changed)
+{
+    CacheRecord record;
+    record.path = file.absoluteFilePath();
+    record.size = file.size();
+    record.mtime = modification_time(file);
+    record.hash = hash;
+    record.name = palette.name();
+    record.columns = palette.columns();
+    record.colors = palette.colors();
+    p->records.push_back(record);
+
+    if ( changed )
+        p->changed = true;
+}
+
+bool PaletteCache::save()
+{
+    // Files have been removed
+    if ( p->header && p->header->entry_count != quint32(p->records.size()) )
+        p->changed = true;
+
+    if ( !p->changed && p->header )
+        return true;
+
+    std::sort(p->records.begin(), p->records.end(),
+        [](const CacheRecord& a, const CacheRecord& b) {
+            return a.path < b.path;
+    });
+
+    QVector<CacheEntry> entries;
+    entries.reserve(p->records.size());
+    QVector<QRgb> colors;
+    QVector<CacheString> names;
+    QVector<ushort> strings;
+
+    auto add_string = [&strings](const QString& string) -> CacheString {
+        CacheString str;
+        str.offset = strings.size();
+        str.length = string.size();
+        for ( QChar c : string )
+            strings.push_back(c.unicode());
+        return str;
+    };
+
+    QString last_path;
+    for ( const CacheRecord& record : p->records )
+    {
+        // Same file found in multiple search paths
+        if ( !entries.empty() && last_path == record.path )
+            continue;
+        last_path = record.path;
+
+        CacheEntry entry;
+        std::memset(&entry, 0, sizeof(entry));
+        entry.size = record.size;
+        entry.mtime = record.mtime;
+        entry.hash = record.hash;
+        entry.path = add_string(record.path);
+        entry.name = add_string(record.name);
+        entry.color_offset = colors.size();
+        entry.color_count = record.colors.size();
+        entry.columns = record.columns;
+        for ( const auto& color : record.colors )
+        {
+            colors.push_back(color.first.rgba());
+            names.push_back(add_string(color.second));
+        }
+        entries.push_back(entry);
+    }
+
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.byte_order = cache_byte_order;
+    header.version = cache_version;
+    header.entry_count = entries.size();
+    header.color_count = colors.size();
+    header.colors_offset = sizeof(CacheHeader) + entries.size() * sizeof(CacheEntry);
+    header.names_offset = header.colors_offset + colors.size() * sizeof(QRgb);
+    header.strings_offset = header.names_offset + names.size() * sizeof(CacheString);
+    header.strings_size = strings.size();
+
+    // The old file might still be mapped
+    QString file_name = p->file.fileName();
+    p->close();
+
+    QSaveFile file(file_name);
+    if ( !file.open(QFile::WriteOnly) )
+        return false;
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(entries.constData()), entries.size() * sizeof(CacheEntry));
+    file.write(reinterpret_cast<const char*>(colors.constData()), colors.size() * sizeof(QRgb));
+    file.write(reinterpret_cast<const char*>(names.constData()), names.size() * sizeof(CacheString));
+    file.write(reinterpret_cast<const char*>(strings.constData()), strings.size() * sizeof(ushort));
+
+    if ( !file.commit() )
+        return false;
+
+    p->changed = false;
+    return true;
+}
+
+} // namespace detail
+} // namespace color_widgets
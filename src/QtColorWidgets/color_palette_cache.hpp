@@ -0,0 +1,100 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_COLOR_PALETTE_CACHE_HPP
+#define COLOR_WIDGETS_COLOR_PALETTE_CACHE_HPP
+
+#include <QFile>
+#include <QFileInfo>
+#include <QVector>
+#include "QtColorWidgets/color_palette.hpp"
+#include "color_hash.hpp"
+
+namespace color_widgets {
+namespace detail {
+
+/**
+ * \brief Loads a palette from the contents of a file
+ * \param data Contents of the file
+ * \param path File name, used for the format detection and the palette file name
+ */
+bool load_palette(const QByteArray& data, const QString& path, ColorPalette& palette);
+
+/**
+ * \brief Binary cache of parsed palette files
+ *
+ * The cache is a single memory-mapped file containing a table of entries
+ * sorted by path, each with the size, modification time and content hash
+ * of the original file, followed by packed color, name and string tables.
+ *
+ * Entries are validated against the file stats, if those don't match
+ * the content hash is used to avoid parsing files which have just been touched.
+ *
+ * The file is rewritten by save() only if any entry has changed.
+ */
+class PaletteCache
+{
+public:
+    explicit PaletteCache(const QString& file_name);
+    ~PaletteCache();
+
+    PaletteCache(const PaletteCache&) = delete;
+    PaletteCache& operator=(const PaletteCache&) = delete;
+
+    /**
+     * \brief Maps the cache file
+     * \returns \b false if the file is missing or invalid
+     */
+    bool open();
+
+    /**
+     * \brief Loads a palette if the cached entry matches the file stats
+     * \param[out] hash Content hash of the cached file
+     * \note Thread-safe after open()
+     */
+    bool load(const QFileInfo& file, ColorPalette& palette, quint64& hash) const;
+
+    /**
+     * \brief Loads a palette if the cached entry matches the content hash
+     * \note Thread-safe after open()
+     */
+    bool load(const QFileInfo& file, quint64 hash, ColorPalette& palette) const;
+
+    /**
+     * \brief Records a palette to be written on save()
+     * \param changed Whether the palette has not been loaded from the cache
+     */
+    void store(const QFileInfo& file, quint64 hash, const ColorPalette& palette, bool changed);
+
+    /**
+     * \brief Writes the stored palettes if there has been any change
+     */
+    bool save();
+
+private:
+    class Private;
+    Private* p;
+};
+
+} // namespace detail
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_COLOR_PALETTE_CACHE_HPP
@@ -0,0 +1,253 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "QtColorWidgets/color_palette_commands.hpp"
+#include <algorithm>
+#include <numeric>
+
+namespace color_widgets {
+
+namespace {
+
+enum CommandId
+{
+    SetColorId = 0x436f6c,
+};
+
+/**
+ * \brief Sorted valid indexes, without duplicates
+ */
+QVector<int> sorted_indexes(QVector<int> indexes, int count)
+{
+    std::sort(indexes.begin(), indexes.end());
+    indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+    indexes.erase(std::remove_if(indexes.begin(), indexes.end(),
+        [count](int i){ return i < 0 || i >= count; }), indexes.end());
+    return indexes;
+}
+
+} // namespace
+
+ColorPaletteCommand::ColorPaletteCommand(ColorPalette* palette, const QString& text, QUndoCommand* parent)
+    : QUndoCommand(text, parent), palette_(palette)
+{
+}
+
+
+SetColorCommand::SetColorCommand(ColorPalette* palette, int index, const QColor& color,
+                                 const QString& name, QUndoCommand* parent)
+    : ColorPaletteCommand(palette, tr("Change Color"), parent),
+      index(index),
+      old_color(palette->colorAt(index).rgba()),
+      old_name(palette->nameAt(index)),
+      new_color(color.rgba()),
+      new_name(name)
+{
+    if ( index < 0 || index >= palette->count() )
+        setObsolete(true);
+}
+
+SetColorCommand::SetColorCommand(ColorPalette* palette, int index, const QColor& color,
+                                 QUndoCommand* parent)
+    : SetColorCommand(palette, index, color, palette->nameAt(index), parent)
+{
+}
+
+void SetColorCommand::redo()
+{
+    palette_->setColorAt(index, QColor::fromRgba(new_color), new_name);
+}
+
+void SetColorCommand::undo()
+{
+    palette_->setColorAt(index, QColor::fromRgba(old_color), old_name);
+}
+
+int SetColorCommand::id() const
+{
+    return SetColorId;
+}
+
+bool SetColorCommand::mergeWith(const QUndoCommand* other)
+{
+    const SetColorCommand* command = static_cast<const SetColorCommand*>(other);
+    if ( command->palette_ != palette_ || command->index != index )
+        return false;
+
+    new_color = command->new_color;
+    new_name = command->new_name;
+    // Changing a color back and forth leaves nothing to undo
+    setObsolete(new_color == old_color && new_name == old_name);
+    return true;
+}
+
+
+InsertColorCommand::InsertColorCommand(ColorPalette* palette, int index, const QColor& color,
+                                       const QString& name, QUndoCommand* parent)
+    : ColorPaletteCommand(palette, tr("Add Color"), parent),
+      index(index),
+      color(color.rgba()),
+      name(name)
+{
+    if ( index < 0 || index > palette->count() )
+        setObsolete(true);
+}
+
+void InsertColorCommand::redo()
+{
+    palette_->insertColor(index, QColor::fromRgba(color), name);
+}
+
+void InsertColorCommand::undo()
+{
+    palette_->eraseColor(index);
+}
+
+
+RemoveColorCommand::RemoveColorCommand(ColorPalette* palette, int index, QUndoCommand* parent)
+    : ColorPaletteCommand(palette, tr("Remove Color"), parent),
+      index(index),
+      color(palette->colorAt(index).rgba()),
+      name(palette->nameAt(index))
+{
+    if ( index < 0 || index >= palette->count() )
+        setObsolete(true);
+}
+
+void RemoveColorCommand::redo()
+{
+    palette_->eraseColor(index);
+}
+
+void RemoveColorCommand::undo()
+{
+    palette_->insertColor(index, QColor::fromRgba(color), name);
+}
+
+
+MoveColorCommand::MoveColorCommand(ColorPalette* palette, int from, int to, QUndoCommand* parent)
+    : ColorPaletteCommand(palette, tr("Move Color"), parent),
+      from(from),
+      to(to)
+{
+    if ( from == to || from < 0 || from >= palette->count() || to < 0 || to >= palette->count() )
+        setObsolete(true);
+}
+
+void MoveColorCommand::redo()
+{
+    move(from, to);
+}
+
+void MoveColorCommand::undo()
+{
+    move(to, from);
+}
+
+void MoveColorCommand::move(int from, int to)
+{
+    QColor color = palette_->colorAt(from);
+    QString name = palette_->nameAt(from);
+    palette_->eraseColor(from);
+    palette_->insertColor(to, color, name);
+}
+
+
+InsertColorsCommand::InsertColorsCommand(ColorPalette* palette, int index,
+                                         const QVector<QPair<QColor,QString> >& colors,
+                                         QUndoCommand* parent)
+    : ColorPaletteCommand(palette, tr("Add %n Color(s)", "", colors.size()), parent),
+      index(index),
+      colors(colors)
+{
+    if ( index < 0 || index > palette->count() || colors.empty() )
+        setObsolete(true);
+}
+
+void InsertColorsCommand::redo()
+{
+    palette_->insertColors(index, colors);
+}
+
+void InsertColorsCommand::undo()
+{
+    QVector<int> range(colors.size());
+    std::iota(range.begin(), range.end(), index);
+    palette_->eraseColors(range);
+}
+
+
+RemoveColorsCommand::RemoveColorsCommand(ColorPalette* palette, const QVector<int>& indexes,
+                                         QUndoCommand* parent)
+    : ColorPaletteCommand(palette, QString(), parent),
+      indexes(sorted_indexes(indexes, palette->count()))
+{
+    setText(tr("Remove %n Color(s)", "", this->indexes.size()));
+    colors.reserve(this->indexes.size());
+    for ( int i : this->indexes )
+        colors.push_back(qMakePair(palette->colorAt(i), palette->nameAt(i)));
+    if ( this->indexes.empty() )
+        setObsolete(true);
+}
+
+void RemoveColorsCommand::redo()
+{
+    palette_->eraseColors(indexes);
+}
+
+void RemoveColorsCommand::undo()
+{
+    palette_->insertColors(indexes, colors);
+}
+
+
+MoveColorsCommand::MoveColorsCommand(ColorPalette* palette, const QVector<int>& indexes,
+                                     int to, QUndoCommand* parent)
+    : ColorPaletteCommand(palette, QString(), parent),
+      indexes(sorted_indexes(indexes, palette->count())),
+      to(to),
+      first_(-1)
+{
+    setText(tr("Move %n Color(s)", "", this->indexes.size()));
+    if ( this->indexes.empty() || to < 0 || to > palette->count() )
+    {
+        setObsolete(true);
+        return;
+    }
+
+    // A block moved within itself stays in place
+    int first = to - (std::lower_bound(this->indexes.begin(), this->indexes.end(), to) - this->indexes.begin());
+    if ( this->indexes.back() - this->indexes.front() + 1 == this->indexes.size() &&
+         first == this->indexes.front() )
+        setObsolete(true);
+}
+
+void MoveColorsCommand::redo()
+{
+    first_ = palette_->moveColors(indexes, to);
+}
+
+void MoveColorsCommand::undo()
+{
+    palette_->restoreMovedColors(first_, indexes);
+}
+
+} // namespace color_widgets
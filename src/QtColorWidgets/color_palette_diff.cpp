@@ -0,0 +1,410 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "QtColorWidgets/color_palette_diff.hpp"
+#include <algorithm>
+#include <vector>
+#include "color_hash.hpp"
+
+namespace color_widgets {
+
+namespace {
+
+typedef QVector<QPair<QColor,QString> > Entries;
+
+/**
+ * \brief Maximum number of values kept to reconstruct the edit path
+ *
+ * This is reached with around 2000 differences, past that the rest of the
+ * palettes is reported as a single replacement.
+ */
+const std::size_t trace_budget = 1 << 22;
+
+bool same_entry(const QPair<QColor,QString>& a, const QPair<QColor,QString>& b)
+{
+    return a.first.rgba() == b.first.rgba() && a.second == b.second;
+}
+
+/**
+ * \brief Colors of a palette with their hashes, to compare them quickly
+ */
+struct Sequence
+{
+    explicit Sequence(const ColorPalette& palette)
+        : entries(palette.colors())
+    {
+        hashes.reserve(entries.size());
+        for ( const auto& entry : entries )
+            hashes.push_back(detail::palette_entry_hash(entry.first, entry.second));
+    }
+
+    int size() const
+    {
+        return entries.size();
+    }
+
+    bool equal(int index, const Sequence& other, int other_index) const
+    {
+        return hashes[index] == other.hashes[other_index] &&
+               same_entry(entries[index], other.entries[other_index]);
+    }
+
+    Entries entries;
+    QVector<quint64> hashes;
+};
+
+/**
+ * \brief Finds the longest common subsequence of the given ranges with Myers' algorithm
+ * \param[out] matches Pairs of matching indices, appended in order
+ * \returns \b false if the ranges are too different to keep track of the edits
+ */
+bool myers(const Sequence& a, int a_begin, int a_end,
+           const Sequence& b, int b_begin, int b_end,
+           QVector<QPair<int, int>>& matches)
+{
+    const int n = a_end - a_begin;
+    const int m = b_end - b_begin;
+    const int max = n + m;
+    const int offset = max + 1;
+
+    // Furthest x reached on each diagonal k = x - y
+    std::vector<int> v(2 * max + 3, 0);
+    // Values of v on diagonals -d..d before step d
+    std::vector<std::vector<int>> trace;
+    std::size_t traced = 0;
+
+    int edits = -1;
+    for ( int d = 0; d <= max && edits == -1; d++ )
+    {
+        traced += 2 * d + 1;
+        if ( traced > trace_budget )
+            return false;
+        trace.emplace_back(v.begin() + offset - d, v.begin() + offset + d + 1);
+
+        for ( int k = -d; k <= d; k += 2 )
+        {
+            int x;
+            if ( k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]) )
+                x = v[offset + k + 1];
+            else
+                x = v[offset + k - 1] + 1;
+            int y = x - k;
+
+            while ( x < n && y < m && a.equal(a_begin + x, b, b_begin + y) )
+            {
+                x++;
+                y++;
+            }
+
+            v[offset + k] = x;
+            if ( x >= n && y >= m )
+            {
+                edits = d;
+                break;
+            }
+        }
+    }
+
+    // Walk the path backwards collecting the diagonal moves
+    QVector<QPair<int, int>> reversed;
+    int x = n;
+    int y = m;
+    for ( int d = edits; d > 0; d-- )
+    {
+        const std::vector<int>& previous = trace[d];
+        auto at = [&previous, d](int k) { return previous[k + d]; };
+
+        int k = x - y;
+        int previous_k = (k == -d || (k != d && at(k - 1) < at(k + 1))) ? k + 1 : k - 1;
+        int previous_x = at(previous_k);
+        int previous_y = previous_x - previous_k;
+
+        while ( x > previous_x && y > previous_y )
+        {
+            x--;
+            y--;
+            reversed.push_back(qMakePair(a_begin + x, b_begin + y));
+        }
+        x = previous_x;
+        y = previous_y;
+    }
+    while ( x > 0 && y > 0 )
+    {
+        x--;
+        y--;
+        reversed.push_back(qMakePair(a_begin + x, b_begin + y));
+    }
+
+    for ( int i = reversed.size() - 1; i >= 0; i-- )
+        matches.push_back(reversed[i]);
+    return true;
+}
+
+/**
+ * \brief Range of the base palette replaced by a range of the edited one
+ */
+struct Hunk
+{
+    int old_begin;
+    int old_end;
+    int new_begin;
+    int new_end;
+
+    bool operator<(const Hunk& other) const
+    {
+        return old_begin != other.old_begin ? old_begin < other.old_begin : old_end < other.old_end;
+    }
+};
+
+QVector<Hunk> hunks(const QVector<ColorPaletteDiff::Run>& runs)
+{
+    QVector<Hunk> result;
+    for ( const ColorPaletteDiff::Run& run : runs )
+    {
+        Hunk hunk{
+            run.oldIndex,
+            run.oldIndex + (run.type == ColorPaletteDiff::Insert ? 0 : run.count),
+            run.newIndex,
+            run.newIndex + (run.type == ColorPaletteDiff::Remove ? 0 : run.count),
+        };
+
+        if ( !result.empty() && result.back().old_end == hunk.old_begin &&
+             result.back().new_end == hunk.new_begin )
+        {
+            result.back().old_end = hunk.old_end;
+            result.back().new_end = hunk.new_end;
+        }
+        else
+        {
+            result.push_back(hunk);
+        }
+    }
+    return result;
+}
+
+/**
+ * \brief Contents of base[begin, end) after applying the hunks of one side in [first, last)
+ */
+Entries apply_hunks(const Entries& base, int begin, int end,
+                    const QVector<Hunk>& side_hunks, int first, int last, const Entries& side)
+{
+    Entries result;
+    int pos = begin;
+    for ( int i = first; i < last; i++ )
+    {
+        const Hunk& hunk = side_hunks[i];
+        result += base.mid(pos, hunk.old_begin - pos);
+        result += side.mid(hunk.new_begin, hunk.new_end - hunk.new_begin);
+        pos = hunk.old_end;
+    }
+    result += base.mid(pos, end - pos);
+    return result;
+}
+
+bool same_entries(const Entries& a, const Entries& b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), same_entry);
+}
+
+template<class T>
+T merge_value(const T& base, const T& ours, const T& theirs, int& conflicts)
+{
+    if ( ours == theirs || theirs == base )
+        return ours;
+    if ( ours == base )
+        return theirs;
+    conflicts++;
+    return ours;
+}
+
+} // namespace
+
+class ColorPaletteDiff::Private
+{
+public:
+    QVector<Run> runs;
+
+    void compute(const ColorPalette& from, const ColorPalette& to)
+    {
+        runs.clear();
+
+        Sequence a(from);
+        Sequence b(to);
+        int n = a.size();
+        int m = b.size();
+
+        int prefix = 0;
+        while ( prefix < n && prefix < m && a.equal(prefix, b, prefix) )
+            prefix++;
+
+        int suffix = 0;
+        while ( suffix < n - prefix && suffix < m - prefix &&
+                a.equal(n - suffix - 1, b, m - suffix - 1) )
+            suffix++;
+
+        // If the palettes are too different there are no matches and the middle is replaced as a whole
+        QVector<QPair<int, int>> matches;
+        myers(a, prefix, n - suffix, b, prefix, m - suffix, matches);
+
+        // Everything between matching colors has been changed
+        int old_index = prefix;
+        int new_index = prefix;
+        for ( const auto& match : matches )
+        {
+            add_gap(old_index, match.first, new_index, match.second);
+            old_index = match.first + 1;
+            new_index = match.second + 1;
+        }
+        add_gap(old_index, n - suffix, new_index, m - suffix);
+    }
+
+    void add_gap(int old_begin, int old_end, int new_begin, int new_end)
+    {
+        int old_count = old_end - old_begin;
+        int new_count = new_end - new_begin;
+        int modified = qMin(old_count, new_count);
+
+        if ( modified > 0 )
+            runs.push_back(Run{Modify, old_begin, new_begin, modified});
+        if ( old_count > modified )
+            runs.push_back(Run{Remove, old_begin + modified, new_begin + modified, old_count - modified});
+        else if ( new_count > modified )
+            runs.push_back(Run{Insert, old_begin + modified, new_begin + modified, new_count - modified});
+    }
+};
+
+ColorPaletteDiff::ColorPaletteDiff()
+    : p(new Private)
+{
+}
+
+ColorPaletteDiff::ColorPaletteDiff(const ColorPalette& from, const ColorPalette& to)
+    : p(new Private)
+{
+    p->compute(from, to);
+}
+
+ColorPaletteDiff::ColorPaletteDiff(const ColorPaletteDiff& other)
+    : p(new Private(*other.p))
+{
+}
+
+ColorPaletteDiff& ColorPaletteDiff::operator=(const ColorPaletteDiff& other)
+{
+    *p = *other.p;
+    return *this;
+}
+
+ColorPaletteDiff::~ColorPaletteDiff()
+{
+    delete p;
+}
+
+QVector<ColorPaletteDiff::Run> ColorPaletteDiff::runs() const
+{
+    return p->runs;
+}
+
+bool ColorPaletteDiff::isEmpty() const
+{
+    return p->runs.empty();
+}
+
+ColorPalette ColorPaletteDiff::merge(const ColorPalette& base, const ColorPalette& ours,
+                                     const ColorPalette& theirs, int* conflicts)
+{
+    int conflict_count = 0;
+    QVector<Hunk> our_hunks = hunks(ColorPaletteDiff(base, ours).runs());
+    QVector<Hunk> their_hunks = hunks(ColorPaletteDiff(base, theirs).runs());
+    Entries base_colors = base.colors();
+    Entries our_colors = ours.colors();
+    Entries their_colors = theirs.colors();
+
+    Entries merged;
+    int pos = 0;
+    int i = 0;
+    int j = 0;
+    while ( i < our_hunks.size() || j < their_hunks.size() )
+    {
+        // Start a group from the first hunk, insertions go before changes at the same index
+        bool ours_first = j >= their_hunks.size() ||
+            (i < our_hunks.size() && !(their_hunks[j] < our_hunks[i]));
+        const Hunk& first = ours_first ? our_hunks[i] : their_hunks[j];
+        int begin = first.old_begin;
+        int end = first.old_end;
+        int our_end = i + ours_first;
+        int their_end = j + !ours_first;
+
+        // Extend the group with the hunks overlapping it, only insertions at the same index are ambiguous
+        auto overlaps = [&begin, &end](const Hunk& hunk) {
+            return hunk.old_begin < end ||
+                (hunk.old_begin == end && begin == end && hunk.old_begin == hunk.old_end);
+        };
+        while ( true )
+        {
+            if ( our_end < our_hunks.size() && overlaps(our_hunks[our_end]) )
+                end = qMax(end, our_hunks[our_end++].old_end);
+            else if ( their_end < their_hunks.size() && overlaps(their_hunks[their_end]) )
+                end = qMax(end, their_hunks[their_end++].old_end);
+            else
+                break;
+        }
+
+        merged += base_colors.mid(pos, begin - pos);
+        Entries our_version = apply_hunks(base_colors, begin, end, our_hunks, i, our_end, our_colors);
+        if ( j == their_end )
+        {
+            merged += our_version;
+        }
+        else
+        {
+            Entries their_version = apply_hunks(base_colors, begin, end, their_hunks, j, their_end, their_colors);
+            if ( i != our_end && !same_entries(our_version, their_version) )
+            {
+                conflict_count++;
+                merged += our_version;
+            }
+            else
+            {
+                merged += their_version;
+            }
+        }
+
+        pos = end;
+        i = our_end;
+        j = their_end;
+    }
+    merged += base_colors.mid(pos);
+
+    ColorPalette result(
+        merged,
+        merge_value(base.name(), ours.name(), theirs.name(), conflict_count),
+        merge_value(base.columns(), ours.columns(), theirs.columns(), conflict_count)
+    );
+    result.setFileName(ours.fileName());
+    result.setDirty(result != ours);
+
+    if ( conflicts )
+        *conflicts = conflict_count;
+    return result;
+}
+
+} // namespace color_widgets
@@ -0,0 +1,975 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "QtColorWidgets/color_palette_format.hpp"
+#include <cctype>
+#include <memory>
+#include <vector>
+#include <QDataStream>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSet>
+#include <QTextStream>
+#include "QtColorWidgets/color_palette.hpp"
+#include "QtColorWidgets/color_names.hpp"
+#include "color_space.hpp"
+
+namespace color_widgets {
+
+namespace {
+
+typedef QVector<QPair<QColor,QString> > ColorList;
+
+/**
+ * \brief First non-empty line in \p header, trimmed
+ */
+QByteArray first_line(const QByteArray& header)
+{
+    for ( const QByteArray& line : header.split('\n') )
+    {
+        QByteArray trimmed = line.trimmed();
+        if ( !trimmed.isEmpty() )
+            return trimmed;
+    }
+    return QByteArray();
+}
+
+bool is_hex(const QByteArray& string)
+{
+    for ( char c : string )
+        if ( !std::isxdigit(static_cast<unsigned char>(c)) )
+            return false;
+    return !string.isEmpty();
+}
+
+/**
+ * \brief Reads a UTF-16 string prefixed by its length (including the terminator)
+ */
+template<class SizeT>
+QString read_utf16(QDataStream& stream)
+{
+    SizeT length = 0;
+    stream >> length;
+    QString string;
+    string.reserve(length);
+    for ( SizeT i = 0; i < length && stream.status() == QDataStream::Ok; i++ )
+    {
+        quint16 c;
+        stream >> c;
+        if ( c )
+            string.push_back(QChar(c));
+    }
+    return string;
+}
+
+template<class SizeT>
+void write_utf16(QDataStream& stream, const QString& string)
+{
+    stream << SizeT(string.size() + 1);
+    for ( QChar c : string )
+        stream << quint16(c.unicode());
+    stream << quint16(0);
+}
+
+/**
+ * \brief Appends a non-negative integer right-aligned to \p width characters
+ */
+void append_number(QByteArray& out, int value, int width = 0)
+{
+    char digits[12];
+    int length = 0;
+    do
+    {
+        digits[length++] = '0' + value % 10;
+        value /= 10;
+    }
+    while ( value > 0 && length < int(sizeof(digits)) );
+
+    for ( int i = length; i < width; i++ )
+        out.append(' ');
+    while ( length > 0 )
+        out.append(digits[--length]);
+}
+
+/**
+ * \brief Writes the whole buffer to \p device
+ */
+bool write_all(QIODevice& device, const QByteArray& data)
+{
+    return device.write(data) == data.size();
+}
+
+/**
+ * \brief Same name used by ColorPalette::save()
+ */
+QString unnamed(const QString& name)
+{
+    return name.isEmpty() ? ColorPalette::tr("Unnamed") : name;
+}
+
+
+class GplFormat : public PaletteFormat
+{
+public:
+    QString id() const override { return QStringLiteral("gpl"); }
+    QString description() const override { return tr("GIMP Palettes"); }
+    QStringList extensions() const override { return QStringList() << QStringLiteral("gpl"); }
+
+    bool probe(const QByteArray& header) const override
+    {
+        return header.startsWith("GIMP Palette");
+    }
+
+    bool read(QIODevice& device, ColorPalette& palette) const override
+    {
+        QTextStream stream(&device);
+
+        if ( stream.readLine() != QLatin1String("GIMP Palette") )
+            return false;
+
+        ColorList colors;
+        bool header = true;
+        QString line;
+        while ( stream.readLineInto(&line) )
+        {
+            line = line.trimmed();
+            if ( line.isEmpty() || line[0] == '#' )
+                continue;
+
+            // Properties are only allowed before the colors
+            if ( header && !line[0].isDigit() )
+            {
+                int colon = line.indexOf(':');
+                if ( colon != -1 )
+                {
+                    /// \todo Store extra properties in the palette object
+                    QString key = line.left(colon).trimmed().toLower();
+                    QString value = line.mid(colon + 1).trimmed();
+                    if ( key == QLatin1String("name") && !value.isEmpty() )
+                        palette.setName(value);
+                    else if ( key == QLatin1String("columns") )
+                        palette.setColumns(value.toInt());
+                    continue;
+                }
+            }
+
+            header = false;
+            QColor color;
+            QString name;
+            if ( parseColor(line, color, name) )
+                colors.push_back(qMakePair(color, name));
+        }
+
+        palette.setColors(colors);
+        return true;
+    }
+
+    bool readHeader(QIODevice& device, ColorPalette& palette, int& count) const override
+    {
+        if ( device.readLine().trimmed() != "GIMP Palette" )
+            return false;
+
+        count = 0;
+        bool header = true;
+        while ( !device.atEnd() )
+        {
+            QByteArray line = device.readLine().trimmed();
+            if ( line.isEmpty() || line[0] == '#' )
+                continue;
+
+            bool digit = std::isdigit(static_cast<unsigned char>(line[0]));
+            if ( header && !digit )
+            {
+                int colon = line.indexOf(':');
+                if ( colon != -1 )
+                {
+                    QByteArray key = line.left(colon).trimmed().toLower();
+                    QString value = QString::fromUtf8(line.mid(colon + 1).trimmed());
+                    if ( key == "name" && !value.isEmpty() )
+                        palette.setName(value);
+                    else if ( key == "columns" )
+                        palette.setColumns(value.toInt());
+                    continue;
+                }
+            }
+
+            header = false;
+            if ( digit )
+                count++;
+        }
+
+        return true;
+    }
+
+    bool write(QIODevice& device, const ColorPalette& palette) const override
+    {
+        const auto colors = palette.colors();
+
+        // Formatted in memory and written at once, "RRR GGG BBB\tName\n"
+        QByteArray out;
+        out.reserve(64 + colors.size() * 32);
+
+        out.append("GIMP Palette\nName: ");
+        out.append(unnamed(palette.name()).toUtf8());
+        out.append('\n');
+        if ( palette.columns() )
+        {
+            out.append("Columns: ");
+            append_number(out, palette.columns());
+            out.append('\n');
+        }
+        /// \todo Options to add comments
+        out.append("#\n");
+
+        for ( const auto& color : colors )
+        {
+            append_number(out, color.first.red(), 3);
+            out.append(' ');
+            append_number(out, color.first.green(), 3);
+            out.append(' ');
+            append_number(out, color.first.blue(), 3);
+            out.append('\t');
+            out.append(unnamed(color.second).toUtf8());
+            out.append('\n');
+        }
+
+        return write_all(device, out);
+    }
+
+private:
+    /**
+     * \brief Parses a line in the form "R G B Name"
+     */
+    static bool parseColor(const QString& line, QColor& color, QString& name)
+    {
+        int components[3];
+        int pos = 0;
+        for ( int& component : components )
+        {
+            while ( pos < line.size() && line[pos].isSpace() )
+                pos++;
+            int start = pos;
+            while ( pos < line.size() && line[pos].isDigit() )
+                pos++;
+            if ( start == pos )
+                return false;
+            component = qBound(0, line.midRef(start, pos - start).toInt(), 255);
+        }
+        color = QColor(components[0], components[1], components[2]);
+        name = line.mid(pos).trimmed();
+        return true;
+    }
+};
+
+
+class JascFormat : public PaletteFormat
+{
+public:
+    QString id() const override { return QStringLiteral("jasc"); }
+    QString description() const override { return tr("JASC Palettes"); }
+    QStringList extensions() const override { return QStringList() << QStringLiteral("pal"); }
+
+    bool probe(const QByteArray& header) const override
+    {
+        return header.startsWith("JASC-PAL");
+    }
+
+    bool read(QIODevice& device, ColorPalette& palette) const override
+    {
+        QTextStream stream(&device);
+        if ( stream.readLine().trimmed() != QLatin1String("JASC-PAL") )
+            return false;
+        // Version
+        stream.readLine();
+        int count = stream.readLine().trimmed().toInt();
+
+        ColorList colors;
+        colors.reserve(qBound(0, count, 0x10000));
+        QString line;
+        while ( colors.size() < count && stream.readLineInto(&line) )
+        {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+            QStringList parts = line.split(' ', Qt::SkipEmptyParts);
+#else
+            QStringList parts = line.split(' ', QString::SkipEmptyParts);
+#endif
+            if ( parts.size() < 3 )
+                continue;
+            QColor color(parts[0].toInt(), parts[1].toInt(), parts[2].toInt());
+            if ( parts.size() > 3 )
+                color.setAlpha(parts[3].toInt());
+            colors.push_back(qMakePair(color, QString()));
+        }
+
+        palette.setColors(colors);
+        return true;
+    }
+
+    bool write(QIODevice& device, const ColorPalette& palette) const override
+    {
+        QTextStream stream(&device);
+        stream << "JASC-PAL\r\n0100\r\n" << palette.count() << "\r\n";
+        for ( int i = 0; i < palette.count(); i++ )
+        {
+            QColor color = palette.colorAt(i);
+            stream << color.red() << ' ' << color.green() << ' ' << color.blue() << "\r\n";
+        }
+        stream.flush();
+        return stream.status() == QTextStream::Ok;
+    }
+};
+
+
+class RiffFormat : public PaletteFormat
+{
+public:
+    QString id() const override { return QStringLiteral("riff"); }
+    QString description() const override { return tr("RIFF Palettes"); }
+    QStringList extensions() const override { return QStringList() << QStringLiteral("pal"); }
+
+    bool probe(const QByteArray& header) const override
+    {
+        return header.startsWith("RIFF") && header.mid(8, 4) == "PAL ";
+    }
+
+    bool read(QIODevice& device, ColorPalette& palette) const override
+    {
+        QDataStream stream(&device);
+        stream.setByteOrder(QDataStream::LittleEndian);
+
+        char id[4];
+        quint32 size;
+        if ( stream.readRawData(id, 4) != 4 || qstrncmp(id, "RIFF", 4) != 0 )
+            return false;
+        stream >> size;
+        if ( stream.readRawData(id, 4) != 4 || qstrncmp(id, "PAL ", 4) != 0 )
+            return false;
+
+        while ( stream.readRawData(id, 4) == 4 )
+        {
+            stream >> size;
+            if ( stream.status() != QDataStream::Ok )
+                return false;
+
+            if ( qstrncmp(id, "data", 4) != 0 )
+            {
+                // Chunks are padded to an even size
+                stream.skipRawData(size + (size & 1));
+                continue;
+            }
+
+            quint16 version, count;
+            stream >> version >> count;
+            ColorList colors;
+            colors.reserve(count);
+            for ( int i = 0; i < count; i++ )
+            {
+                quint8 r, g, b, flags;
+                stream >> r >> g >> b >> flags;
+                colors.push_back(qMakePair(QColor(r, g, b), QString()));
+            }
+            if ( stream.status() != QDataStream::Ok )
+                return false;
+
+            palette.setColors(colors);
+            return true;
+        }
+
+        return false;
+    }
+
+    bool write(QIODevice& device, const ColorPalette& palette) const override
+    {
+        QDataStream stream(&device);
+        stream.setByteOrder(QDataStream::LittleEndian);
+
+        quint16 count = qMin(palette.count(), 0xffff);
+        quint32 data_size = 4 + 4 * count;
+
+        stream.writeRawData("RIFF", 4);
+        stream << quint32(4 + 8 + data_size);
+        stream.writeRawData("PAL data", 8);
+        stream << data_size << quint16(0x0300) << count;
+        for ( int i = 0; i < count; i++ )
+        {
+            QColor color = palette.colorAt(i);
+            stream << quint8(color.red()) << quint8(color.green())
+                   << quint8(color.blue()) << quint8(0);
+        }
+        return stream.status() == QDataStream::Ok;
+    }
+};
+
+
+class AseFormat : public PaletteFormat
+{
+public:
+    QString id() const override { return QStringLiteral("ase"); }
+    QString description() const override { return tr("Adobe Swatch Exchange"); }
+    QStringList extensions() const override { return QStringList() << QStringLiteral("ase"); }
+
+    bool probe(const QByteArray& header) const override
+    {
+        return header.startsWith("ASEF");
+    }
+
+    bool read(QIODevice& device, ColorPalette& palette) const override
+    {
+        QDataStream stream(&device);
+        stream.setByteOrder(QDataStream::BigEndian);
+
+        char magic[4];
+        if ( stream.readRawData(magic, 4) != 4 || qstrncmp(magic, "ASEF", 4) != 0 )
+            return false;
+
+        quint16 major, minor;
+        quint32 blocks;
+        stream >> major >> minor >> blocks;
+
+        ColorList colors;
+        bool named = false;
+        for ( quint32 i = 0; i < blocks && stream.status() == QDataStream::Ok; i++ )
+        {
+            quint16 type;
+            quint32 length;
+            stream >> type >> length;
+            if ( !device.isSequential() && qint64(length) > device.size() )
+                return false;
+            QByteArray data(length, 0);
+            if ( stream.readRawData(data.data(), length) != int(length) )
+                return false;
+
+            QDataStream block(data);
+            block.setByteOrder(QDataStream::BigEndian);
+            block.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+            if ( type == 0xC001 && !named )
+            {
+                QString name = read_utf16<quint16>(block);
+                if ( !name.isEmpty() )
+                    palette.setName(name);
+                named = true;
+            }
+            else if ( type == 0x0001 )
+            {
+                QString name = read_utf16<quint16>(block);
+                char model[4];
+                block.readRawData(model, 4);
+                QColor color = readColor(block, model);
+                if ( color.isValid() )
+                    colors.push_back(qMakePair(color, name));
+            }
+        }
+
+        if ( stream.status() != QDataStream::Ok )
+            return false;
+
+        palette.setColors(colors);
+        return true;
+    }
+
+    bool write(QIODevice& device, const ColorPalette& palette) const override
+    {
+        QDataStream stream(&device);
+        stream.setByteOrder(QDataStream::BigEndian);
+        stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+        QString name = unnamed(palette.name());
+
+        stream.writeRawData("ASEF", 4);
+        stream << quint16(1) << quint16(0) << quint32(palette.count() + 2);
+
+        stream << quint16(0xC001) << quint32(2 + (name.size() + 1) * 2);
+        write_utf16<quint16>(stream, name);
+
+        for ( int i = 0; i < palette.count(); i++ )
+        {
+            QColor color = palette.colorAt(i);
+            QString color_name = palette.nameAt(i);
+            stream << quint16(0x0001) << quint32(2 + (color_name.size() + 1) * 2 + 4 + 12 + 2);
+            write_utf16<quint16>(stream, color_name);
+            stream.writeRawData("RGB ", 4);
+            stream << float(color.redF()) << float(color.greenF()) << float(color.blueF());
+            // Normal (ie: not global or spot) color
+            stream << quint16(2);
+        }
+
+        stream << quint16(0xC002) << quint32(0);
+        return stream.status() == QDataStream::Ok;
+    }
+
+private:
+    static QColor readColor(QDataStream& block, const char* model)
+    {
+        float v[4];
+        if ( qstrncmp(model, "RGB ", 4) == 0 )
+        {
+            block >> v[0] >> v[1] >> v[2];
+            return QColor::fromRgbF(qBound(0.f, v[0], 1.f), qBound(0.f, v[1], 1.f), qBound(0.f, v[2], 1.f));
+        }
+        if ( qstrncmp(model, "CMYK", 4) == 0 )
+        {
+            block >> v[0] >> v[1] >> v[2] >> v[3];
+            return QColor::fromCmykF(qBound(0.f, v[0], 1.f), qBound(0.f, v[1], 1.f),
+                                     qBound(0.f, v[2], 1.f), qBound(0.f, v[3], 1.f));
+        }
+        if ( qstrncmp(model, "LAB ", 4) == 0 )
+        {
+            block >> v[0] >> v[1] >> v[2];
+            return detail::color_from_lab(v[0] * 100, v[1], v[2]);
+        }
+        if ( qstrncmp(model, "Gray", 4) == 0 )
+        {
+            block >> v[0];
+            v[0] = qBound(0.f, v[0], 1.f);
+            return QColor::fromRgbF(v[0], v[0], v[0]);
+        }
+        return QColor();
+    }
+};
+
+
+class AcoFormat : public PaletteFormat
+{
+public:
+    QString id() const override { return QStringLiteral("aco"); }
+    QString description() const override { return tr("Adobe Color Swatches"); }
+    QStringList extensions() const override { return QStringList() << QStringLiteral("aco"); }
+
+    bool probe(const QByteArray& header) const override
+    {
+        if ( header.size() < 4 || header[0] != 0 || (header[1] != 1 && header[1] != 2) )
+            return false;
+        // Color space of the first entry
+        if ( header.size() >= 6 )
+            return header[4] == 0 && QByteArray("\x00\x01\x02\x07\x08", 5).contains(header[5]);
+        return true;
+    }
+
+    bool read(QIODevice& device, ColorPalette& palette) const override
+    {
+        QDataStream stream(&device);
+        stream.setByteOrder(QDataStream::BigEndian);
+
+        quint16 version, count;
+        stream >> version >> count;
+        if ( stream.status() != QDataStream::Ok || (version != 1 && version != 2) )
+            return false;
+
+        ColorList colors;
+        readSection(stream, version, count, colors);
+
+        // Version 1 files may be followed by a version 2 section with names
+        if ( version == 1 && !stream.atEnd() )
+        {
+            stream >> version >> count;
+            if ( stream.status() == QDataStream::Ok && version == 2 )
+            {
+                ColorList named;
+                readSection(stream, version, count, named);
+                if ( stream.status() == QDataStream::Ok )
+                    colors = named;
+            }
+            stream.resetStatus();
+        }
+
+        if ( stream.status() != QDataStream::Ok )
+            return false;
+
+        palette.setColors(colors);
+        return true;
+    }
+
+    bool write(QIODevice& device, const ColorPalette& palette) const override
+    {
+        QDataStream stream(&device);
+        stream.setByteOrder(QDataStream::BigEndian);
+
+        quint16 count = qMin(palette.count(), 0xffff);
+        for ( quint16 version = 1; version <= 2; version++ )
+        {
+            stream << version << count;
+            for ( int i = 0; i < count; i++ )
+            {
+                QColor color = palette.colorAt(i);
+                stream << quint16(0) << quint16(color.red() * 257)
+                       << quint16(color.green() * 257) << quint16(color.blue() * 257)
+                       << quint16(0);
+                if ( version == 2 )
+                    write_utf16<quint32>(stream, palette.nameAt(i));
+            }
+        }
+        return stream.status() == QDataStream::Ok;
+    }
+
+private:
+    static void readSection(QDataStream& stream, quint16 version, quint16 count, ColorList& colors)
+    {
+        colors.reserve(count);
+        for ( int i = 0; i < count && stream.status() == QDataStream::Ok; i++ )
+        {
+            quint16 space, w, x, y, z;
+            stream >> space >> w >> x >> y >> z;
+            QString name;
+            if ( version == 2 )
+                name = read_utf16<quint32>(stream);
+
+            QColor color = toColor(space, w, x, y, z);
+            if ( color.isValid() )
+                colors.push_back(qMakePair(color, name));
+        }
+    }
+
+    static QColor toColor(quint16 space, quint16 w, quint16 x, quint16 y, quint16 z)
+    {
+        switch ( space )
+        {
+            case 0: // RGB
+                return QColor::fromRgbF(w / 65535.0, x / 65535.0, y / 65535.0);
+            case 1: // HSB
+                return QColor::fromHsvF(w / 65535.0, x / 65535.0, y / 65535.0);
+            case 2: // CMYK, 0 is 100% ink
+                return QColor::fromCmykF(1 - w / 65535.0, 1 - x / 65535.0,
+                                         1 - y / 65535.0, 1 - z / 65535.0);
+            case 7: // Lab
+                return detail::color_from_lab(w / 100.f, qint16(x) / 100.f, qint16(y) / 100.f);
+            case 8: // Grayscale, 10000 is black
+            {
+                qreal gray = 1 - qMin(w, quint16(10000)) / 10000.0;
+                return QColor::fromRgbF(gray, gray, gray);
+            }
+        }
+        return QColor();
+    }
+};
+
+
+class PaintNetFormat : public PaletteFormat
+{
+public:
+    QString id() const override { return QStringLiteral("paint.net"); }
+    QString description() const override { return tr("Paint.NET Palettes"); }
+    QStringList extensions() const override { return QStringList() << QStringLiteral("txt"); }
+
+    bool probe(const QByteArray& header) const override
+    {
+        QByteArray line = first_line(header);
+        return line.startsWith(';') || (line.size() == 8 && is_hex(line));
+    }
+
+    bool read(QIODevice& device, ColorPalette& palette) const override
+    {
+        QTextStream stream(&device);
+        ColorList colors;
+        QString line;
+        while ( stream.readLineInto(&line) )
+        {
+            line = line.trimmed();
+            if ( line.isEmpty() || line[0] == ';' )
+                continue;
+
+            bool ok = false;
+            QRgb argb = line.toUInt(&ok, 16);
+            if ( !ok || (line.size() != 8 && line.size() != 6) )
+                return false;
+            if ( line.size() == 6 )
+                argb |= 0xff000000;
+            colors.push_back(qMakePair(QColor::fromRgba(argb), QString()));
+        }
+
+        // Any text file starting with a comment passes the probe
+        if ( colors.empty() )
+            return false;
+        palette.setColors(colors);
+        return true;
+    }
+
+    bool write(QIODevice& device, const ColorPalette& palette) const override
+    {
+        QTextStream stream(&device);
+        stream << "; paint.net Palette File\r\n";
+        stream << "; " << unnamed(palette.name()) << "\r\n";
+        stream.setIntegerBase(16);
+        stream.setNumberFlags(QTextStream::UppercaseDigits);
+        stream.setPadChar('0');
+        for ( int i = 0; i < palette.count(); i++ )
+            stream << qSetFieldWidth(8) << palette.colorAt(i).rgba() << qSetFieldWidth(0) << "\r\n";
+        stream.flush();
+        return stream.status() == QTextStream::Ok;
+    }
+};
+
+
+class HexFormat : public PaletteFormat
+{
+public:
+    QString id() const override { return QStringLiteral("hex"); }
+    QString description() const override { return tr("Hex Color Lists"); }
+    QStringList extensions() const override { return QStringList() << QStringLiteral("hex"); }
+
+    bool probe(const QByteArray& header) const override
+    {
+        QByteArray line = first_line(header);
+        if ( line.startsWith('#') )
+            line.remove(0, 1);
+        return (line.size() == 6 || line.size() == 8) && is_hex(line);
+    }
+
+    bool read(QIODevice& device, ColorPalette& palette) const override
+    {
+        QTextStream stream(&device);
+        ColorList colors;
+        QString line;
+        while ( stream.readLineInto(&line) )
+        {
+            line = line.trimmed();
+            if ( line.isEmpty() )
+                continue;
+            if ( line[0] != '#' )
+                line.prepend('#');
+            QColor color = colorFromString(line);
+            if ( !color.isValid() )
+                return false;
+            colors.push_back(qMakePair(color, QString()));
+        }
+
+        palette.setColors(colors);
+        return true;
+    }
+
+    bool write(QIODevice& device, const ColorPalette& palette) const override
+    {
+        QTextStream stream(&device);
+        for ( int i = 0; i < palette.count(); i++ )
+            stream << stringFromColor(palette.colorAt(i)).mid(1) << '\n';
+        stream.flush();
+        return stream.status() == QTextStream::Ok;
+    }
+};
+
+
+class CssFormat : public PaletteFormat
+{
+public:
+    QString id() const override { return QStringLiteral("css"); }
+    QString description() const override { return tr("CSS Custom Properties"); }
+    QStringList extensions() const override { return QStringList() << QStringLiteral("css"); }
+
+    bool probe(const QByteArray& header) const override
+    {
+        static const QRegularExpression custom_property(
+            QStringLiteral("^\\s*--[-\\w]+\\s*:"), QRegularExpression::MultilineOption);
+        return header.contains(":root") || custom_property.match(QString::fromUtf8(header)).hasMatch();
+    }
+
+    bool read(QIODevice& device, ColorPalette& palette) const override
+    {
+        QString css = QTextStream(&device).readAll();
+
+        static const QRegularExpression name_regex(QStringLiteral("/\\*\\s*Name:\\s*(.*?)\\s*\\*/"));
+        QRegularExpressionMatch name_match = name_regex.match(css);
+        if ( name_match.hasMatch() && !name_match.captured(1).isEmpty() )
+            palette.setName(name_match.captured(1));
+
+        static const QRegularExpression property(QStringLiteral("--([-\\w]+)\\s*:\\s*([^;}]+)"));
+        ColorList colors;
+        QRegularExpressionMatchIterator it = property.globalMatch(css);
+        while ( it.hasNext() )
+        {
+            QRegularExpressionMatch match = it.next();
+            QColor color = colorFromString(match.captured(2));
+            if ( color.isValid() )
+                colors.push_back(qMakePair(color, match.captured(1)));
+        }
+
+        // Stylesheets without color properties aren't palettes
+        if ( colors.empty() )
+            return false;
+        palette.setColors(colors);
+        return true;
+    }
+
+    bool write(QIODevice& device, const ColorPalette& palette) const override
+    {
+        QTextStream stream(&device);
+        stream << "/* Name: " << unnamed(palette.name()) << " */\n";
+        stream << ":root {\n";
+        QSet<QString> used;
+        for ( int i = 0; i < palette.count(); i++ )
+        {
+            QString name = propertyName(palette.nameAt(i), i);
+            QString unique = name;
+            for ( int n = 2; used.contains(unique); n++ )
+                unique = name + '-' + QString::number(n);
+            used.insert(unique);
+            stream << "    --" << unique << ": " << stringFromColor(palette.colorAt(i)) << ";\n";
+        }
+        stream << "}\n";
+        stream.flush();
+        return stream.status() == QTextStream::Ok;
+    }
+
+private:
+    static QString propertyName(const QString& name, int index)
+    {
+        QString out;
+        for ( QChar c : name.trimmed().toLower() )
+        {
+            if ( c.isLetterOrNumber() || c == '-' || c == '_' )
+                out.push_back(c);
+            else if ( c.isSpace() && !out.endsWith('-') )
+                out.push_back('-');
+        }
+        if ( out.isEmpty() )
+            out = QStringLiteral("color-%1").arg(index + 1);
+        return out;
+    }
+};
+
+
+class Registry
+{
+public:
+    Registry()
+    {
+        add(new GplFormat);
+        add(new JascFormat);
+        add(new RiffFormat);
+        add(new AseFormat);
+        add(new AcoFormat);
+        add(new PaintNetFormat);
+        add(new HexFormat);
+        add(new CssFormat);
+    }
+
+    void add(PaletteFormat* format)
+    {
+        owned.push_back(std::unique_ptr<PaletteFormat>(format));
+        formats.push_back(format);
+    }
+
+    std::vector<std::unique_ptr<PaletteFormat>> owned;
+    QList<const PaletteFormat*> formats;
+};
+
+Registry& registry()
+{
+    static Registry registry;
+    return registry;
+}
+
+} // namespace
+
+PaletteFormat::~PaletteFormat() = default;
+
+bool PaletteFormat::canWrite() const
+{
+    return true;
+}
+
+bool PaletteFormat::readHeader(QIODevice& device, ColorPalette& palette, int& count) const
+{
+    if ( !read(device, palette) )
+        return false;
+    count = palette.count();
+    palette.setColors(ColorList());
+    return true;
+}
+
+QString PaletteFormat::nameFilter() const
+{
+    QStringList patterns;
+    for ( const QString& extension : extensions() )
+        patterns << QStringLiteral("*.") + extension;
+    return QStringLiteral("%1 (%2)").arg(description()).arg(patterns.join(' '));
+}
+
+void PaletteFormat::registerFormat(PaletteFormat* format)
+{
+    if ( format )
+        registry().add(format);
+}
+
+QList<const PaletteFormat*> PaletteFormat::formats()
+{
+    return registry().formats;
+}
+
+const PaletteFormat* PaletteFormat::fromId(const QString& id)
+{
+    for ( const PaletteFormat* format : registry().formats )
+        if ( format->id() == id )
+            return format;
+    return nullptr;
+}
+
+const PaletteFormat* PaletteFormat::fromExtension(const QString& extension)
+{
+    QString lower = extension.toLower();
+    for ( const PaletteFormat* format : registry().formats )
+        if ( format->extensions().contains(lower) )
+            return format;
+    return nullptr;
+}
+
+const PaletteFormat* PaletteFormat::detect(QIODevice& device, const QString& file_name)
+{
+    QByteArray header = device.peek(probe_size);
+    if ( header.isEmpty() )
+        return nullptr;
+
+    // Formats matching the extension first, as some probes are rather weak
+    QString extension = QFileInfo(file_name).suffix().toLower();
+    if ( !extension.isEmpty() )
+        for ( const PaletteFormat* format : registry().formats )
+            if ( format->extensions().contains(extension) && format->probe(header) )
+                return format;
+
+    for ( const PaletteFormat* format : registry().formats )
+        if ( format->probe(header) )
+            return format;
+
+    return nullptr;
+}
+
+QStringList PaletteFormat::fileNamePatterns()
+{
+    QStringList patterns;
+    for ( const PaletteFormat* format : registry().formats )
+        for ( const QString& extension : format->extensions() )
+        {
+            QString pattern = QStringLiteral("*.") + extension;
+            if ( !patterns.contains(pattern) )
+                patterns << pattern;
+        }
+    return patterns;
+}
+
+QStringList PaletteFormat::nameFilters()
+{
+    QStringList filters;
+    filters << tr("All Palettes (%1)").arg(fileNamePatterns().join(' '));
+    for ( const PaletteFormat* format : registry().formats )
+        filters << format->nameFilter();
+    return filters;
+}
+
+} // namespace color_widgets
@@ -0,0 +1,632 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "QtColorWidgets/color_palette_index.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "QtColorWidgets/color_palette.hpp"
+#include "color_space.hpp"
+#include "parallel.hpp"
+
+namespace color_widgets {
+
+namespace {
+
+struct Point
+{
+    float c[3];
+    int   index;
+};
+
+/**
+ * \brief Candidate found while searching the tree
+ */
+struct Candidate
+{
+    float distance2;
+    int   index;    ///< Index in the palette
+    int   position; ///< Position in the tree
+
+    bool operator<(const Candidate& other) const
+    {
+        return distance2 != other.distance2 ? distance2 < other.distance2 : index < other.index;
+    }
+};
+
+/// Number of entries in the per-thread cache used by image queries
+const int image_cache_size = 4096;
+
+} // namespace
+
+class ColorPaletteIndex::Private
+{
+public:
+    Metric metric = OkLab;
+    /// Points ordered as an implicit k-d tree: each range is split at its middle element
+    QVector<Point> points;
+    /// Split axis for the node at the same position in points
+    QVector<quint8> axes;
+
+    void transform(const QColor& color, float* out) const
+    {
+        QColor rgb = color.toRgb();
+        if ( metric == Rgb )
+        {
+            out[0] = rgb.red();
+            out[1] = rgb.green();
+            out[2] = rgb.blue();
+        }
+        else if ( metric == OkLab )
+        {
+            detail::OkLab lab = detail::oklab_from_color(rgb);
+            out[0] = lab.l;
+            out[1] = lab.a;
+            out[2] = lab.b;
+        }
+        else
+        {
+            detail::CieLab lab = detail::cielab_from_color(rgb);
+            out[0] = lab.l;
+            out[1] = lab.a;
+            out[2] = lab.b;
+        }
+    }
+
+    void build(const QVector<QColor>& colors)
+    {
+        points.clear();
+        points.reserve(colors.size());
+        for ( int i = 0; i < colors.size(); i++ )
+        {
+            Point point;
+            transform(colors[i], point.c);
+            point.index = i;
+            points.push_back(point);
+        }
+        axes.fill(0, points.size());
+        build(0, points.size());
+    }
+
+    void build(int begin, int end)
+    {
+        if ( end - begin < 1 )
+            return;
+
+        float low[3] = {
+            std::numeric_limits<float>::max(),
+            std::numeric_limits<float>::max(),
+            std::numeric_limits<float>::max()
+        };
+        float high[3] = {
+            std::numeric_limits<float>::lowest(),
+            std::numeric_limits<float>::lowest(),
+            std::numeric_limits<float>::lowest()
+        };
+        for ( int i = begin; i < end; i++ )
+        {
+            for ( int c = 0; c < 3; c++ )
+            {
+                low[c] = qMin(low[c], points[i].c[c]);
+                high[c] = qMax(high[c], points[i].c[c]);
+            }
+        }
+
+        int axis = 0;
+        for ( int c = 1; c < 3; c++ )
+            if ( high[c] - low[c] > high[axis] - low[axis] )
+                axis = c;
+
+        int mid = (begin + end) / 2;
+        std::nth_element(points.begin() + begin, points.begin() + mid, points.begin() + end,
+            [axis](const Point& a, const Point& b) {
+                return a.c[axis] < b.c[axis];
+        });
+        axes[mid] = axis;
+
+        build(begin, mid);
+        build(mid + 1, end);
+    }
+
+    static float distance2(const float* a, const float* b)
+    {
+        float d0 = a[0] - b[0];
+        float d1 = a[1] - b[1];
+        float d2 = a[2] - b[2];
+        return d0 * d0 + d1 * d1 + d2 * d2;
+    }
+
+    /**
+     * \brief Collects the \p k nearest points into \p best, kept sorted
+     */
+    void search_nearest(const float* query, int k, int begin, int end, QVector<Candidate>& best) const
+    {
+        if ( begin >= end )
+            return;
+
+        int mid = (begin + end) / 2;
+        const Point& point = points[mid];
+        Candidate candidate{distance2(query, point.c), point.index, mid};
+        if ( best.size() < k || candidate < best.back() )
+        {
+            best.insert(std::upper_bound(best.begin(), best.end(), candidate), candidate);
+            if ( best.size() > k )
+                best.pop_back();
+        }
+
+        int axis = axes[mid];
+        float diff = query[axis] - point.c[axis];
+        if ( diff < 0 )
+            search_nearest(query, k, begin, mid, best);
+        else
+            search_nearest(query, k, mid + 1, end, best);
+
+        // Equal distances must be visited as well to break ties by index
+        if ( best.size() < k || diff * diff <= best.back().distance2 )
+        {
+            if ( diff < 0 )
+                search_nearest(query, k, mid + 1, end, best);
+            else
+                search_nearest(query, k, begin, mid, best);
+        }
+    }
+
+    void search_radius(const float* query, float radius2, int begin, int end, QVector<Candidate>& found) const
+    {
+        if ( begin >= end )
+            return;
+
+        int mid = (begin + end) / 2;
+        const Point& point = points[mid];
+        float distance = distance2(query, point.c);
+        if ( distance <= radius2 )
+            found.push_back(Candidate{distance, point.index, mid});
+
+        int axis = axes[mid];
+        float diff = query[axis] - point.c[axis];
+        if ( diff <= 0 || diff * diff <= radius2 )
+            search_radius(query, radius2, begin, mid, found);
+        if ( diff >= 0 || diff * diff <= radius2 )
+            search_radius(query, radius2, mid + 1, end, found);
+    }
+
+    /**
+     * \brief Index of the point nearest to \p color
+     *
+     * For Ciede2000 a few candidates are selected by their euclidean
+     * distance in L*a*b*, the best of them bounds the search for the
+     * actual nearest color.
+     */
+    int nearest(const QColor& color) const
+    {
+        if ( points.empty() )
+            return -1;
+
+        if ( metric == Ciede2000 )
+        {
+            QVector<Match> matches = this->matches(color, 1);
+            return matches.empty() ? -1 : matches[0].index;
+        }
+
+        float query[3];
+        transform(color, query);
+        QVector<Candidate> best;
+        best.reserve(2);
+        search_nearest(query, 1, 0, points.size(), best);
+        return best[0].index;
+    }
+
+    QVector<Match> matches(const QColor& color, int k) const
+    {
+        QVector<Match> result;
+        if ( points.empty() || k <= 0 )
+            return result;
+
+        float query[3];
+        transform(color, query);
+        QVector<Candidate> best;
+        int candidates = metric == Ciede2000 ? qMax(k * 4, k + 8) : k;
+        best.reserve(candidates + 1);
+        search_nearest(query, candidates, 0, points.size(), best);
+
+        if ( metric == Ciede2000 )
+        {
+            rank_ciede2000(color, best);
+            // Fewer candidates than requested means the whole index has been ranked,
+            // otherwise all the colors closer than the k-th candidate are searched
+            if ( best.size() >= k )
+            {
+                float bound2 = best[k - 1].distance2;
+                best.clear();
+                search_ciede2000(color, query, bound2, best);
+            }
+        }
+
+        for ( int i = 0; i < best.size() && i < k; i++ )
+            result.push_back(Match{best[i].index, distance(best[i])});
+        return result;
+    }
+
+    QVector<Match> within(const QColor& color, float radius) const
+    {
+        QVector<Match> result;
+        if ( points.empty() || radius < 0 )
+            return result;
+
+        float query[3];
+        transform(color, query);
+        QVector<Candidate> found;
+
+        if ( metric == Ciede2000 )
+        {
+            search_ciede2000(color, query, radius * radius, found);
+        }
+        else
+        {
+            search_radius(query, radius * radius, 0, points.size(), found);
+            std::sort(found.begin(), found.end());
+        }
+
+        result.reserve(found.size());
+        for ( const Candidate& candidate : found )
+            result.push_back(Match{candidate.index, distance(candidate)});
+        return result;
+    }
+
+    /**
+     * \brief Radius in L*a*b* containing all the colors within \p radius CIEDE2000 of \p query
+     *
+     * CIEDE2000 divides the differences in lightness, chroma and hue by SL,
+     * SC and SH, and scales a* by up to 1.5 before computing them.
+     * So the L*a*b* distance is at most the largest of SL (1.75 at most),
+     * SC and SH (SC = 1 + 0.045 C', always larger than SH) times the
+     * difference without the rotation term. The rotation term can lower the
+     * difference by up to a factor of sqrt(1 - sqrt(3) / 2).
+     * SC depends on the mean chroma of the two colors, which is bounded by
+     * the chroma of the query and the distance itself.
+     *
+     * \returns A negative value if the search can't be bounded
+     */
+    static float ciede2000_search_radius(const float* query, float radius)
+    {
+        const float rotation = 2.7321f; // 1 / sqrt(1 - sqrt(3) / 2)
+        const float sl_max = 1.75f;
+        float chroma = 1.5f * std::hypot(query[1], query[2]);
+
+        // Solves d = rotation * radius * (1 + 0.045 * 1.5 * (chroma + d / 2))
+        float slope = rotation * radius * 0.045f * 1.5f / 2;
+        if ( slope >= 1 )
+            return -1;
+        float widened = rotation * radius * (1 + 0.045f * chroma) / (1 - slope);
+        return qMax(widened, rotation * radius * sl_max);
+    }
+
+    /**
+     * \brief Adds to \p found the points within \p radius2 squared CIEDE2000 of \p color, sorted
+     */
+    void search_ciede2000(const QColor& color, const float* query, float radius2, QVector<Candidate>& found) const
+    {
+        float widened = ciede2000_search_radius(query, std::sqrt(radius2));
+        if ( widened < 0 )
+            widened = std::numeric_limits<float>::infinity();
+        // Rounding in the conversions
+        widened = widened * 1.001f + 0.001f;
+        search_radius(query, widened * widened, 0, points.size(), found);
+        rank_ciede2000(color, found);
+        while ( !found.empty() && found.back().distance2 > radius2 )
+            found.pop_back();
+    }
+
+    /**
+     * \brief Replaces the distances of \p candidates with CIEDE2000 and sorts them
+     */
+    void rank_ciede2000(const QColor& color, QVector<Candidate>& candidates) const
+    {
+        detail::CieLab query = detail::cielab_from_color(color.toRgb());
+        for ( Candidate& candidate : candidates )
+        {
+            const Point& point = points[candidate.position];
+            float difference = detail::ciede2000(query, detail::CieLab(point.c[0], point.c[1], point.c[2]));
+            candidate.distance2 = difference * difference;
+        }
+        std::sort(candidates.begin(), candidates.end());
+    }
+
+    static float distance(const Candidate& candidate)
+    {
+        return std::sqrt(candidate.distance2);
+    }
+};
+
+ColorPaletteIndex::ColorPaletteIndex(Metric metric)
+    : p(new Private)
+{
+    p->metric = metric;
+}
+
+ColorPaletteIndex::ColorPaletteIndex(const ColorPalette& palette, Metric metric)
+    : p(new Private)
+{
+    p->metric = metric;
+    p->build(palette.onlyColors());
+}
+
+ColorPaletteIndex::ColorPaletteIndex(const QVector<QColor>& colors, Metric metric)
+    : p(new Private)
+{
+    p->metric = metric;
+    p->build(colors);
+}
+
+ColorPaletteIndex::ColorPaletteIndex(const ColorPaletteIndex& other)
+    : p(new Private(*other.p))
+{
+}
+
+ColorPaletteIndex& ColorPaletteIndex::operator=(const ColorPaletteIndex& other)
+{
+    *p = *other.p;
+    return *this;
+}
+
+ColorPaletteIndex::~ColorPaletteIndex()
+{
+    delete p;
+}
+
+ColorPaletteIndex::Metric ColorPaletteIndex::metric() const
+{
+    return p->metric;
+}
+
+int ColorPaletteIndex::count() const
+{
+    return p->points.size();
+}
+
+int ColorPaletteIndex::nearest(const QColor& color) const
+{
+    return p->nearest(color);
+}
+
+QVector<ColorPaletteIndex::Match> ColorPaletteIndex::nearest(const QColor& color, int k) const
+{
+    return p->matches(color, k);
+}
+
+QVector<ColorPaletteIndex::Match> ColorPaletteIndex::withinRadius(const QColor& color, float radius) const
+{
+    return p->within(color, radius);
+}
+
+QVector<int> ColorPaletteIndex::nearest(const QImage& image) const
+{
+    if ( p->points.empty() || image.isNull() )
+        return QVector<int>();
+
+    QImage rgb = image.convertToFormat(QImage::Format_RGB32);
+    const int width = rgb.width();
+    const uchar* bits = rgb.constBits();
+    const int stride = rgb.bytesPerLine();
+
+    QVector<int> result(width * rgb.height());
+    int* out = result.data();
+
+    detail::parallel_for(0, rgb.height(), 16, [&](int begin, int end) {
+        // Images tend to repeat colors, 0 is never a key as pixels are opaque
+        QVector<QRgb> keys(image_cache_size, 0);
+        QVector<int> values(image_cache_size);
+        for ( int y = begin; y < end; y++ )
+        {
+            const QRgb* line = reinterpret_cast<const QRgb*>(bits + qint64(y) * stride);
+            for ( int x = 0; x < width; x++ )
+            {
+                QRgb pixel = line[x] | 0xff000000;
+                int slot = (pixel * 2654435761u) >> 20 & (image_cache_size - 1);
+                if ( keys[slot] != pixel )
+                {
+                    keys[slot] = pixel;
+                    values[slot] = p->nearest(QColor(pixel));
+                }
+                out[qint64(y) * width + x] = values[slot];
+            }
+        }
+    });
+
+    return result;
+}
+
+float ColorPaletteIndex::distance(const QColor& a, const QColor& b, Metric metric)
+{
+    if ( metric == Ciede2000 )
+        return detail::ciede2000(detail::cielab_from_color(a.toRgb()), detail::cielab_from_color(b.toRgb()));
+
+    Private index;
+    index.metric = metric;
+    float pa[3];
+    float pb[3];
+    index.transform(a, pa);
+    index.transform(b, pb);
+    return std::sqrt(Private::distance2(pa, pb));
+}
+
+
+class ColorPaletteNameIndex::Private
+{
+public:
+    /**
+     * \brief Start of a word within a name
+     */
+    struct Word
+    {
+        int index;  ///< Index in the palette
+        int offset; ///< Position of the word in the name
+    };
+
+    /// Case-folded names
+    QVector<QString> names;
+    /// Words ordered by the text from their start, then by index
+    QVector<Word> words;
+
+    QStringRef text(const Word& word) const
+    {
+        return names[word.index].midRef(word.offset);
+    }
+
+    void build(const QVector<QString>& raw_names)
+    {
+        names.clear();
+        words.clear();
+        names.reserve(raw_names.size());
+        for ( int i = 0; i < raw_names.size(); i++ )
+        {
+            QString name = raw_names[i].toCaseFolded();
+            for ( int j = 0; j < name.size(); j++ )
+            {
+                if ( name[j].isLetterOrNumber() && (j == 0 || !name[j-1].isLetterOrNumber()) )
+                    words.push_back(Word{i, j});
+            }
+            names.push_back(name);
+        }
+
+        std::sort(words.begin(), words.end(), [this](const Word& a, const Word& b) {
+            int cmp = text(a).compare(text(b));
+            return cmp != 0 ? cmp < 0 : a.index < b.index;
+        });
+    }
+
+    /**
+     * \brief Range of the words starting with \p prefix
+     */
+    std::pair<const Word*, const Word*> range(const QString& prefix) const
+    {
+        const Word* begin = words.constData();
+        const Word* end = begin + words.size();
+        int size = prefix.size();
+        const Word* first = std::lower_bound(begin, end, prefix, [this](const Word& word, const QString& prefix) {
+            return text(word).compare(prefix) < 0;
+        });
+        const Word* last = std::upper_bound(first, end, prefix, [this, size](const QString& prefix, const Word& word) {
+            return prefix.compare(text(word).left(size)) < 0;
+        });
+        return std::make_pair(first, last);
+    }
+
+    /**
+     * \brief Whether all the characters of \p query appear in \p name in the same order
+     */
+    static bool subsequence(const QString& query, const QString& name)
+    {
+        int j = 0;
+        for ( int i = 0; i < name.size() && j < query.size(); i++ )
+        {
+            if ( name[i] == query[j] )
+                j++;
+        }
+        return j == query.size();
+    }
+};
+
+ColorPaletteNameIndex::ColorPaletteNameIndex()
+    : p(new Private)
+{
+}
+
+ColorPaletteNameIndex::ColorPaletteNameIndex(const ColorPalette& palette)
+    : p(new Private)
+{
+    QVector<QString> names;
+    names.reserve(palette.count());
+    for ( int i = 0; i < palette.count(); i++ )
+        names.push_back(palette.nameAt(i));
+    p->build(names);
+}
+
+ColorPaletteNameIndex::ColorPaletteNameIndex(const QVector<QString>& names)
+    : p(new Private)
+{
+    p->build(names);
+}
+
+ColorPaletteNameIndex::ColorPaletteNameIndex(const ColorPaletteNameIndex& other)
+    : p(new Private(*other.p))
+{
+}
+
+ColorPaletteNameIndex& ColorPaletteNameIndex::operator=(const ColorPaletteNameIndex& other)
+{
+    *p = *other.p;
+    return *this;
+}
+
+ColorPaletteNameIndex::~ColorPaletteNameIndex()
+{
+    delete p;
+}
+
+int ColorPaletteNameIndex::count() const
+{
+    return p->names.size();
+}
+
+QVector<int> ColorPaletteNameIndex::matches(const QString& prefix) const
+{
+    QVector<int> result;
+    auto range = p->range(prefix.toCaseFolded());
+    for ( const Private::Word* word = range.first; word != range.second; ++word )
+        result.push_back(word->index);
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+int ColorPaletteNameIndex::next(const QString& query, int from) const
+{
+    QString folded = query.toCaseFolded();
+    if ( folded.isEmpty() || p->names.empty() )
+        return -1;
+
+    // Smallest match after from, or the smallest overall to wrap around
+    auto range = p->range(folded);
+    int after = -1;
+    int first = -1;
+    for ( const Private::Word* word = range.first; word != range.second; ++word )
+    {
+        if ( word->index > from && (after == -1 || word->index < after) )
+            after = word->index;
+        if ( first == -1 || word->index < first )
+            first = word->index;
+    }
+    if ( first != -1 )
+        return after != -1 ? after : first;
+
+    int count = p->names.size();
+    int start = qBound(-1, from, count - 1) + 1;
+    for ( int i = 0; i < count; i++ )
+    {
+        int index = (start + i) % count;
+        if ( Private::subsequence(folded, p->names[index]) )
+            return index;
+    }
+    return -1;
+}
+
+} // namespace color_widgets
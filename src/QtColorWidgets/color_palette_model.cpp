@@ -20,24 +20,347 @@
  *
  */
 #include "QtColorWidgets/color_palette_model.hpp"
+#include "QtColorWidgets/color_palette_format.hpp"
+#include "color_palette_cache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <QDateTime>
 #include <QDir>
+#include <QFileSystemWatcher>
+#include <QGuiApplication>
+#include <QHash>
 #include <QList>
-#include <QRegularExpression>
+#include <QMutex>
+#include <QRunnable>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
 
 namespace color_widgets {
 
+namespace {
+
+/**
+ * \brief Palette files found in the search paths, in loading order
+ */
+QFileInfoList find_files(const QStringList& search_paths)
+{
+    QFileInfoList files;
+    QStringList filters = PaletteFormat::fileNamePatterns();
+    for ( const QString& directory_name : search_paths )
+    {
+        QDir directory(directory_name);
+        directory.setNameFilters(filters);
+        directory.setFilter(QDir::Files|QDir::Readable);
+        directory.setSorting(QDir::Name);
+        files += directory.entryInfoList();
+    }
+    return files;
+}
+
+/**
+ * \brief Loads a palette file, using \p cache if possible
+ * \param[out] hash    Content hash of the file
+ * \param[out] changed Whether the palette was not found in the cache
+ * \note Thread-safe
+ */
+bool load_file(const QFileInfo& file, ColorPalette& palette,
+               const detail::PaletteCache* cache, quint64& hash, bool& changed)
+{
+    changed = true;
+    if ( !cache )
+        return palette.load(file.absoluteFilePath());
+
+    if ( cache->load(file, palette, hash) )
+    {
+        changed = false;
+        return true;
+    }
+
+    QFile input(file.absoluteFilePath());
+    if ( !input.open(QFile::ReadOnly) )
+        return false;
+    QByteArray data = input.readAll();
+    hash = detail::fnv1a(data);
+
+    // Only the file stats have changed
+    if ( cache->load(file, hash, palette) )
+        return true;
+
+    return detail::load_palette(data, file.absoluteFilePath(), palette);
+}
+
+/**
+ * \brief Reads the palette metadata and the number of colors
+ * \note Thread-safe
+ */
+bool scan_file(const QFileInfo& file, ColorPalette& palette, int& count)
+{
+    QFile input(file.absoluteFilePath());
+    if ( !input.open(QFile::ReadOnly) )
+        return false;
+
+    const PaletteFormat* format = PaletteFormat::detect(input, input.fileName());
+    if ( !format )
+        return false;
+
+    palette.setName(file.baseName());
+    if ( !format->readHeader(input, palette, count) )
+        return false;
+
+    palette.setFileName(file.absoluteFilePath());
+    palette.setDirty(false);
+    return true;
+}
+
+/**
+ * \brief Palette stored in the model
+ */
+struct PaletteEntry
+{
+    PaletteEntry(const ColorPalette& palette = ColorPalette(), int color_count = -1)
+        : palette(palette),
+          color_count(color_count < 0 ? palette.count() : color_count),
+          materialized(color_count < 0)
+    {}
+
+    ColorPalette palette;
+    int     color_count;            ///< Number of colors, even when not materialized
+    bool    materialized;           ///< Whether the colors of a lazy palette have been loaded
+    bool    evictable = false;      ///< Whether the colors can be dropped to save memory
+    std::list<PaletteEntry*>::iterator lru_position; ///< Position in the recently used list, if evictable
+    qint64  file_size = -1;         ///< Size of the file when it was last read or written
+    qint64  file_mtime = -1;        ///< Modification time of the file when it was last read or written
+    QString canonical_path;         ///< Canonical path of the file, resolved once when it is read or written
+    QString indexed_path;           ///< Absolute path of the file as stored in the lookup index
+    quint64 content_hash = 0;       ///< Content hash of the colors, kept when they are evicted
+    bool    hashed = false;         ///< Whether content_hash is known, lazy palettes need to be loaded once
+    bool    unsaved = false;        ///< Updated without being saved, so changes to the file don't replace it
+    QPixmap thumbnail;              ///< Cached preview for DecorationRole
+    quint64 thumbnail_revision = 0; ///< Palette revision the thumbnail has been rendered from
+
+    void setStat(const QFileInfo& file)
+    {
+        file_size = file.size();
+        file_mtime = file.lastModified().toMSecsSinceEpoch();
+        canonical_path = file.canonicalFilePath();
+    }
+
+    bool statChanged(const QFileInfo& file) const
+    {
+        return file_size != file.size() || file_mtime != file.lastModified().toMSecsSinceEpoch();
+    }
+};
+
+/**
+ * \brief Palette contents parsed by a background thread
+ *
+ * Plain data so no QObject crosses threads
+ */
+struct LoadedPalette
+{
+    bool    ok = false;
+    QString name;
+    QString file_name;
+    int     columns = 0;
+    QVector<QPair<QColor,QString> > colors;
+    int     count = -1;             ///< Number of colors for lazy palettes
+    quint64 hash = 0;
+    bool    changed = true;
+};
+
+/**
+ * \brief State shared between the model and the threads of an asynchronous load
+ */
+struct AsyncLoad
+{
+    QStringList search_paths;
+    std::unique_ptr<detail::PaletteCache> cache;
+    bool lazy = false;
+    std::atomic<bool> canceled{false};
+
+    QMutex mutex;
+    QFileInfoList files;            ///< Written once before \c total is set
+    int total = -1;                 ///< -1 while scanning
+    QVector<LoadedPalette> results;
+    QVector<bool> done;
+    bool started = false;           ///< Whether the parsing tasks have been started
+    int delivered = 0;              ///< Number of results passed to the model
+};
+
+class ScanTask : public QRunnable
+{
+public:
+    explicit ScanTask(std::shared_ptr<AsyncLoad> state) : state(std::move(state)) {}
+
+    void run() override
+    {
+        if ( state->canceled )
+            return;
+
+        QFileInfoList files = find_files(state->search_paths);
+
+        QMutexLocker lock(&state->mutex);
+        state->files = files;
+        state->results.resize(files.size());
+        state->done.fill(false, files.size());
+        state->total = files.size();
+    }
+
+private:
+    std::shared_ptr<AsyncLoad> state;
+};
+
+class ParseTask : public QRunnable
+{
+public:
+    ParseTask(std::shared_ptr<AsyncLoad> state, int index)
+        : state(std::move(state)), index(index) {}
+
+    void run() override
+    {
+        LoadedPalette result;
+        if ( !state->canceled )
+        {
+            ColorPalette palette;
+            if ( state->lazy )
+                result.ok = scan_file(state->files.at(index), palette, result.count);
+            else
+                result.ok = load_file(state->files.at(index), palette,
+                                      state->cache.get(), result.hash, result.changed);
+            result.name = palette.name();
+            result.file_name = palette.fileName();
+            result.columns = palette.columns();
+            result.colors = palette.colors();
+        }
+
+        QMutexLocker lock(&state->mutex);
+        state->results[index] = result;
+        state->done[index] = true;
+    }
+
+private:
+    std::shared_ptr<AsyncLoad> state;
+    int index;
+};
+
+} // namespace
+
 class ColorPaletteModel::Private
 {
 public:
     /// \todo Keep sorted by name (?)
-    QList<ColorPalette> palettes;
+    QList<PaletteEntry> palettes;
     QSize icon_size;
     QStringList search_paths;
     QString     save_path;
+    /// File names in save_path, listed once and kept up to date by save()
+    QSet<QString> save_dir_files;
+    bool        save_dir_listed = false;
+    /// Last number used to make a file name unique, by palette name
+    QHash<QString, int> save_name_suffix;
+    QString     cache_file;
+    QString     thumbnail_path;
+    bool        lazy_loading = false;
+    int         max_loaded_palettes = 0;
+    /**
+     * \brief Evictable palettes, the most recently used first
+     *
+     * QList keeps large items on the heap, so the pointers stay valid
+     * as rows are inserted and removed.
+     */
+    std::list<PaletteEntry*> recently_used;
+
+    QThreadPool load_pool;
+    QTimer      load_timer;
+    std::shared_ptr<AsyncLoad> async_load;
+
+    bool        watch_files = false;
+    QFileSystemWatcher watcher;
+    QTimer      watch_timer;            ///< Debounces watcher notifications
+    QSet<QString> changed_directories;
+    QSet<QString> changed_files;
+
+    /// Sorted rows of the palettes with a given name
+    QHash<QString, QVector<int>> name_index;
+    /// Sorted rows of the palettes for a given file, by canonical and absolute path
+    QHash<QString, QVector<int>> path_index;
+    /// Sorted rows of the palettes with a given content hash
+    QHash<quint64, QVector<int>> content_index;
 
     Private()
         : icon_size(32, 32)
-    {}
+    {
+        load_timer.setInterval(50);
+        watch_timer.setInterval(300);
+        watch_timer.setSingleShot(true);
+    }
+
+    ~Private()
+    {
+        cancelLoad();
+    }
+
+    void cancelLoad()
+    {
+        if ( async_load )
+        {
+            async_load->canceled = true;
+            load_pool.clear();
+            async_load.reset();
+        }
+        load_timer.stop();
+    }
+
+    /**
+     * \brief Takes the results which are ready to be inserted, in order
+     */
+    QList<PaletteEntry> takeLoaded(int& delivered, int& total)
+    {
+        QVector<LoadedPalette> batch;
+        std::shared_ptr<AsyncLoad> state = async_load;
+        {
+            QMutexLocker lock(&state->mutex);
+            total = state->total;
+            if ( total != -1 && !state->started )
+            {
+                state->started = true;
+                for ( int i = 0; i < total; i++ )
+                    load_pool.start(new ParseTask(state, i));
+            }
+
+            while ( state->delivered < total && state->done[state->delivered] )
+            {
+                batch.push_back(state->results[state->delivered]);
+                state->results[state->delivered] = LoadedPalette();
+                state->delivered++;
+            }
+            delivered = state->delivered;
+        }
+
+        QList<PaletteEntry> palettes;
+        int index = delivered - batch.size();
+        for ( const LoadedPalette& result : batch )
+        {
+            if ( result.ok )
+            {
+                ColorPalette palette;
+                palette.setName(result.name);
+                palette.setColumns(result.columns);
+                palette.setColors(result.colors);
+                palette.setFileName(result.file_name);
+                palette.setDirty(false);
+                if ( state->cache && !state->lazy )
+                    state->cache->store(state->files.at(index), result.hash, palette, result.changed);
+                palettes.push_back(PaletteEntry(palette, result.count));
+                palettes.back().setStat(state->files.at(index));
+            }
+            index++;
+        }
+        return palettes;
+    }
 
     bool acceptable(const QModelIndex& index) const
     {
@@ -46,15 +369,387 @@ public:
 
     bool acceptable(int row) const
     {
-        return row >= 0 && row <= palettes.count();
+        return row >= 0 && row < palettes.count();
+    }
+
+    /**
+     * \brief Adds \p row to the rows for \p key, keeping them sorted
+     */
+    template<class Key>
+    static void indexKey(QHash<Key, QVector<int>>& index, const Key& key, int row)
+    {
+        QVector<int>& rows = index[key];
+        // Rows are mostly appended
+        if ( rows.empty() || rows.back() < row )
+            rows.push_back(row);
+        else
+            rows.insert(std::lower_bound(rows.begin(), rows.end(), row), row);
+    }
+
+    template<class Key>
+    static void unindexKey(QHash<Key, QVector<int>>& index, const Key& key, int row)
+    {
+        auto it = index.find(key);
+        if ( it == index.end() )
+            return;
+        auto found = std::lower_bound(it->begin(), it->end(), row);
+        if ( found != it->end() && *found == row )
+            it->erase(found);
+        if ( it->empty() )
+            index.erase(it);
+    }
+
+    /**
+     * \brief Adds the palette at \p row to the lookup indexes
+     */
+    void indexRow(int row)
+    {
+        PaletteEntry& entry = palettes[row];
+        indexKey(name_index, entry.palette.name(), row);
+
+        const QString& file_name = entry.palette.fileName();
+        entry.indexed_path = file_name.isEmpty() ? QString() : QFileInfo(file_name).absoluteFilePath();
+        if ( !entry.indexed_path.isEmpty() )
+            indexKey(path_index, entry.indexed_path, row);
+        if ( !entry.canonical_path.isEmpty() && entry.canonical_path != entry.indexed_path )
+            indexKey(path_index, entry.canonical_path, row);
+
+        if ( entry.materialized )
+        {
+            entry.content_hash = entry.palette.contentHash();
+            entry.hashed = true;
+        }
+        if ( entry.hashed )
+            indexKey(content_index, entry.content_hash, row);
+    }
+
+    /**
+     * \brief Removes the palette at \p row from the lookup indexes
+     *
+     * Must be called before the name, the file name or the stats of the
+     * entry are changed, as those are the keys to remove.
+     */
+    void unindexRow(int row)
+    {
+        const PaletteEntry& entry = palettes[row];
+        unindexKey(name_index, entry.palette.name(), row);
+        if ( !entry.indexed_path.isEmpty() )
+            unindexKey(path_index, entry.indexed_path, row);
+        if ( !entry.canonical_path.isEmpty() && entry.canonical_path != entry.indexed_path )
+            unindexKey(path_index, entry.canonical_path, row);
+        if ( entry.hashed )
+            unindexKey(content_index, entry.content_hash, row);
+    }
+
+    /**
+     * \brief Indexes the palettes appended to the list
+     */
+    void appendedRows(int first)
+    {
+        for ( int i = first; i < palettes.size(); i++ )
+            indexRow(i);
+    }
+
+    /**
+     * \brief Replaces the palette at \p row, updating only its keys in the indexes
+     */
+    void replaceEntry(int row, const PaletteEntry& entry)
+    {
+        unindexRow(row);
+        unloadEntry(palettes[row]);
+        palettes[row] = entry;
+        indexRow(row);
+    }
+
+    /**
+     * \brief Removes the palettes from \p first to \p last, renumbering the following rows
+     */
+    void removeEntries(int first, int last)
+    {
+        for ( int i = first; i <= last; i++ )
+        {
+            unindexRow(i);
+            unloadEntry(palettes[i]);
+        }
+        palettes.erase(palettes.begin() + first, palettes.begin() + last + 1);
+
+        int count = last - first + 1;
+        renumber(name_index, last, count);
+        renumber(path_index, last, count);
+        renumber(content_index, last, count);
+    }
+
+    /**
+     * \brief Shifts back by \p count the rows after \p last
+     */
+    template<class Key>
+    static void renumber(QHash<Key, QVector<int>>& index, int last, int count)
+    {
+        for ( QVector<int>& rows : index )
+        {
+            // Sorted, so only the tail has to be renumbered
+            for ( auto it = std::upper_bound(rows.begin(), rows.end(), last); it != rows.end(); ++it )
+                *it -= count;
+        }
+    }
+
+    void clearIndex()
+    {
+        name_index.clear();
+        path_index.clear();
+        content_index.clear();
+        recently_used.clear();
+    }
+
+    /**
+     * \brief First row for \p key or -1
+     */
+    static int lookup(const QHash<QString, QVector<int>>& index, const QString& key)
+    {
+        auto it = index.find(key);
+        return it == index.end() ? -1 : it->front();
+    }
+
+    /**
+     * \brief Row of the first palette with the given name or -1
+     */
+    int find(const QString& name)
+    {
+        return lookup(name_index, name);
+    }
+
+    /**
+     * \brief Loads a palette file into an entry, honouring lazy_loading
+     */
+    bool loadEntry(const QFileInfo& file, PaletteEntry& entry, detail::PaletteCache* cache = nullptr)
+    {
+        ColorPalette palette;
+        if ( lazy_loading )
+        {
+            int count = 0;
+            if ( !scan_file(file, palette, count) )
+                return false;
+            entry = PaletteEntry(palette, count);
+        }
+        else
+        {
+            quint64 hash = 0;
+            bool changed = true;
+            if ( !load_file(file, palette, cache, hash, changed) )
+                return false;
+            entry = PaletteEntry(palette);
+            if ( cache )
+                cache->store(file, hash, palette, changed);
+        }
+
+        entry.setStat(file);
+        return true;
+    }
+
+    /**
+     * \brief Keeps the watched paths in sync with the search paths and the palette files
+     */
+    void updateWatcher()
+    {
+        QStringList directories;
+        QStringList files;
+        if ( watch_files )
+        {
+            for ( const QString& path : search_paths )
+                if ( QFileInfo(path).isDir() )
+                    directories.push_back(path);
+            for ( const PaletteEntry& entry : palettes )
+                if ( !entry.palette.fileName().isEmpty() && entry.file_size != -1 )
+                    files.push_back(entry.palette.fileName());
+        }
+
+        sync_watched(watcher.directories(), directories);
+        sync_watched(watcher.files(), files);
+    }
+
+    void sync_watched(const QStringList& watched, const QStringList& wanted)
+    {
+        QSet<QString> wanted_set = to_set(wanted);
+        QSet<QString> watched_set = to_set(watched);
+
+        QStringList removed;
+        for ( const QString& path : watched_set )
+            if ( !wanted_set.contains(path) )
+                removed.push_back(path);
+        if ( !removed.empty() )
+            watcher.removePaths(removed);
+
+        QStringList added;
+        for ( const QString& path : wanted_set )
+            if ( !watched_set.contains(path) )
+                added.push_back(path);
+        if ( !added.empty() )
+            watcher.addPaths(added);
+    }
+
+    /**
+     * \brief Updates the watched files for the palette at \p row only
+     * \param old_file File watched for the palette before it changed, empty if none
+     */
+    void updateWatchedFile(int row, const QString& old_file)
+    {
+        if ( !watch_files )
+            return;
+
+        const PaletteEntry& entry = palettes[row];
+        QString new_file = entry.file_size != -1 ? entry.palette.fileName() : QString();
+        if ( new_file == old_file )
+            return;
+
+        // Other palettes might have been loaded from the same file
+        if ( !old_file.isEmpty() && lookup(path_index, QFileInfo(old_file).absoluteFilePath()) == -1 )
+            watcher.removePath(old_file);
+        if ( !new_file.isEmpty() )
+            watcher.addPath(new_file);
+    }
+
+    static QSet<QString> to_set(const QStringList& list)
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        return QSet<QString>(list.begin(), list.end());
+#else
+        return list.toSet();
+#endif
+    }
+
+    /**
+     * \brief Records the stats of a file written by the model so it isn't reloaded
+     */
+    void updateStat(int index)
+    {
+        QFileInfo file(palettes[index].palette.fileName());
+        if ( file.exists() )
+        {
+            unindexRow(index);
+            palettes[index].setStat(file);
+            indexRow(index);
+        }
+    }
+
+    /**
+     * \brief Returns the palette at the given index, loading its colors if needed
+     */
+    const ColorPalette& materialize(int index)
+    {
+        PaletteEntry& entry = palettes[index];
+        touchEntry(entry);
+        if ( !entry.materialized )
+        {
+            // The thumbnail has been rendered from the same file
+            bool thumbnail_fresh = entry.thumbnail_revision == entry.palette.revision();
+            // The loaded name and colors change the keys of the entry
+            unindexRow(index);
+            ColorPalette loaded;
+            if ( loaded.load(entry.palette.fileName()) )
+                entry.palette = loaded;
+            if ( thumbnail_fresh )
+                entry.thumbnail_revision = entry.palette.revision();
+            entry.materialized = true;
+            entry.evictable = true;
+            entry.lru_position = recently_used.insert(recently_used.begin(), &entry);
+            entry.color_count = entry.palette.count();
+            indexRow(index);
+            evict();
+        }
+        return entry.palette;
+    }
+
+    /**
+     * \brief Moves an evictable palette to the front of the recently used list
+     */
+    void touchEntry(PaletteEntry& entry)
+    {
+        if ( entry.evictable )
+            recently_used.splice(recently_used.begin(), recently_used, entry.lru_position);
+    }
+
+    /**
+     * \brief Removes a palette from the recently used list before it is replaced or removed
+     */
+    void unloadEntry(PaletteEntry& entry)
+    {
+        if ( entry.evictable )
+        {
+            recently_used.erase(entry.lru_position);
+            entry.evictable = false;
+        }
+    }
+
+    /**
+     * \brief Drops the colors of the least recently used lazy palettes
+     */
+    void evict()
+    {
+        if ( max_loaded_palettes <= 0 )
+            return;
+
+        while ( int(recently_used.size()) > max_loaded_palettes )
+        {
+            PaletteEntry& entry = *recently_used.back();
+            recently_used.pop_back();
+            bool thumbnail_fresh = entry.thumbnail_revision == entry.palette.revision();
+            entry.palette.setColors(QVector<QPair<QColor,QString> >());
+            entry.palette.setDirty(false);
+            if ( thumbnail_fresh )
+                entry.thumbnail_revision = entry.palette.revision();
+            entry.materialized = false;
+            entry.evictable = false;
+        }
     }
 
-    QList<ColorPalette>::iterator find(const QString& name)
+    /**
+     * \brief File in thumbnail_path storing the preview of an unmodified palette file
+     */
+    QString thumbnailFile(const PaletteEntry& entry, const QSize& size) const
     {
-        return std::find_if(palettes.begin(), palettes.end(),
-            [&name](const ColorPalette& palette) {
-                return palette.name() == name;
-        });
+        if ( thumbnail_path.isEmpty() || entry.file_size == -1 || entry.palette.dirty() )
+            return QString();
+
+        QByteArray key = QStringLiteral("%1\n%2\n%3\n%4x%5")
+            .arg(entry.canonical_path).arg(entry.file_size).arg(entry.file_mtime)
+            .arg(size.width()).arg(size.height()).toUtf8();
+        return QDir(thumbnail_path).filePath(
+            QString::number(detail::fnv1a(key), 16).rightJustified(16, '0') + QStringLiteral(".png")
+        );
+    }
+
+    /**
+     * \brief Preview of the palette at the given index for DecorationRole
+     *
+     * Thumbnails are rendered at the device pixel ratio of the application and
+     * are kept until the palette revision or the icon size change.
+     */
+    QPixmap thumbnail(int index)
+    {
+        qreal dpr = qGuiApp ? qGuiApp->devicePixelRatio() : 1;
+        QSize size = icon_size * dpr;
+
+        PaletteEntry& entry = palettes[index];
+        if ( !entry.thumbnail.isNull() && entry.thumbnail.size() == size &&
+             entry.thumbnail_revision == entry.palette.revision() )
+        {
+            touchEntry(entry);
+            return entry.thumbnail;
+        }
+
+        QString stored = thumbnailFile(entry, size);
+        QPixmap pixmap;
+        if ( stored.isEmpty() || !pixmap.load(stored, "PNG") || pixmap.size() != size )
+        {
+            pixmap = materialize(index).preview(size);
+            if ( !stored.isEmpty() && !pixmap.isNull() )
+                pixmap.save(stored, "PNG");
+        }
+
+        pixmap.setDevicePixelRatio(dpr);
+        entry.thumbnail = pixmap;
+        entry.thumbnail_revision = entry.palette.revision();
+        return pixmap;
     }
 
     bool attemptSave(ColorPalette& palette, const QString& filename)
@@ -83,40 +778,90 @@ public:
         if ( !save_dir.exists() && !QDir().mkdir(save_path) )
             return false;
 
-        // Attempt to save as (Name).gpl
-        QString filename = palette.name()+".gpl";
-        if ( !save_dir.exists(filename) &&
-                attemptSave(palette, save_dir.absoluteFilePath(filename)) )
-            return true;
+        QString filename = uniqueFileName(save_dir, palette.name());
+        if ( !attemptSave(palette, save_dir.absoluteFilePath(filename)) )
+            return false;
 
-        // Get all of the files matching the pattern *.gpl
-        save_dir.setNameFilters(QStringList() << QStringLiteral("*.gpl"));
-        save_dir.setFilter(QDir::Files);
-        QStringList existing_files = save_dir.entryList();
+        save_dir_files.insert(filename);
+        return true;
+    }
 
-        // For all the files that match (Name)(Number).gpl, find the maximum (Number)
-        QRegularExpression name_regex(QRegularExpression::escape(palette.name())+"([0-9]+)\\.gpl");
-        int max = 0;
-        for ( const auto& existing_file : existing_files )
+    /**
+     * \brief Picks a file name not used in \p save_dir, (Name).gpl or (Name)(Number).gpl
+     *
+     * The directory is listed only the first time, later names are found
+     * from the files known to be there.
+     */
+    QString uniqueFileName(const QDir& save_dir, const QString& name)
+    {
+        if ( !save_dir_listed )
         {
-            QRegularExpressionMatch match = name_regex.match(existing_file);
-            if ( match.hasMatch() )
-            {
-                int num = match.captured(1).toInt();
-                if ( num > max )
-                    max = num;
-            }
+            save_dir_files = to_set(save_dir.entryList(QDir::Files));
+            save_dir_listed = true;
         }
 
-        return attemptSave(palette,
-            save_dir.absoluteFilePath(QStringLiteral("%1%2.gpl").arg(palette.name()).arg(max+1))
-        );
+        QString filename = name + QStringLiteral(".gpl");
+        if ( !save_dir_files.contains(filename) && !save_dir.exists(filename) )
+            return filename;
+
+        int& suffix = save_name_suffix[name];
+        do
+            filename = QStringLiteral("%1%2.gpl").arg(name).arg(++suffix);
+        // Files might have been added by someone else since the listing
+        while ( save_dir_files.contains(filename) || save_dir.exists(filename) );
+
+        return filename;
+    }
+
+    void clearSaveDir()
+    {
+        save_dir_files.clear();
+        save_dir_listed = false;
+        save_name_suffix.clear();
     }
 };
 
 ColorPaletteModel::ColorPaletteModel()
     : p ( new Private )
-    {}
+{
+    connect(&p->load_timer, &QTimer::timeout, this, [this]{
+        if ( !p->async_load )
+            return;
+
+        int delivered = 0;
+        int total = -1;
+        QList<PaletteEntry> palettes = p->takeLoaded(delivered, total);
+        if ( !palettes.empty() )
+        {
+            int first = p->palettes.size();
+            beginInsertRows(QModelIndex(), first, first + palettes.size() - 1);
+            p->palettes += palettes;
+            p->appendedRows(first);
+            endInsertRows();
+        }
+        Q_EMIT loadProgress(delivered, total);
+
+        if ( delivered == total )
+        {
+            if ( p->async_load->cache )
+                p->async_load->cache->save();
+            p->async_load.reset();
+            p->load_timer.stop();
+            p->updateWatcher();
+            Q_EMIT loadFinished(false);
+        }
+    });
+
+    connect(&p->watcher, &QFileSystemWatcher::directoryChanged, this, [this](const QString& path){
+        p->changed_directories.insert(path);
+        p->watch_timer.start();
+    });
+    connect(&p->watcher, &QFileSystemWatcher::fileChanged, this, [this](const QString& path){
+        p->changed_files.insert(path);
+        p->watch_timer.start();
+    });
+    connect(&p->watch_timer, &QTimer::timeout, this, &ColorPaletteModel::reloadChangedFiles);
+}
 
 ColorPaletteModel::~ColorPaletteModel()
 {
@@ -133,15 +878,15 @@ QVariant ColorPaletteModel::data(const QModelIndex &index, int role) const
     if ( !p->acceptable(index) )
         return QVariant();
 
-    const ColorPalette& palette = p->palettes[index.row()];
+    const PaletteEntry& entry = p->palettes[index.row()];
     switch( role )
     {
         case Qt::DisplayRole:
-            return palette.name();
+            return entry.palette.name();
         case Qt::DecorationRole:
-            return palette.preview(p->icon_size);
+            return p->thumbnail(index.row());
         case Qt::ToolTipRole:
-            return tr("%1 (%2 colors)").arg(palette.name()).arg(palette.count());
+            return tr("%1 (%2 colors)").arg(entry.palette.name()).arg(entry.color_count);
     }
 
     return QVariant();
@@ -154,19 +899,22 @@ bool ColorPaletteModel::removeRows(int row, int count, const QModelIndex & paren
     if ( !p->acceptable(row) || count <= 0 )
         return false;
 
-    auto begin = p->palettes.begin() + row;
-    auto end = row + count >= p->palettes.size() ? p->palettes.end() : begin + count;
-    for ( auto it = begin; it != end; ++it )
+    int last = qMin(row + count, p->palettes.size()) - 1;
+    for ( int i = row; i <= last; i++ )
     {
-        if ( !it->fileName().isEmpty() )
+        QString file_name = p->palettes[i].palette.fileName();
+        if ( !file_name.isEmpty() )
         {
-            QFileInfo file(it->fileName());
+            QFileInfo file(file_name);
             if ( file.isWritable() && file.isFile() )
-                QFile::remove(it->fileName());
+                QFile::remove(file_name);
         }
     }
 
-    p->palettes.erase(begin, end);
+    beginRemoveRows(QModelIndex(), row, last);
+    p->removeEntries(row, last);
+    endRemoveRows();
+    p->updateWatcher();
 
     return true;
 }
@@ -179,7 +927,12 @@ QSize ColorPaletteModel::iconSize() const
 void ColorPaletteModel::setIconSize(const QSize& iconSize)
 {
     if ( p->icon_size != iconSize )
+    {
         Q_EMIT iconSizeChanged( p->icon_size = iconSize );
+        if ( !p->palettes.empty() )
+            Q_EMIT dataChanged(index(0), index(p->palettes.size() - 1),
+                               QVector<int>() << Qt::DecorationRole);
+    }
 }
 
 QString ColorPaletteModel::savePath() const
@@ -195,13 +948,19 @@ QStringList ColorPaletteModel::searchPaths() const
 void ColorPaletteModel::setSavePath(const QString& savePath)
 {
     if ( p->save_path != savePath )
+    {
+        p->clearSaveDir();
         Q_EMIT savePathChanged( p->save_path = savePath );
+    }
 }
 
 void ColorPaletteModel::setSearchPaths(const QStringList& searchPaths)
 {
     if ( p->search_paths != searchPaths )
+    {
         Q_EMIT searchPathsChanged( p->search_paths = searchPaths );
+        p->updateWatcher();
+    }
 }
 
 void ColorPaletteModel::addSearchPath(const QString& path)
@@ -212,36 +971,263 @@ void ColorPaletteModel::addSearchPath(const QString& path)
     {
         p->search_paths.push_back(path);
         Q_EMIT searchPathsChanged( p->search_paths );
+        p->updateWatcher();
     }
 }
 
-void ColorPaletteModel::load()
+bool ColorPaletteModel::watchFiles() const
 {
-    beginResetModel();
-    p->palettes.clear();
-    QStringList filters;
-    filters << QStringLiteral("*.gpl");
-    for ( const QString& directory_name : p->search_paths )
+    return p->watch_files;
+}
+
+void ColorPaletteModel::setWatchFiles(bool watchFiles)
+{
+    if ( p->watch_files != watchFiles )
+    {
+        Q_EMIT watchFilesChanged( p->watch_files = watchFiles );
+        p->updateWatcher();
+    }
+}
+
+void ColorPaletteModel::reloadChangedFiles()
+{
+    // Wait for the palettes to be loaded before comparing them with the files
+    if ( p->async_load )
+    {
+        p->watch_timer.start();
+        return;
+    }
+
+    QSet<QString> directories;
+    QSet<QString> files;
+    std::swap(directories, p->changed_directories);
+    std::swap(files, p->changed_files);
+
+    if ( !p->watch_files )
+        return;
+
+    QHash<QString, int> rows;
+    for ( int i = 0; i < p->palettes.size(); i++ )
+    {
+        const QString& file_name = p->palettes[i].palette.fileName();
+        if ( !file_name.isEmpty() && p->palettes[i].file_size != -1 )
+            rows.insert(QFileInfo(file_name).absoluteFilePath(), i);
+    }
+
+    // Find new files, changes in existing files are detected by their stats
+    QStringList filters = PaletteFormat::fileNamePatterns();
+    QFileInfoList added;
+    for ( const QString& directory_name : directories )
     {
         QDir directory(directory_name);
         directory.setNameFilters(filters);
         directory.setFilter(QDir::Files|QDir::Readable);
         directory.setSorting(QDir::Name);
+        QString directory_path = directory.absolutePath();
+
+        QSet<QString> found;
         for ( const QFileInfo& file : directory.entryInfoList() )
         {
-            ColorPalette palette;
-            if ( palette.load(file.absoluteFilePath()) )
+            QString path = file.absoluteFilePath();
+            found.insert(path);
+            int row = rows.value(path, -1);
+            if ( row == -1 )
+                added.push_back(file);
+            else if ( p->palettes[row].statChanged(file) )
+                files.insert(path);
+        }
+
+        // Removed files
+        for ( auto it = rows.begin(); it != rows.end(); ++it )
+            if ( !found.contains(it.key()) && QFileInfo(it.key()).absolutePath() == directory_path )
+                files.insert(it.key());
+    }
+
+    QList<int> removed;
+    for ( const QString& file_name : files )
+    {
+        QFileInfo file(file_name);
+        int row = rows.value(file.absoluteFilePath(), -1);
+        if ( row == -1 )
+            continue;
+
+        // Keep edits which haven't been written to the file
+        const PaletteEntry& current = p->palettes[row];
+        if ( current.unsaved || current.palette.dirty() )
+            continue;
+
+        if ( !file.exists() )
+        {
+            removed.push_back(row);
+        }
+        else if ( p->palettes[row].statChanged(file) )
+        {
+            PaletteEntry entry;
+            if ( !p->loadEntry(file, entry) )
             {
-                p->palettes.push_back(palette);
+                removed.push_back(row);
+                continue;
             }
+            p->replaceEntry(row, entry);
+            QModelIndex model_index = index(row);
+            Q_EMIT dataChanged(model_index, model_index);
         }
     }
+
+    std::sort(removed.begin(), removed.end());
+    for ( int i = removed.size() - 1; i >= 0; i-- )
+    {
+        beginRemoveRows(QModelIndex(), removed[i], removed[i]);
+        p->removeEntries(removed[i], removed[i]);
+        endRemoveRows();
+    }
+
+    QList<PaletteEntry> inserted;
+    for ( const QFileInfo& file : added )
+    {
+        PaletteEntry entry;
+        if ( p->loadEntry(file, entry) )
+            inserted.push_back(entry);
+    }
+    if ( !inserted.empty() )
+    {
+        int first = p->palettes.size();
+        beginInsertRows(QModelIndex(), first, first + inserted.size() - 1);
+        p->palettes += inserted;
+        p->appendedRows(first);
+        endInsertRows();
+    }
+
+    p->updateWatcher();
+}
+
+QString ColorPaletteModel::cacheFile() const
+{
+    return p->cache_file;
+}
+
+void ColorPaletteModel::setCacheFile(const QString& cacheFile)
+{
+    if ( p->cache_file != cacheFile )
+        Q_EMIT cacheFileChanged( p->cache_file = cacheFile );
+}
+
+QString ColorPaletteModel::thumbnailCachePath() const
+{
+    return p->thumbnail_path;
+}
+
+void ColorPaletteModel::setThumbnailCachePath(const QString& thumbnailCachePath)
+{
+    if ( p->thumbnail_path != thumbnailCachePath )
+    {
+        if ( !thumbnailCachePath.isEmpty() )
+            QDir().mkpath(thumbnailCachePath);
+        Q_EMIT thumbnailCachePathChanged( p->thumbnail_path = thumbnailCachePath );
+    }
+}
+
+void ColorPaletteModel::load()
+{
+    cancelLoad();
+
+    beginResetModel();
+    p->palettes.clear();
+    p->clearIndex();
+
+    std::unique_ptr<detail::PaletteCache> cache;
+    if ( !p->cache_file.isEmpty() && !p->lazy_loading )
+    {
+        cache.reset(new detail::PaletteCache(p->cache_file));
+        cache->open();
+    }
+
+    for ( const QFileInfo& file : find_files(p->search_paths) )
+    {
+        PaletteEntry entry;
+        if ( p->loadEntry(file, entry, cache.get()) )
+        {
+            p->palettes.push_back(entry);
+            p->indexRow(p->palettes.size() - 1);
+        }
+    }
+
+    if ( cache )
+        cache->save();
+
     endResetModel();
+
+    p->updateWatcher();
+}
+
+void ColorPaletteModel::loadAsync()
+{
+    cancelLoad();
+
+    beginResetModel();
+    p->palettes.clear();
+    p->clearIndex();
+    endResetModel();
+
+    std::shared_ptr<AsyncLoad> state = std::make_shared<AsyncLoad>();
+    state->search_paths = p->search_paths;
+    state->lazy = p->lazy_loading;
+    if ( !p->cache_file.isEmpty() && !state->lazy )
+    {
+        state->cache.reset(new detail::PaletteCache(p->cache_file));
+        state->cache->open();
+    }
+
+    p->async_load = state;
+    p->load_pool.start(new ScanTask(state));
+    p->load_timer.start();
+}
+
+void ColorPaletteModel::cancelLoad()
+{
+    if ( p->async_load )
+    {
+        p->cancelLoad();
+        Q_EMIT loadFinished(true);
+    }
+}
+
+bool ColorPaletteModel::lazyLoading() const
+{
+    return p->lazy_loading;
+}
+
+void ColorPaletteModel::setLazyLoading(bool lazyLoading)
+{
+    if ( p->lazy_loading != lazyLoading )
+        Q_EMIT lazyLoadingChanged( p->lazy_loading = lazyLoading );
+}
+
+int ColorPaletteModel::maxLoadedPalettes() const
+{
+    return p->max_loaded_palettes;
+}
+
+void ColorPaletteModel::setMaxLoadedPalettes(int maxLoadedPalettes)
+{
+    if ( maxLoadedPalettes < 0 )
+        maxLoadedPalettes = 0;
+
+    if ( p->max_loaded_palettes != maxLoadedPalettes )
+    {
+        Q_EMIT maxLoadedPalettesChanged( p->max_loaded_palettes = maxLoadedPalettes );
+        p->evict();
+    }
+}
+
+bool ColorPaletteModel::isLoading() const
+{
+    return bool(p->async_load);
 }
 
 bool ColorPaletteModel::hasPalette(const QString& name) const
 {
-    return p->find(name) != p->palettes.end();
+    return p->find(name) != -1;
 }
 
 int ColorPaletteModel::count() const
@@ -251,12 +1237,18 @@ int ColorPaletteModel::count() const
 
 const ColorPalette& ColorPaletteModel::palette(const QString& name) const
 {
-    return *p->find(name);
+    int index = p->find(name);
+    if ( index == -1 )
+    {
+        static const ColorPalette empty;
+        return empty;
+    }
+    return p->materialize(index);
 }
 
 const ColorPalette& ColorPaletteModel::palette(int index) const
 {
-    return p->palettes[index];
+    return p->materialize(index);
 }
 
 bool ColorPaletteModel::updatePalette(int index, const ColorPalette& palette, bool save)
@@ -265,15 +1257,40 @@ bool ColorPaletteModel::updatePalette(int index, const ColorPalette& palette, bo
         return false;
 
     // Store the old file name
-    QString filename = p->palettes[index].fileName();
+    const PaletteEntry& old_entry = p->palettes[index];
+    QString filename = old_entry.palette.fileName();
+    QString old_watched = old_entry.file_size != -1 ? filename : QString();
+    PaletteEntry entry(palette);
+    // Still the same file, keep it tracked by indexFromFile() and the watcher
+    if ( palette.fileName() == filename )
+    {
+        entry.file_size = old_entry.file_size;
+        entry.file_mtime = old_entry.file_mtime;
+        entry.canonical_path = old_entry.canonical_path;
+    }
+    p->fixUnnamed(entry.palette);
+
     // Update the palette
-    ColorPalette& local_palette = p->palettes[index] = palette;
-    p->fixUnnamed(local_palette);
+    p->unindexRow(index);
+    p->unloadEntry(p->palettes[index]);
+    p->palettes[index] = entry;
+    ColorPalette& local_palette = p->palettes[index].palette;
 
+    bool ok = true;
     if ( save )
-        return p->save(local_palette, filename);
+    {
+        ok = p->save(local_palette, filename);
+        QFileInfo file(local_palette.fileName());
+        if ( file.exists() )
+            p->palettes[index].setStat(file);
+    }
+    p->palettes[index].unsaved = !save || !ok;
+    p->indexRow(index);
 
-    return true;
+    QModelIndex model_index = this->index(index);
+    Q_EMIT dataChanged(model_index, model_index);
+    p->updateWatchedFile(index, old_watched);
+    return ok;
 }
 
 bool ColorPaletteModel::removePalette(int index, bool remove_file)
@@ -281,11 +1298,12 @@ bool ColorPaletteModel::removePalette(int index, bool remove_file)
     if ( !p->acceptable(index) )
         return false;
 
-    QString file_name = p->palettes[index].fileName();
+    QString file_name = p->palettes[index].palette.fileName();
 
     beginRemoveRows(QModelIndex(), index, index);
-    p->palettes.removeAt(index);
+    p->removeEntries(index, index);
     endRemoveRows();
+    p->updateWatcher();
 
     if ( !file_name.isEmpty() && remove_file )
     {
@@ -301,28 +1319,55 @@ bool ColorPaletteModel::removePalette(int index, bool remove_file)
 bool ColorPaletteModel::addPalette(const ColorPalette& palette,  bool save)
 {
     beginInsertRows(QModelIndex(), p->palettes.size(), p->palettes.size());
-    p->palettes.push_back(palette);
-    p->fixUnnamed(p->palettes.back());
+    p->palettes.push_back(PaletteEntry(palette));
+    p->fixUnnamed(p->palettes.back().palette);
+    p->appendedRows(p->palettes.size() - 1);
     endInsertRows();
 
-    if ( save )
-        return p->save(p->palettes.back());
+    if ( !save )
+        return true;
 
-    return true;
+    bool ok = p->save(p->palettes.back().palette);
+    p->updateStat(p->palettes.size() - 1);
+    p->updateWatcher();
+    return ok;
 }
 
 
 int ColorPaletteModel::indexFromFile(const QString& filename) const
 {
-    QString canonical = QFileInfo(filename).canonicalFilePath();
-    int i = 0;
-    for ( const auto& pal : p->palettes )
+    if ( filename.isEmpty() )
+        return -1;
+
+    // Absolute paths don't touch the file system, only resolve links on a miss
+    QFileInfo file(filename);
+    int row = p->lookup(p->path_index, file.absoluteFilePath());
+    if ( row != -1 )
+        return row;
+
+    QString canonical = file.canonicalFilePath();
+    if ( canonical.isEmpty() )
+        return -1;
+    return p->lookup(p->path_index, canonical);
+}
+
+int ColorPaletteModel::indexFromContent(const ColorPalette& palette) const
+{
+    // Copied as loading the candidates updates the indexes
+    QVector<int> rows = p->content_index.value(palette.contentHash());
+
+    // Lazy palettes which have never been loaded know their name and size but not their hash
+    for ( int row : p->name_index.value(palette.name()) )
     {
-        if ( !pal.fileName().isEmpty() &&
-                QFileInfo(pal.fileName()).canonicalFilePath() == canonical )
-            return i;
-        i++;
+        const PaletteEntry& entry = p->palettes[row];
+        if ( !entry.hashed && entry.color_count == palette.count() )
+            rows.push_back(row);
     }
+    std::sort(rows.begin(), rows.end());
+
+    for ( int row : rows )
+        if ( p->materialize(row) == palette )
+            return row;
     return -1;
 }
 
@@ -0,0 +1,306 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "QtColorWidgets/color_palette_proxy.hpp"
+#include <algorithm>
+#include "QtColorWidgets/color_palette.hpp"
+#include "color_space.hpp"
+#include "parallel.hpp"
+
+namespace color_widgets {
+
+namespace {
+
+/// Number of colors above which sort keys are computed by multiple threads
+const int parallel_key_grain = 4096;
+
+} // namespace
+
+class ColorPaletteProxy::Private
+{
+public:
+    const ColorPalette* source = nullptr;
+    SortKey             sort_key = Unsorted;
+    Qt::SortOrder       sort_order = Qt::AscendingOrder;
+    QString             filter;     ///< Case-folded filter
+
+    /// Sort keys for sort_key, valid for keys_revision
+    QVector<float>      keys;
+    /// Case-folded names, used by the Name key
+    QVector<QString>    name_keys;
+    SortKey             keys_sort_key = Unsorted;
+    quint64             keys_revision = 0;
+
+    /// View index to source index, valid for mapping_revision
+    QVector<int>        mapping;
+    /// Source index to view index, built on demand
+    QVector<int>        reverse;
+    bool                mapping_valid = false;
+    quint64             mapping_revision = 0;
+
+    bool identity() const
+    {
+        return sort_key == Unsorted && filter.isEmpty();
+    }
+
+    void invalidate()
+    {
+        mapping_valid = false;
+    }
+
+    /**
+     * \brief Brings the sort keys up to date with the source palette
+     */
+    void updateKeys(const QVector<QPair<QColor,QString>>& colors)
+    {
+        if ( keys_sort_key == sort_key && keys_revision == source->revision() )
+            return;
+
+        keys.clear();
+        name_keys.clear();
+        if ( sort_key == Name )
+        {
+            name_keys.resize(colors.size());
+            detail::parallel_for(0, colors.size(), parallel_key_grain, [&](int begin, int end) {
+                for ( int i = begin; i < end; i++ )
+                    name_keys[i] = colors[i].second.toCaseFolded();
+            });
+        }
+        else if ( sort_key != Unsorted )
+        {
+            keys.resize(colors.size());
+            SortKey key = sort_key;
+            detail::parallel_for(0, colors.size(), parallel_key_grain, [&](int begin, int end) {
+                for ( int i = begin; i < end; i++ )
+                    keys[i] = sortKey(colors[i].first, key);
+            });
+        }
+
+        keys_sort_key = sort_key;
+        keys_revision = source->revision();
+    }
+
+    static float sortKey(const QColor& color, SortKey key)
+    {
+        switch ( key )
+        {
+            case Hue:
+                // Achromatic colors have a hue of -1
+                return color.hsvHueF();
+            case Saturation:
+                return color.hsvSaturationF();
+            case Lightness:
+                return detail::oklab_from_color(color.toRgb()).l;
+            default:
+                return 0;
+        }
+    }
+
+    static bool matches(const QPair<QColor,QString>& color, const QString& filter)
+    {
+        return color.second.toCaseFolded().contains(filter) ||
+               color.first.name().contains(filter);
+    }
+
+    /**
+     * \brief Brings the permutation up to date with the source palette
+     */
+    void update()
+    {
+        if ( identity() || !source )
+            return;
+        if ( mapping_valid && mapping_revision == source->revision() )
+            return;
+
+        const QVector<QPair<QColor,QString>> colors = source->colors();
+        updateKeys(colors);
+
+        mapping.clear();
+        reverse.clear();
+        mapping.reserve(colors.size());
+        for ( int i = 0; i < colors.size(); i++ )
+        {
+            if ( filter.isEmpty() || matches(colors[i], filter) )
+                mapping.push_back(i);
+        }
+
+        // Ties keep the palette order in both directions
+        bool descending = sort_order == Qt::DescendingOrder;
+        if ( sort_key == Name )
+        {
+            std::sort(mapping.begin(), mapping.end(), [this, descending](int a, int b) {
+                int cmp = name_keys[a].compare(name_keys[b]);
+                if ( cmp == 0 )
+                    return a < b;
+                return descending ? cmp > 0 : cmp < 0;
+            });
+        }
+        else if ( sort_key != Unsorted )
+        {
+            std::sort(mapping.begin(), mapping.end(), [this, descending](int a, int b) {
+                if ( keys[a] == keys[b] )
+                    return a < b;
+                return descending ? keys[a] > keys[b] : keys[a] < keys[b];
+            });
+        }
+
+        mapping_valid = true;
+        mapping_revision = source->revision();
+    }
+
+    void updateReverse()
+    {
+        if ( !reverse.empty() || !source )
+            return;
+        reverse.fill(-1, source->count());
+        for ( int i = 0; i < mapping.size(); i++ )
+            reverse[mapping[i]] = i;
+    }
+};
+
+ColorPaletteProxy::ColorPaletteProxy(const ColorPalette* source)
+    : p(new Private)
+{
+    p->source = source;
+}
+
+ColorPaletteProxy::ColorPaletteProxy(const ColorPaletteProxy& other)
+    : p(new Private(*other.p))
+{
+}
+
+ColorPaletteProxy& ColorPaletteProxy::operator=(const ColorPaletteProxy& other)
+{
+    *p = *other.p;
+    return *this;
+}
+
+ColorPaletteProxy::~ColorPaletteProxy()
+{
+    delete p;
+}
+
+const ColorPalette* ColorPaletteProxy::source() const
+{
+    return p->source;
+}
+
+void ColorPaletteProxy::setSource(const ColorPalette* source)
+{
+    if ( source != p->source )
+    {
+        p->source = source;
+        p->keys_revision = 0;
+        p->invalidate();
+    }
+}
+
+ColorPaletteProxy::SortKey ColorPaletteProxy::sortKey() const
+{
+    return p->sort_key;
+}
+
+void ColorPaletteProxy::setSortKey(SortKey key)
+{
+    if ( key != p->sort_key )
+    {
+        p->sort_key = key;
+        p->invalidate();
+    }
+}
+
+Qt::SortOrder ColorPaletteProxy::sortOrder() const
+{
+    return p->sort_order;
+}
+
+void ColorPaletteProxy::setSortOrder(Qt::SortOrder order)
+{
+    if ( order != p->sort_order )
+    {
+        p->sort_order = order;
+        p->invalidate();
+    }
+}
+
+QString ColorPaletteProxy::filter() const
+{
+    return p->filter;
+}
+
+void ColorPaletteProxy::setFilter(const QString& filter)
+{
+    QString folded = filter.toCaseFolded();
+    if ( folded != p->filter )
+    {
+        p->filter = folded;
+        p->invalidate();
+    }
+}
+
+bool ColorPaletteProxy::isIdentity() const
+{
+    return p->identity();
+}
+
+int ColorPaletteProxy::count() const
+{
+    if ( !p->source )
+        return 0;
+    if ( p->identity() )
+        return p->source->count();
+    p->update();
+    return p->mapping.size();
+}
+
+int ColorPaletteProxy::mapToSource(int index) const
+{
+    if ( index < 0 || index >= count() )
+        return -1;
+    if ( p->identity() )
+        return index;
+    return p->mapping[index];
+}
+
+int ColorPaletteProxy::mapFromSource(int source_index) const
+{
+    if ( !p->source || source_index < 0 || source_index >= p->source->count() )
+        return -1;
+    if ( p->identity() )
+        return source_index;
+    p->update();
+    p->updateReverse();
+    return p->reverse[source_index];
+}
+
+QColor ColorPaletteProxy::colorAt(int index) const
+{
+    int source_index = mapToSource(index);
+    return source_index == -1 ? QColor() : p->source->colorAt(source_index);
+}
+
+QString ColorPaletteProxy::nameAt(int index) const
+{
+    int source_index = mapToSource(index);
+    return source_index == -1 ? QString() : p->source->nameAt(source_index);
+}
+
+} // namespace color_widgets
@@ -0,0 +1,380 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "QtColorWidgets/color_palette_remapper.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <QMutex>
+#include <QThread>
+#include "parallel.hpp"
+
+namespace color_widgets {
+
+namespace {
+
+const int cube_bits = 6;
+const int cube_side = 1 << cube_bits;
+const int cube_shift = 8 - cube_bits;
+
+const int bayer_matrix[8][8] = {
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 },
+};
+
+/**
+ * \brief Share of the error diffused to a neighbouring pixel
+ */
+struct DiffusionWeight
+{
+    int   dx;
+    int   dy;
+    float weight;
+};
+
+const DiffusionWeight floyd_steinberg[] = {
+    {  1, 0, 7 / 16.f },
+    { -1, 1, 3 / 16.f },
+    {  0, 1, 5 / 16.f },
+    {  1, 1, 1 / 16.f },
+};
+
+const DiffusionWeight atkinson[] = {
+    {  1, 0, 1 / 8.f },
+    {  2, 0, 1 / 8.f },
+    { -1, 1, 1 / 8.f },
+    {  0, 1, 1 / 8.f },
+    {  1, 1, 1 / 8.f },
+    {  0, 2, 1 / 8.f },
+};
+
+/// Padding of the error rows so kernels don't need bounds checks
+const int error_padding = 2;
+
+/// Pixels processed by a row between updates of its progress
+const int progress_step = 32;
+
+/// Columns a row must trail the one above, so all the error reaching a pixel is there
+const int wavefront_lag = 2;
+
+inline int clamp_channel(float value)
+{
+    int rounded = qRound(value);
+    return rounded < 0 ? 0 : ( rounded > 255 ? 255 : rounded );
+}
+
+} // namespace
+
+class ColorPaletteRemapper::Private
+{
+public:
+    Dither dither = NoDither;
+    ColorPaletteIndex::Metric metric = ColorPaletteIndex::Rgb;
+    QVector<QRgb> colors;
+    /// Palette index for each cell of a 6 bit per channel RGB cube
+    QVector<int> cube;
+
+    void build(const ColorPalette& palette)
+    {
+        colors = palette.colorTable();
+        if ( colors.empty() )
+            return;
+
+        // Built here as it isn't safe to build it from multiple threads
+        const ColorPaletteIndex& index = palette.searchIndex(metric);
+        cube.resize(cube_side * cube_side * cube_side);
+        int* data = cube.data();
+
+        detail::parallel_for(0, cube_side, 1, [&](int begin, int end) {
+            for ( int r = begin; r < end; r++ )
+                for ( int g = 0; g < cube_side; g++ )
+                    for ( int b = 0; b < cube_side; b++ )
+                        data[(r << (2 * cube_bits)) | (g << cube_bits) | b] = index.nearest(QColor(
+                            (r << cube_shift) + (1 << cube_shift) / 2,
+                            (g << cube_shift) + (1 << cube_shift) / 2,
+                            (b << cube_shift) + (1 << cube_shift) / 2
+                        ));
+        });
+    }
+
+    int lookup(int r, int g, int b) const
+    {
+        return cube.constData()[
+            (r >> cube_shift) << (2 * cube_bits) |
+            (g >> cube_shift) << cube_bits |
+            (b >> cube_shift)
+        ];
+    }
+
+    /**
+     * \brief Writes the palette color \p index to the output scanline
+     */
+    void put(uchar* line, int x, int index, bool indexed) const
+    {
+        if ( indexed )
+            line[x] = index;
+        else
+            reinterpret_cast<QRgb*>(line)[x] = colors[index] | 0xff000000;
+    }
+
+    /**
+     * \brief Maps each pixel independently, with optional ordered dithering
+     */
+    void map_rows(const QImage& source, QImage& out, bool indexed) const
+    {
+        const int width = source.width();
+        const uchar* in_bits = source.constBits();
+        const int in_stride = source.bytesPerLine();
+        uchar* out_bits = out.bits();
+        const int out_stride = out.bytesPerLine();
+
+        // Spread the thresholds over the average distance between palette colors
+        float spread = qMax(8.f, 255.f / std::cbrt(float(colors.size())));
+        bool ordered = dither == Bayer;
+
+        detail::parallel_for(0, source.height(), 16, [&](int begin, int end) {
+            for ( int y = begin; y < end; y++ )
+            {
+                const QRgb* in = reinterpret_cast<const QRgb*>(in_bits + qint64(y) * in_stride);
+                uchar* line = out_bits + qint64(y) * out_stride;
+                for ( int x = 0; x < width; x++ )
+                {
+                    int r = qRed(in[x]);
+                    int g = qGreen(in[x]);
+                    int b = qBlue(in[x]);
+                    if ( ordered )
+                    {
+                        float offset = ((bayer_matrix[y & 7][x & 7] + 0.5f) / 64 - 0.5f) * spread;
+                        r = clamp_channel(r + offset);
+                        g = clamp_channel(g + offset);
+                        b = clamp_channel(b + offset);
+                    }
+                    put(line, x, lookup(r, g, b), indexed);
+                }
+            }
+        });
+    }
+
+    /**
+     * \brief Error diffusion processed as a wavefront of rows
+     *
+     * Rows are claimed in order by the workers, each row waits for the row
+     * above to be wavefront_lag pixels ahead before reading the error it
+     * diffused. Errors for the rows below are kept in a ring of buffers,
+     * one per row in flight, and the error along the row in local variables,
+     * so every buffer element is only written by one thread at a time.
+     */
+    void diffuse(const QImage& source, QImage& out, bool indexed) const
+    {
+        const DiffusionWeight* kernel = dither == Atkinson ? atkinson : floyd_steinberg;
+        const int kernel_size = dither == Atkinson ?
+            sizeof(atkinson) / sizeof(*atkinson) :
+            sizeof(floyd_steinberg) / sizeof(*floyd_steinberg);
+        int rows_below = 0;
+        for ( int i = 0; i < kernel_size; i++ )
+            rows_below = qMax(rows_below, kernel[i].dy);
+
+        const int width = source.width();
+        const int height = source.height();
+        const uchar* in_bits = source.constBits();
+        const int in_stride = source.bytesPerLine();
+        uchar* out_bits = out.bits();
+        const int out_stride = out.bytesPerLine();
+
+        const int threads = qMax(1, qMin(QThread::idealThreadCount(), height));
+        const int ring = threads + rows_below + 1;
+        const int row_size = (width + 2 * error_padding) * 3;
+        QVector<float> errors(ring * row_size, 0);
+        float* error_data = errors.data();
+
+        // Row number in the high bits and processed pixels in the low bits
+        std::unique_ptr<std::atomic<quint64>[]> progress(new std::atomic<quint64>[ring]);
+        for ( int i = 0; i < ring; i++ )
+            progress[i].store(0);
+
+        QMutex claim_mutex;
+        int next_row = 0;
+
+        auto row_errors = [&](int row) -> float* {
+            return error_data + (row % ring) * row_size + error_padding * 3;
+        };
+
+        auto worker = [&](int, int) {
+            for ( ;; )
+            {
+                int y;
+                {
+                    QMutexLocker lock(&claim_mutex);
+                    if ( next_row >= height )
+                        return;
+                    y = next_row++;
+                    // The farthest row this one writes to hasn't been claimed yet
+                    if ( y + rows_below < height )
+                        std::fill_n(row_errors(y + rows_below) - error_padding * 3, row_size, 0.f);
+                }
+
+                const QRgb* in = reinterpret_cast<const QRgb*>(in_bits + qint64(y) * in_stride);
+                uchar* line = out_bits + qint64(y) * out_stride;
+                float* current = row_errors(y);
+                float carry[2][3] = {{0, 0, 0}, {0, 0, 0}};
+                int available = y == 0 ? width : 0;
+                std::atomic<quint64>& own_progress = progress[y % ring];
+                std::atomic<quint64>* above = y > 0 ? &progress[(y - 1) % ring] : nullptr;
+
+                for ( int x = 0; x < width; x++ )
+                {
+                    int needed = qMin(width, x + wavefront_lag);
+                    while ( available < needed )
+                    {
+                        quint64 state = above->load(std::memory_order_acquire);
+                        if ( state >> 32 == quint64(y - 1) )
+                            available = state & 0xffffffff;
+                        if ( available < needed )
+                            QThread::yieldCurrentThread();
+                    }
+
+                    float value[3] = {
+                        qRed(in[x]) + current[x * 3] + carry[0][0],
+                        qGreen(in[x]) + current[x * 3 + 1] + carry[0][1],
+                        qBlue(in[x]) + current[x * 3 + 2] + carry[0][2],
+                    };
+                    int index = lookup(clamp_channel(value[0]), clamp_channel(value[1]), clamp_channel(value[2]));
+                    put(line, x, index, indexed);
+
+                    QRgb chosen = colors[index];
+                    float error[3] = {
+                        value[0] - qRed(chosen),
+                        value[1] - qGreen(chosen),
+                        value[2] - qBlue(chosen),
+                    };
+
+                    for ( int c = 0; c < 3; c++ )
+                    {
+                        carry[0][c] = carry[1][c];
+                        carry[1][c] = 0;
+                    }
+
+                    for ( int i = 0; i < kernel_size; i++ )
+                    {
+                        const DiffusionWeight& w = kernel[i];
+                        if ( w.dy == 0 )
+                        {
+                            for ( int c = 0; c < 3; c++ )
+                                carry[w.dx - 1][c] += error[c] * w.weight;
+                        }
+                        else if ( y + w.dy < height )
+                        {
+                            float* below = row_errors(y + w.dy) + (x + w.dx) * 3;
+                            for ( int c = 0; c < 3; c++ )
+                                below[c] += error[c] * w.weight;
+                        }
+                    }
+
+                    if ( (x + 1) % progress_step == 0 )
+                        own_progress.store(quint64(y) << 32 | quint64(x + 1), std::memory_order_release);
+                }
+
+                own_progress.store(quint64(y) << 32 | quint64(width), std::memory_order_release);
+            }
+        };
+
+        // Every worker claims rows until none are left, so it doesn't matter
+        // whether they actually run in parallel
+        detail::parallel_for(0, threads, 1, worker);
+    }
+};
+
+ColorPaletteRemapper::ColorPaletteRemapper(const ColorPalette& palette, Dither dither,
+                                           ColorPaletteIndex::Metric metric)
+    : p(new Private)
+{
+    p->dither = dither;
+    p->metric = metric;
+    p->build(palette);
+}
+
+ColorPaletteRemapper::ColorPaletteRemapper(const ColorPaletteRemapper& other)
+    : p(new Private(*other.p))
+{
+}
+
+ColorPaletteRemapper& ColorPaletteRemapper::operator=(const ColorPaletteRemapper& other)
+{
+    *p = *other.p;
+    return *this;
+}
+
+ColorPaletteRemapper::~ColorPaletteRemapper()
+{
+    delete p;
+}
+
+ColorPaletteRemapper::Dither ColorPaletteRemapper::dither() const
+{
+    return p->dither;
+}
+
+void ColorPaletteRemapper::setDither(Dither dither)
+{
+    p->dither = dither;
+}
+
+ColorPaletteIndex::Metric ColorPaletteRemapper::metric() const
+{
+    return p->metric;
+}
+
+int ColorPaletteRemapper::indexOf(QRgb color) const
+{
+    if ( p->colors.empty() )
+        return -1;
+    return p->lookup(qRed(color), qGreen(color), qBlue(color));
+}
+
+QImage ColorPaletteRemapper::remap(const QImage& image) const
+{
+    if ( image.isNull() || p->colors.empty() )
+        return QImage();
+
+    QImage source = image.convertToFormat(QImage::Format_RGB32);
+    bool indexed = p->colors.size() <= 256;
+    QImage out(source.size(), indexed ? QImage::Format_Indexed8 : QImage::Format_RGB32);
+    if ( out.isNull() )
+        return QImage();
+    if ( indexed )
+        out.setColorTable(p->colors);
+
+    if ( p->dither == FloydSteinberg || p->dither == Atkinson )
+        p->diffuse(source, out, indexed);
+    else
+        p->map_rows(source, out, indexed);
+
+    return out;
+}
+
+} // namespace color_widgets
@@ -22,18 +22,31 @@
 #include "QtColorWidgets/color_palette_widget.hpp"
 #include "ui_color_palette_widget.h"
 #include "QtColorWidgets/color_dialog.hpp"
+#include "QtColorWidgets/color_palette_format.hpp"
+#include "QtColorWidgets/color_quantizer.hpp"
+#include "QtColorWidgets/color_palette_commands.hpp"
 #include <QInputDialog>
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QImageReader>
+#include <QProgressDialog>
+#include <QUndoStack>
 
 namespace color_widgets {
 
 class ColorPaletteWidget::Private : public Ui::ColorPaletteWidget
 {
 public:
+    /// Images with more colors than this are quantized, so photos stay usable
+    static const int max_image_colors = 256;
+    /// Number of colors extracted from images with too many colors
+    static const int quantized_image_colors = 32;
+
     ColorPaletteModel* model = nullptr;
+    QMetaObject::Connection model_changed;
     bool read_only = false;
+    /// Edits of the palette in the swatch, cleared when the palette is replaced
+    QUndoStack undo_stack;
 
     bool hasSelectedPalette()
     {
@@ -47,6 +60,14 @@ public:
 
     void addPalette(ColorPalette& palette)
     {
+        // The same palette might have been loaded from a different file
+        int existing = model->indexFromContent(palette);
+        if ( existing != -1 )
+        {
+            palette_list->setCurrentIndex(existing);
+            return;
+        }
+
         bool save = false;
         // Save palettes in the savePath
         /// \todo This currently breaks opening the right directory
@@ -64,13 +85,39 @@ public:
         palette_list->setCurrentIndex(model->count()-1);
     }
 
+    /**
+     * \brief Loads the colors of an image as a new palette
+     *
+     * Quantizing large images can take a while, so it shows a progress
+     * dialog which cancels the import.
+     * \returns \b false if the image can't be read
+     */
     bool openImage(const QString& file)
     {
         QImage image(file);
         if ( !image.isNull() )
         {
             ColorPalette palette;
-            palette.loadImage(image);
+            palette.loadImage(image, true, max_image_colors + 1);
+            if ( palette.count() > max_image_colors )
+            {
+                QProgressDialog progress(
+                    ColorPaletteWidget::tr("Extracting colors from %1...").arg(QFileInfo(file).fileName()),
+                    ColorPaletteWidget::tr("Cancel"), 0, 100, palette_list->window()
+                );
+                progress.setWindowModality(Qt::WindowModal);
+                progress.setMinimumDuration(500);
+
+                palette = ColorQuantizer(ColorQuantizer::KMeans, quantized_image_colors).quantize(image,
+                    [&progress](int value) {
+                        progress.setValue(value);
+                        return !progress.wasCanceled();
+                    });
+
+                // Canceled by the user, which isn't a failure to report
+                if ( progress.wasCanceled() )
+                    return true;
+            }
             palette.setName(QFileInfo(file).baseName());
             palette.setFileName(file+".gpl");
             addPalette(palette);
@@ -79,8 +126,15 @@ public:
         return false;
     }
 
-    bool openGpl(const QString& file)
+    /**
+     * \brief Opens a palette file, the format is detected from the contents
+     * \param image Whether the file has been explicitly chosen as an image
+     */
+    bool openPalette(const QString& file, bool image)
     {
+        if ( image )
+            return openImage(file);
+
         int existing = model->indexFromFile(file);
         if ( existing != -1 )
         {
@@ -95,14 +149,8 @@ public:
             return true;
         }
 
-        return false;
-    }
-
-    bool openPalette(const QString& file, int type)
-    {
-        if ( type == 1 )
-            return openImage(file);
-        return openGpl(file);
+        // Not a known palette format, try as an image
+        return openImage(file);
     }
 };
 
@@ -111,6 +159,7 @@ ColorPaletteWidget::ColorPaletteWidget(QWidget* parent)
     : QWidget(parent), p(new Private)
 {
     p->setupUi(this);
+    p->swatch->setUndoStack(&p->undo_stack);
 
     // Connext Swatch signals
     connect(p->swatch, &Swatch::colorSizeChanged, this, &ColorPaletteWidget::colorSizeChanged);
@@ -139,7 +188,8 @@ ColorPaletteWidget::ColorPaletteWidget(QWidget* parent)
                 dialog.setColor(p->swatch->selectedColor());
             if ( dialog.exec() )
             {
-                p->swatch->palette().appendColor(dialog.color());
+                ColorPalette& palette = p->swatch->palette();
+                p->undo_stack.push(new InsertColorCommand(&palette, palette.count(), dialog.color()));
                 p->swatch->setSelected(p->swatch->palette().count()-1);
             }
         }
@@ -214,9 +264,9 @@ ColorPaletteWidget::ColorPaletteWidget(QWidget* parent)
                     default_dir = QFileInfo(palette.fileName()).dir().path();
             }
 
-            QStringList file_formats = QStringList()
-                << tr("GIMP Palettes (*.gpl)")
-                << tr("Palette Image (%1)").arg(image_formats)
+            QString image_filter = tr("Palette Image (%1)").arg(image_formats);
+            QStringList file_formats = PaletteFormat::nameFilters()
+                << image_filter
                 << tr("All Files (*)");
             QFileDialog open_dialog(this, tr("Open Palette"), default_dir);
             open_dialog.setFileMode(QFileDialog::ExistingFile);
@@ -226,10 +276,10 @@ ColorPaletteWidget::ColorPaletteWidget(QWidget* parent)
             if ( !open_dialog.exec() )
                 return;
 
-            int type = file_formats.indexOf(open_dialog.selectedNameFilter());
+            bool image = open_dialog.selectedNameFilter() == image_filter;
             QString file_name = open_dialog.selectedFiles()[0];
 
-            if ( !p->openPalette( file_name, type ) )
+            if ( !p->openPalette( file_name, image ) )
             {
                 QMessageBox::warning(this, tr("Open Palette"),
                     tr("Failed to load the palette file\n%1").arg(file_name));
@@ -288,9 +338,32 @@ void ColorPaletteWidget::setModel(ColorPaletteModel* model)
 {
     if ( model == p->model )
         return;
+    disconnect(p->model_changed);
     p->model = model;
     p->swatch->setPalette(ColorPalette());
     p->palette_list->setModel(model);
+
+    // Reflects changes to the palette files unless the user has edited the palette
+    if ( model )
+        p->model_changed = connect(model, &QAbstractItemModel::dataChanged, this,
+            [this](const QModelIndex& top_left, const QModelIndex& bottom_right, const QVector<int>& roles) {
+                // Icon updates don't change the colors
+                if ( !roles.empty() && !roles.contains(Qt::DisplayRole) )
+                    return;
+
+                int row = p->palette_list->currentIndex();
+                if ( row < top_left.row() || row > bottom_right.row() || p->swatch->palette().dirty() )
+                    return;
+
+                // Replacing the palette clears the selection and the undo stack,
+                // the content hashes are compared first so this is cheap
+                const ColorPalette& palette = p->model->palette(row);
+                if ( palette == p->swatch->palette() )
+                    return;
+
+                p->swatch->setPalette(palette);
+                p->swatch->palette().setDirty(false);
+        });
 }
 
 void ColorPaletteWidget::setColorSize(const QSize& colorSize)
@@ -332,11 +405,13 @@ void ColorPaletteWidget::setReadOnly(bool readOnly)
 bool ColorPaletteWidget::setCurrentColor(const QColor& color)
 {
     const auto& palette = p->swatch->palette();
-    for ( int i = 0; i < palette.count(); i++ )
+    // Candidates with the same RGB, in palette order
+    auto matches = palette.searchIndex(ColorPaletteIndex::Rgb).withinRadius(color, 0);
+    for ( const auto& match : matches )
     {
-        if ( palette.colorAt(i) == color )
+        if ( palette.colorAt(match.index) == color )
         {
-            p->swatch->setSelected(i);
+            p->swatch->setSelected(match.index);
             return true;
         }
     }
@@ -393,10 +468,15 @@ void ColorPaletteWidget::on_swatch_doubleClicked(int index)
         dialog.setAlphaEnabled(false);
         dialog.setColor(p->swatch->palette().colorAt(index));
         if ( dialog.exec() )
-            p->swatch->palette().setColorAt(index, dialog.color());
+            p->undo_stack.push(new SetColorCommand(&p->swatch->palette(), index, dialog.color()));
     }
 }
 
+QUndoStack* ColorPaletteWidget::undoStack() const
+{
+    return &p->undo_stack;
+}
+
 int ColorPaletteWidget::currentRow() const
 {
     return p->palette_list->currentIndex();
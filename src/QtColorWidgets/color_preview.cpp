@@ -27,6 +27,7 @@
 #include <QMouseEvent>
 #include <QDrag>
 #include <QMimeData>
+#include "QtColorWidgets/color_palette.hpp"
 
 namespace color_widgets {
 
@@ -164,9 +165,8 @@ void ColorPreview::mouseMoveEvent(QMouseEvent *ev)
 
     if ( ev->buttons() &Qt::LeftButton && !QRect(QPoint(0,0),size()).contains(ev->pos()) )
     {
-        QMimeData *data = new QMimeData;
-
-        data->setColorData(p->col);
+        // Also carries the color with its alpha to palettes
+        QMimeData *data = ColorPalette(QVector<QColor>{p->col}).mimeData();
 
         QDrag* drag = new QDrag(this);
         drag->setMimeData(data);
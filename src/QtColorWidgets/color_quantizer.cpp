@@ -0,0 +1,576 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "QtColorWidgets/color_quantizer.hpp"
+#include <algorithm>
+#include <limits>
+#include <QMap>
+#include <QMutex>
+#include <QVector>
+#include "color_space.hpp"
+#include "parallel.hpp"
+
+namespace color_widgets {
+
+namespace {
+
+const int histogram_bits = 5;
+const int histogram_side = 1 << histogram_bits;
+const int histogram_size = histogram_side * histogram_side * histogram_side;
+
+/// Progress reported once the histogram has been built
+const int histogram_progress = 70;
+
+/**
+ * \brief Sum of the colors of a set of pixels
+ *
+ * Integer sums keep the result independent of the order of accumulation.
+ */
+struct ColorSum
+{
+    quint64 weight = 0;
+    quint64 r = 0;
+    quint64 g = 0;
+    quint64 b = 0;
+
+    void add(const ColorSum& other)
+    {
+        weight += other.weight;
+        r += other.r;
+        g += other.g;
+        b += other.b;
+    }
+
+    double mean(int channel) const
+    {
+        quint64 sum = channel == 0 ? r : ( channel == 1 ? g : b );
+        return double(sum) / weight;
+    }
+
+    QColor color() const
+    {
+        return QColor(
+            qRound(mean(0)),
+            qRound(mean(1)),
+            qRound(mean(2))
+        );
+    }
+};
+
+/**
+ * \brief Non-empty histogram bin
+ */
+struct Sample
+{
+    int      index;     ///< Bin index, 5 bits per channel as RGB
+    ColorSum sum;
+
+    int coordinate(int channel) const
+    {
+        return (index >> (histogram_bits * (2 - channel))) & (histogram_side - 1);
+    }
+};
+
+/**
+ * \brief Weighted color with a deterministic order for the output
+ */
+struct WeightedColor
+{
+    QColor  color;
+    quint64 weight;
+
+    bool operator<(const WeightedColor& other) const
+    {
+        if ( weight != other.weight )
+            return weight > other.weight;
+        return color.rgb() < other.color.rgb();
+    }
+};
+
+bool report(const ColorQuantizer::ProgressCallback& progress, int value)
+{
+    return !progress || progress(value);
+}
+
+/**
+ * \brief Collects the pixels in a 5 bit per channel histogram
+ * \returns \b false if canceled
+ */
+bool build_histogram(const QImage& image, QVector<Sample>& samples,
+                     const ColorQuantizer::ProgressCallback& progress)
+{
+    QImage rgb = image.convertToFormat(QImage::Format_RGB32);
+    const int width = rgb.width();
+    const int height = rgb.height();
+    const uchar* bits = rgb.constBits();
+    const int stride = rgb.bytesPerLine();
+
+    QVector<ColorSum> histogram(histogram_size);
+    QMutex mutex;
+
+    auto add_rows = [&](int begin, int end) {
+        QVector<ColorSum> local(histogram_size);
+        for ( int y = begin; y < end; y++ )
+        {
+            const QRgb* line = reinterpret_cast<const QRgb*>(bits + qint64(y) * stride);
+            for ( int x = 0; x < width; x++ )
+            {
+                int r = qRed(line[x]);
+                int g = qGreen(line[x]);
+                int b = qBlue(line[x]);
+                int shift = 8 - histogram_bits;
+                ColorSum& bin = local[
+                    (r >> shift) << (2 * histogram_bits) |
+                    (g >> shift) << histogram_bits |
+                    (b >> shift)
+                ];
+                bin.weight++;
+                bin.r += r;
+                bin.g += g;
+                bin.b += b;
+            }
+        }
+
+        QMutexLocker lock(&mutex);
+        for ( int i = 0; i < histogram_size; i++ )
+            if ( local[i].weight )
+                histogram[i].add(local[i]);
+    };
+
+    // Rows are processed in blocks to report progress from the calling thread
+    const int blocks = qMin(10, height);
+    for ( int block = 0; block < blocks; block++ )
+    {
+        detail::parallel_for(height * block / blocks, height * (block + 1) / blocks, 16, add_rows);
+        if ( !report(progress, histogram_progress * (block + 1) / blocks) )
+            return false;
+    }
+
+    samples.clear();
+    for ( int i = 0; i < histogram_size; i++ )
+    {
+        if ( histogram[i].weight )
+        {
+            Sample sample;
+            sample.index = i;
+            sample.sum = histogram[i];
+            samples.push_back(sample);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * \brief Group of samples for the median cut
+ */
+struct Box
+{
+    int begin;
+    int end;
+    ColorSum sum;
+    int widest_channel = 0;
+    double widest_range = 0;
+
+    void update(const QVector<Sample>& samples)
+    {
+        sum = ColorSum();
+        double low[3] = {255, 255, 255};
+        double high[3] = {0, 0, 0};
+        for ( int i = begin; i < end; i++ )
+        {
+            sum.add(samples[i].sum);
+            for ( int c = 0; c < 3; c++ )
+            {
+                double value = samples[i].sum.mean(c);
+                low[c] = qMin(low[c], value);
+                high[c] = qMax(high[c], value);
+            }
+        }
+
+        widest_channel = 0;
+        widest_range = 0;
+        for ( int c = 0; c < 3; c++ )
+        {
+            if ( high[c] - low[c] > widest_range )
+            {
+                widest_range = high[c] - low[c];
+                widest_channel = c;
+            }
+        }
+    }
+
+    double priority() const
+    {
+        return end - begin < 2 ? -1 : widest_range * sum.weight;
+    }
+};
+
+/**
+ * \brief Splits the samples in up to \p max_colors groups
+ * \returns The sums of each group
+ */
+QVector<ColorSum> median_cut(QVector<Sample>& samples, int max_colors)
+{
+    QVector<Box> boxes;
+    Box first;
+    first.begin = 0;
+    first.end = samples.size();
+    first.update(samples);
+    boxes.push_back(first);
+
+    while ( boxes.size() < max_colors )
+    {
+        int best = -1;
+        for ( int i = 0; i < boxes.size(); i++ )
+            if ( boxes[i].priority() > 0 && ( best == -1 || boxes[i].priority() > boxes[best].priority() ) )
+                best = i;
+        if ( best == -1 )
+            break;
+
+        Box box = boxes[best];
+        int channel = box.widest_channel;
+        std::sort(samples.begin() + box.begin, samples.begin() + box.end,
+            [channel](const Sample& a, const Sample& b) {
+                int ca = a.coordinate(channel);
+                int cb = b.coordinate(channel);
+                return ca != cb ? ca < cb : a.index < b.index;
+        });
+
+        // Split at the weighted median, leaving at least one sample per side
+        quint64 half = box.sum.weight / 2;
+        quint64 accumulated = 0;
+        int split = box.begin + 1;
+        for ( int i = box.begin; i < box.end - 1; i++ )
+        {
+            accumulated += samples[i].sum.weight;
+            split = i + 1;
+            if ( accumulated >= half )
+                break;
+        }
+
+        Box low = box;
+        low.end = split;
+        low.update(samples);
+        Box high = box;
+        high.begin = split;
+        high.update(samples);
+        boxes[best] = low;
+        boxes.push_back(high);
+    }
+
+    QVector<ColorSum> result;
+    result.reserve(boxes.size());
+    for ( const Box& box : boxes )
+        result.push_back(box.sum);
+    return result;
+}
+
+/**
+ * \brief Octree node, identified by its level and the coordinates of its cube
+ */
+struct OctreeNode
+{
+    int level;
+    int coords[3];
+    ColorSum sum;
+
+    int key() const
+    {
+        return coords[0] << (2 * histogram_bits) | coords[1] << histogram_bits | coords[2];
+    }
+};
+
+/**
+ * \brief Merges the branches with fewest pixels until there are at most \p max_colors leaves
+ */
+QVector<ColorSum> octree(const QVector<Sample>& samples, int max_colors)
+{
+    QVector<OctreeNode> leaves;
+    leaves.reserve(samples.size());
+    for ( const Sample& sample : samples )
+    {
+        OctreeNode node;
+        node.level = histogram_bits;
+        for ( int c = 0; c < 3; c++ )
+            node.coords[c] = sample.coordinate(c);
+        node.sum = sample.sum;
+        leaves.push_back(node);
+    }
+
+    for ( int level = histogram_bits; level > 0 && leaves.size() > max_colors; level-- )
+    {
+        // Parents of the leaves at this level, in a deterministic order
+        QMap<int, OctreeNode> parents;
+        QMap<int, int> children;
+        for ( const OctreeNode& leaf : leaves )
+        {
+            if ( leaf.level != level )
+                continue;
+
+            OctreeNode parent;
+            parent.level = level - 1;
+            for ( int c = 0; c < 3; c++ )
+                parent.coords[c] = leaf.coords[c] >> 1;
+
+            auto it = parents.find(parent.key());
+            if ( it == parents.end() )
+                it = parents.insert(parent.key(), parent);
+            it->sum.add(leaf.sum);
+            children[parent.key()]++;
+        }
+
+        QVector<OctreeNode> candidates = parents.values().toVector();
+        std::stable_sort(candidates.begin(), candidates.end(),
+            [](const OctreeNode& a, const OctreeNode& b) {
+                return a.sum.weight < b.sum.weight;
+        });
+
+        int count = leaves.size();
+        QMap<int, bool> merged;
+        for ( const OctreeNode& parent : candidates )
+        {
+            if ( count <= max_colors )
+                break;
+            count -= children[parent.key()] - 1;
+            merged[parent.key()] = true;
+        }
+
+        QVector<OctreeNode> reduced;
+        reduced.reserve(count);
+        for ( const OctreeNode& leaf : leaves )
+        {
+            if ( leaf.level == level )
+            {
+                int parent_key = (leaf.coords[0] >> 1) << (2 * histogram_bits) |
+                                 (leaf.coords[1] >> 1) << histogram_bits |
+                                 (leaf.coords[2] >> 1);
+                if ( merged.contains(parent_key) )
+                    continue;
+            }
+            reduced.push_back(leaf);
+        }
+        for ( auto it = merged.begin(); it != merged.end(); ++it )
+            reduced.push_back(parents[it.key()]);
+
+        leaves = reduced;
+    }
+
+    QVector<ColorSum> result;
+    result.reserve(leaves.size());
+    for ( const OctreeNode& leaf : leaves )
+        result.push_back(leaf.sum);
+    return result;
+}
+
+/**
+ * \brief Refines a median cut with k-means clustering in OKLab
+ * \returns \b false if canceled
+ */
+bool kmeans(QVector<Sample>& samples, int max_colors, int iterations,
+            QVector<WeightedColor>& result,
+            const ColorQuantizer::ProgressCallback& progress)
+{
+    QVector<ColorSum> initial = median_cut(samples, max_colors);
+    QVector<detail::OkLab> centers;
+    centers.reserve(initial.size());
+    for ( const ColorSum& sum : initial )
+        centers.push_back(detail::oklab_from_color(sum.color()));
+
+    QVector<detail::OkLab> points;
+    points.reserve(samples.size());
+    for ( const Sample& sample : samples )
+        points.push_back(detail::oklab_from_color(sample.sum.color()));
+
+    QVector<int> assignment(samples.size(), -1);
+    QVector<int> next(samples.size(), -1);
+    QVector<quint64> weights(centers.size());
+
+    for ( int iteration = 0; iteration < iterations; iteration++ )
+    {
+        // Raw pointers avoid implicit sharing checks from the worker threads
+        const detail::OkLab* point_data = points.constData();
+        const detail::OkLab* center_data = centers.constData();
+        const int center_count = centers.size();
+        int* next_data = next.data();
+        detail::parallel_for(0, points.size(), 1024, [&](int begin, int end) {
+            for ( int i = begin; i < end; i++ )
+            {
+                int best = 0;
+                float best_distance = std::numeric_limits<float>::max();
+                for ( int c = 0; c < center_count; c++ )
+                {
+                    float distance = point_data[i].distance2(center_data[c]);
+                    if ( distance < best_distance )
+                    {
+                        best_distance = distance;
+                        best = c;
+                    }
+                }
+                next_data[i] = best;
+            }
+        });
+
+        if ( next == assignment )
+            break;
+        assignment = next;
+
+        // Sequential accumulation keeps the result deterministic
+        QVector<double> l(centers.size(), 0), a(centers.size(), 0), b(centers.size(), 0);
+        weights.fill(0);
+        for ( int i = 0; i < points.size(); i++ )
+        {
+            int c = assignment[i];
+            quint64 weight = samples[i].sum.weight;
+            weights[c] += weight;
+            l[c] += double(points[i].l) * weight;
+            a[c] += double(points[i].a) * weight;
+            b[c] += double(points[i].b) * weight;
+        }
+
+        for ( int c = 0; c < centers.size(); c++ )
+            if ( weights[c] )
+                centers[c] = detail::OkLab(l[c] / weights[c], a[c] / weights[c], b[c] / weights[c]);
+
+        int value = histogram_progress + (100 - histogram_progress) * (iteration + 1) / iterations;
+        if ( !report(progress, value) )
+            return false;
+    }
+
+    result.clear();
+    for ( int c = 0; c < centers.size(); c++ )
+    {
+        if ( weights[c] )
+        {
+            WeightedColor color;
+            color.color = detail::color_from_oklab(centers[c]);
+            color.weight = weights[c];
+            result.push_back(color);
+        }
+    }
+
+    return true;
+}
+
+} // namespace
+
+class ColorQuantizer::Private
+{
+public:
+    Method method = MedianCut;
+    int max_colors = 16;
+    int iterations = 16;
+};
+
+ColorQuantizer::ColorQuantizer(Method method, int max_colors)
+    : p(new Private)
+{
+    p->method = method;
+    setMaxColors(max_colors);
+}
+
+ColorQuantizer::ColorQuantizer(const ColorQuantizer& other)
+    : p(new Private(*other.p))
+{
+}
+
+ColorQuantizer& ColorQuantizer::operator=(const ColorQuantizer& other)
+{
+    *p = *other.p;
+    return *this;
+}
+
+ColorQuantizer::~ColorQuantizer()
+{
+    delete p;
+}
+
+ColorQuantizer::Method ColorQuantizer::method() const
+{
+    return p->method;
+}
+
+void ColorQuantizer::setMethod(Method method)
+{
+    p->method = method;
+}
+
+int ColorQuantizer::maxColors() const
+{
+    return p->max_colors;
+}
+
+void ColorQuantizer::setMaxColors(int max_colors)
+{
+    p->max_colors = qMax(1, max_colors);
+}
+
+int ColorQuantizer::iterations() const
+{
+    return p->iterations;
+}
+
+void ColorQuantizer::setIterations(int iterations)
+{
+    p->iterations = qMax(1, iterations);
+}
+
+ColorPalette ColorQuantizer::quantize(const QImage& image, const ProgressCallback& progress) const
+{
+    if ( image.isNull() )
+        return ColorPalette();
+
+    QVector<Sample> samples;
+    if ( !build_histogram(image, samples, progress) || samples.empty() )
+        return ColorPalette();
+
+    QVector<WeightedColor> colors;
+    if ( p->method == KMeans )
+    {
+        if ( !kmeans(samples, p->max_colors, p->iterations, colors, progress) )
+            return ColorPalette();
+    }
+    else
+    {
+        QVector<ColorSum> sums = p->method == Octree ?
+            octree(samples, p->max_colors) : median_cut(samples, p->max_colors);
+        for ( const ColorSum& sum : sums )
+        {
+            WeightedColor color;
+            color.color = sum.color();
+            color.weight = sum.weight;
+            colors.push_back(color);
+        }
+    }
+
+    if ( !report(progress, 100) )
+        return ColorPalette();
+
+    std::sort(colors.begin(), colors.end());
+    QVector<QColor> palette_colors;
+    palette_colors.reserve(colors.size());
+    for ( const WeightedColor& color : colors )
+        palette_colors.push_back(color.color);
+
+    return ColorPalette(palette_colors);
+}
+
+} // namespace color_widgets
@@ -0,0 +1,268 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_COLOR_SPACE_HPP
+#define COLOR_WIDGETS_COLOR_SPACE_HPP
+
+#include <cmath>
+#include <utility>
+#include <QColor>
+
+namespace color_widgets {
+namespace detail {
+
+/**
+ * \brief sRGB component [0,1] to linear light
+ */
+inline float srgb_to_linear(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+/**
+ * \brief Linear light to sRGB component [0,1]
+ */
+inline float linear_to_srgb(float c)
+{
+    c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1 / 2.4f) - 0.055f;
+    return c < 0 ? 0 : ( c > 1 ? 1 : c );
+}
+
+/**
+ * \brief WCAG relative luminance [0,1] of an sRGB color
+ */
+inline float relative_luminance(const QColor& color)
+{
+    return 0.2126f * srgb_to_linear(color.redF()) +
+           0.7152f * srgb_to_linear(color.greenF()) +
+           0.0722f * srgb_to_linear(color.blueF());
+}
+
+/**
+ * \brief WCAG contrast ratio between two colors, from 1 to 21
+ */
+inline float contrast_ratio(const QColor& c1, const QColor& c2)
+{
+    float l1 = relative_luminance(c1);
+    float l2 = relative_luminance(c2);
+    if ( l1 < l2 )
+        std::swap(l1, l2);
+    return (l1 + 0.05f) / (l2 + 0.05f);
+}
+
+/**
+ * \brief CIE L*a*b* (D65) to sRGB
+ * \param l Lightness [0, 100]
+ */
+inline QColor color_from_lab(float l, float a, float b)
+{
+    float fy = (l + 16) / 116;
+    float fx = fy + a / 500;
+    float fz = fy - b / 200;
+
+    auto finv = [](float t) {
+        return t > 6.f / 29 ? t * t * t : 3 * (6.f / 29) * (6.f / 29) * (t - 4.f / 29);
+    };
+
+    float x = 0.95047f * finv(fx);
+    float y = 1.00000f * finv(fy);
+    float z = 1.08883f * finv(fz);
+
+    return QColor::fromRgbF(
+        linear_to_srgb( 3.2404542f * x - 1.5371385f * y - 0.4985314f * z),
+        linear_to_srgb(-0.9692660f * x + 1.8760108f * y + 0.0415560f * z),
+        linear_to_srgb( 0.0556434f * x - 0.2040259f * y + 1.0572252f * z)
+    );
+}
+
+/**
+ * \brief Color in the CIE L*a*b* color space (D65)
+ */
+struct CieLab
+{
+    float l = 0;
+    float a = 0;
+    float b = 0;
+
+    CieLab() = default;
+    CieLab(float l, float a, float b) : l(l), a(a), b(b) {}
+};
+
+/**
+ * \brief sRGB components [0,1] to CIE L*a*b* (D65)
+ */
+inline CieLab cielab_from_rgb(float r, float g, float b)
+{
+    r = srgb_to_linear(r);
+    g = srgb_to_linear(g);
+    b = srgb_to_linear(b);
+
+    auto f = [](float t) {
+        return t > 216.f / 24389 ? std::cbrt(t) : (24389.f / 27 * t + 16) / 116;
+    };
+
+    float fx = f((0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / 0.95047f);
+    float fy = f( 0.2126729f * r + 0.7151522f * g + 0.0721750f * b);
+    float fz = f((0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / 1.08883f);
+
+    return CieLab(116 * fy - 16, 500 * (fx - fy), 200 * (fy - fz));
+}
+
+inline CieLab cielab_from_color(const QColor& color)
+{
+    return cielab_from_rgb(color.redF(), color.greenF(), color.blueF());
+}
+
+/**
+ * \brief CIEDE2000 color difference
+ */
+inline float ciede2000(const CieLab& lab1, const CieLab& lab2)
+{
+    const double pi = 3.14159265358979323846;
+    const double deg = pi / 180;
+
+    double c1 = std::hypot(lab1.a, lab1.b);
+    double c2 = std::hypot(lab2.a, lab2.b);
+    double c_mean7 = std::pow((c1 + c2) / 2, 7);
+    double g = 0.5 * (1 - std::sqrt(c_mean7 / (c_mean7 + 6103515625.0))); // 25^7
+
+    double a1 = (1 + g) * lab1.a;
+    double a2 = (1 + g) * lab2.a;
+    double c1p = std::hypot(a1, double(lab1.b));
+    double c2p = std::hypot(a2, double(lab2.b));
+    double h1p = c1p == 0 ? 0 : std::atan2(double(lab1.b), a1);
+    double h2p = c2p == 0 ? 0 : std::atan2(double(lab2.b), a2);
+    if ( h1p < 0 ) h1p += 2 * pi;
+    if ( h2p < 0 ) h2p += 2 * pi;
+
+    double dl = lab2.l - lab1.l;
+    double dc = c2p - c1p;
+    double dh = 0;
+    if ( c1p * c2p != 0 )
+    {
+        dh = h2p - h1p;
+        if ( dh > pi ) dh -= 2 * pi;
+        else if ( dh < -pi ) dh += 2 * pi;
+    }
+    double dhh = 2 * std::sqrt(c1p * c2p) * std::sin(dh / 2);
+
+    double l_mean = (lab1.l + lab2.l) / 2;
+    double c_mean = (c1p + c2p) / 2;
+    double h_mean = h1p + h2p;
+    if ( c1p * c2p != 0 )
+    {
+        if ( std::abs(h1p - h2p) > pi )
+            h_mean += h_mean < 2 * pi ? 2 * pi : -2 * pi;
+        h_mean /= 2;
+    }
+
+    double t = 1 - 0.17 * std::cos(h_mean - 30 * deg) + 0.24 * std::cos(2 * h_mean)
+                 + 0.32 * std::cos(3 * h_mean + 6 * deg) - 0.20 * std::cos(4 * h_mean - 63 * deg);
+    double l50 = (l_mean - 50) * (l_mean - 50);
+    double sl = 1 + 0.015 * l50 / std::sqrt(20 + l50);
+    double sc = 1 + 0.045 * c_mean;
+    double sh = 1 + 0.015 * c_mean * t;
+    double c_mean_p7 = std::pow(c_mean, 7);
+    double d_theta = 30 * deg * std::exp(-std::pow((h_mean / deg - 275) / 25, 2));
+    double rt = -2 * std::sqrt(c_mean_p7 / (c_mean_p7 + 6103515625.0)) * std::sin(2 * d_theta);
+
+    double tl = dl / sl;
+    double tc = dc / sc;
+    double th = dhh / sh;
+    return std::sqrt(tl * tl + tc * tc + th * th + rt * tc * th);
+}
+
+/**
+ * \brief Color in the OKLab perceptual color space
+ */
+struct OkLab
+{
+    float l = 0;
+    float a = 0;
+    float b = 0;
+
+    OkLab() = default;
+    OkLab(float l, float a, float b) : l(l), a(a), b(b) {}
+
+    /**
+     * \brief Squared euclidean distance, roughly proportional to the perceived difference
+     */
+    float distance2(const OkLab& other) const
+    {
+        float dl = l - other.l;
+        float da = a - other.a;
+        float db = b - other.b;
+        return dl * dl + da * da + db * db;
+    }
+};
+
+/**
+ * \brief Linear sRGB [0,1] to OKLab
+ */
+inline OkLab oklab_from_linear(float r, float g, float b)
+{
+    float l = std::cbrt(0.4122214708f * r + 0.5363325363f * g + 0.0514459929f * b);
+    float m = std::cbrt(0.2119034982f * r + 0.6806995451f * g + 0.1073969566f * b);
+    float s = std::cbrt(0.0883024619f * r + 0.2817188376f * g + 0.6299787005f * b);
+
+    return OkLab(
+        0.2104542553f * l + 0.7936177850f * m - 0.0040720468f * s,
+        1.9779984951f * l - 2.4285922050f * m + 0.4505937099f * s,
+        0.0259040371f * l + 0.7827717662f * m - 0.8086757660f * s
+    );
+}
+
+/**
+ * \brief sRGB components [0,1] to OKLab
+ */
+inline OkLab oklab_from_rgb(float r, float g, float b)
+{
+    return oklab_from_linear(srgb_to_linear(r), srgb_to_linear(g), srgb_to_linear(b));
+}
+
+inline OkLab oklab_from_color(const QColor& color)
+{
+    return oklab_from_rgb(color.redF(), color.greenF(), color.blueF());
+}
+
+/**
+ * \brief OKLab to sRGB, clamping colors outside the gamut
+ */
+inline QColor color_from_oklab(const OkLab& lab)
+{
+    float l = lab.l + 0.3963377774f * lab.a + 0.2158037573f * lab.b;
+    float m = lab.l - 0.1055613458f * lab.a - 0.0638541728f * lab.b;
+    float s = lab.l - 0.0894841775f * lab.a - 1.2914855480f * lab.b;
+    l = l * l * l;
+    m = m * m * m;
+    s = s * s * s;
+
+    return QColor::fromRgbF(
+        linear_to_srgb( 4.0767416621f * l - 3.3077115913f * m + 0.2309699292f * s),
+        linear_to_srgb(-1.2684380046f * l + 2.6097574011f * m - 0.3413193965f * s),
+        linear_to_srgb(-0.0041960863f * l - 0.7034186147f * m + 1.7076147010f * s)
+    );
+}
+
+} // namespace detail
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_COLOR_SPACE_HPP
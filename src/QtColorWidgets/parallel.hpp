@@ -0,0 +1,103 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_PARALLEL_HPP
+#define COLOR_WIDGETS_PARALLEL_HPP
+
+#include <functional>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+namespace color_widgets {
+namespace detail {
+
+/**
+ * \brief Runs a range of a parallel_for() and signals its completion
+ */
+class RangeTask : public QRunnable
+{
+public:
+    RangeTask(const std::function<void(int, int)>& func, int begin, int end, QSemaphore& done)
+        : func(func), begin(begin), end(end), done(done)
+    {}
+
+    void run() override
+    {
+        func(begin, end);
+        done.release();
+    }
+
+private:
+    const std::function<void(int, int)>& func;
+    int begin;
+    int end;
+    QSemaphore& done;
+};
+
+/**
+ * \brief Splits [begin, end) in contiguous ranges processed by the global thread pool
+ * \param grain Minimum number of items worth handing to a separate thread
+ * \param func  Called as func(range_begin, range_end), must be thread-safe
+ *
+ * The calling thread processes the first range. Ranges that cannot be
+ * started immediately because the pool is busy are processed by the calling
+ * thread as well, so it's safe to call this from a pool thread.
+ */
+inline void parallel_for(int begin, int end, int grain, const std::function<void(int, int)>& func)
+{
+    int count = end - begin;
+    int threads = qMin(QThread::idealThreadCount(), count / qMax(grain, 1));
+    if ( threads <= 1 )
+    {
+        if ( count > 0 )
+            func(begin, end);
+        return;
+    }
+
+    QSemaphore done;
+    int started = 0;
+    QThreadPool* pool = QThreadPool::globalInstance();
+    for ( int i = 1; i < threads; i++ )
+    {
+        int range_begin = begin + count * i / threads;
+        int range_end = begin + count * (i + 1) / threads;
+        RangeTask* task = new RangeTask(func, range_begin, range_end, done);
+        if ( pool->tryStart(task) )
+        {
+            started++;
+        }
+        else
+        {
+            func(range_begin, range_end);
+            delete task;
+        }
+    }
+
+    func(begin, begin + count / threads);
+    done.acquire(started);
+}
+
+} // namespace detail
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_PARALLEL_HPP
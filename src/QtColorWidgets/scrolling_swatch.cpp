@@ -0,0 +1,733 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "QtColorWidgets/scrolling_swatch.hpp"
+
+#include <limits>
+#include <QApplication>
+#include <QDrag>
+#include <QDragEnterEvent>
+#include <QDropEvent>
+#include <QKeyEvent>
+#include <QMimeData>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPointer>
+#include <QScrollBar>
+#include <QTimer>
+#include <QUndoStack>
+#include "QtColorWidgets/color_palette_commands.hpp"
+#include "swatch_helpers.hpp"
+#include "swatch_tooltip.hpp"
+
+namespace color_widgets {
+
+class ScrollingSwatch::Private
+{
+public:
+    ColorPalette palette;
+    int          selected = -1;
+    QSize        color_size{16, 16};
+    QPen         border{Qt::black, 1};
+    int          forced_columns = 0;
+    bool         readonly = false;
+    QPointer<QUndoStack> undo_stack;
+
+    int     columns = 1;            ///< Number of columns, updated by updateLayout()
+    int     rows = 0;               ///< Number of rows, updated by updateLayout()
+
+    QPoint  drag_pos;               ///< Point used to keep track of dragging
+    int     drag_index = -1;        ///< Index used by drags
+    int     drop_index = -1;        ///< Index for a requested drop
+    QColor  drop_color;             ///< First dropped color
+    QString drop_name;              ///< Name of the first dropped color
+    QVector<QPair<QColor,QString>> drop_colors; ///< Dropped colors, read once when the drag enters
+    bool    drop_overwrite = false; ///< Whether the drop will overwrite an existing color
+    bool    drop_move = false;      ///< Whether the drop moves a color within the widget
+    QPoint  drop_pos;               ///< Last drag position, in viewport coordinates
+    QTimer  autoscroll_timer;       ///< Scrolls while dragging close to the edges
+
+    ScrollingSwatch* owner;
+
+    explicit Private(ScrollingSwatch* owner)
+        : owner(owner)
+    {
+        autoscroll_timer.setInterval(30);
+    }
+
+    void edit(QUndoCommand* command)
+    {
+        if ( undo_stack )
+        {
+            undo_stack->push(command);
+        }
+        else
+        {
+            command->redo();
+            delete command;
+        }
+    }
+
+    QPoint scrollOffset() const
+    {
+        return QPoint(owner->horizontalScrollBar()->value(), owner->verticalScrollBar()->value());
+    }
+
+    /**
+     * \brief Computes rows and columns and updates the scroll bars to match
+     */
+    void updateLayout()
+    {
+        QSize viewport = owner->viewport()->size();
+        int count = palette.count();
+
+        if ( forced_columns )
+            columns = forced_columns;
+        else if ( palette.columns() )
+            columns = palette.columns();
+        else
+            columns = qMax(1, viewport.width() / qMax(1, color_size.width()));
+        rows = (count + columns - 1) / columns;
+
+        qint64 width = qint64(qMin(count, columns)) * color_size.width();
+        qint64 height = qint64(rows) * color_size.height();
+        const qint64 max_range = std::numeric_limits<int>::max();
+
+        QScrollBar* horizontal = owner->horizontalScrollBar();
+        horizontal->setRange(0, qMin(max_range, qMax<qint64>(0, width - viewport.width())));
+        horizontal->setPageStep(viewport.width());
+        horizontal->setSingleStep(color_size.width());
+
+        QScrollBar* vertical = owner->verticalScrollBar();
+        vertical->setRange(0, qMin(max_range, qMax<qint64>(0, height - viewport.height())));
+        vertical->setPageStep(viewport.height());
+        vertical->setSingleStep(color_size.height());
+
+        owner->viewport()->update();
+    }
+
+    QRect indexRect(int index) const
+    {
+        if ( index < 0 )
+            return QRect();
+        QPoint offset = scrollOffset();
+        return QRect(
+            int(qint64(index % columns) * color_size.width() - offset.x()),
+            int(qint64(index / columns) * color_size.height() - offset.y()),
+            color_size.width(),
+            color_size.height()
+        );
+    }
+
+    int indexAt(const QPoint& pos) const
+    {
+        if ( palette.count() == 0 || color_size.isEmpty() )
+            return -1;
+
+        QPoint offset = scrollOffset();
+        qint64 x = qint64(pos.x()) + offset.x();
+        qint64 y = qint64(pos.y()) + offset.y();
+        if ( x < 0 || y < 0 || x / color_size.width() >= columns )
+            return -1;
+
+        qint64 index = y / color_size.height() * columns + x / color_size.width();
+        return index < palette.count() ? int(index) : -1;
+    }
+
+    /**
+     * \brief Pixels outside a cell painted by its border, selection or drop marker
+     */
+    int cellMargin() const
+    {
+        return detail::swatch_cell_margin(border);
+    }
+
+    void updateIndex(int index)
+    {
+        QRect rect = indexRect(index);
+        if ( rect.isValid() )
+        {
+            int margin = cellMargin();
+            owner->viewport()->update(rect.adjusted(-margin, -margin, margin, margin));
+        }
+    }
+
+    void updateDrop(int index)
+    {
+        if ( index == -1 )
+            return;
+        // The marker can also be drawn at the end of the previous row
+        updateIndex(index - 1);
+        updateIndex(index);
+    }
+
+    /**
+     * \brief Reads the dragged color, once per drag
+     */
+    void readDrag(QDropEvent* event)
+    {
+        drop_colors = detail::swatch_drop_colors(event->mimeData());
+        drop_color = drop_colors.empty() ? QColor() : drop_colors[0].first;
+        drop_name = drop_colors.empty() ? QString() : drop_colors[0].second;
+    }
+
+    /**
+     * \brief Finds where a drag at \p pos would drop the color
+     */
+    void setDropPosition(const QPoint& pos)
+    {
+        int old_drop_index = drop_index;
+        drop_pos = pos;
+        drop_index = indexAt(pos);
+        if ( drop_index == -1 )
+            drop_index = palette.count();
+
+        drop_overwrite = false;
+        if ( drop_index < palette.count() )
+        {
+            drop_index += detail::swatch_drop_offset(pos, indexRect(drop_index), columns == 1,
+                                                     !drop_move && drop_colors.size() == 1, drop_overwrite);
+        }
+
+        updateDrop(old_drop_index);
+        updateDrop(drop_index);
+    }
+
+    void clearDrop()
+    {
+        autoscroll_timer.stop();
+        updateDrop(drop_index);
+        drop_index = -1;
+        drop_color = QColor();
+        drop_name.clear();
+        drop_colors.clear();
+        drop_overwrite = false;
+        drop_move = false;
+    }
+
+    /**
+     * \brief Amount to scroll by when dragging at \p pos, 0 if not close to an edge
+     */
+    int autoscrollStep(const QPoint& pos) const
+    {
+        int edge = qMax(color_size.height(), 8);
+        if ( pos.y() < edge )
+            return -color_size.height();
+        if ( pos.y() >= owner->viewport()->height() - edge )
+            return color_size.height();
+        return 0;
+    }
+
+    void autoscroll()
+    {
+        int step = autoscrollStep(drop_pos);
+        QScrollBar* vertical = owner->verticalScrollBar();
+        int value = vertical->value();
+        vertical->setValue(value + step);
+        if ( step == 0 || vertical->value() == value )
+            autoscroll_timer.stop();
+        else
+            setDropPosition(drop_pos);
+    }
+};
+
+ScrollingSwatch::ScrollingSwatch(QWidget* parent)
+    : QAbstractScrollArea(parent), p(new Private(this))
+{
+    auto palette_modified = [this]{
+        if ( p->selected >= p->palette.count() )
+            clearSelection();
+        p->updateLayout();
+    };
+    connect(&p->palette, &ColorPalette::colorsChanged, this, palette_modified);
+    connect(&p->palette, &ColorPalette::columnsChanged, this, palette_modified);
+    connect(&p->palette, &ColorPalette::colorAdded, this, palette_modified);
+    connect(&p->palette, &ColorPalette::colorRemoved, this, palette_modified);
+    connect(&p->palette, &ColorPalette::colorChanged, this, [this](int index){
+        p->updateIndex(index);
+        if ( index == p->selected )
+            Q_EMIT colorSelected(p->palette.colorAt(index));
+    });
+    connect(&p->autoscroll_timer, &QTimer::timeout, this, [this]{ p->autoscroll(); });
+
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setAcceptDrops(true);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+    p->updateLayout();
+}
+
+ScrollingSwatch::~ScrollingSwatch()
+{
+    delete p;
+}
+
+QSize ScrollingSwatch::sizeHint() const
+{
+    int columns = p->forced_columns ? p->forced_columns : p->palette.columns();
+    if ( columns == 0 )
+        columns = 16;
+    int frame = 2 * frameWidth();
+    return QSize(
+        columns * p->color_size.width() + frame + verticalScrollBar()->sizeHint().width(),
+        8 * p->color_size.height() + frame
+    );
+}
+
+const ColorPalette& ScrollingSwatch::palette() const
+{
+    return p->palette;
+}
+
+ColorPalette& ScrollingSwatch::palette()
+{
+    return p->palette;
+}
+
+int ScrollingSwatch::selected() const
+{
+    return p->selected;
+}
+
+QColor ScrollingSwatch::selectedColor() const
+{
+    return p->palette.colorAt(p->selected);
+}
+
+int ScrollingSwatch::indexAt(const QPoint& pos) const
+{
+    return p->indexAt(pos);
+}
+
+QRect ScrollingSwatch::indexRect(int index) const
+{
+    if ( index >= p->palette.count() )
+        return QRect();
+    return p->indexRect(index);
+}
+
+void ScrollingSwatch::setPalette(const ColorPalette& palette)
+{
+    clearSelection();
+    if ( p->undo_stack )
+        p->undo_stack->clear();
+    p->palette = palette;
+    verticalScrollBar()->setValue(0);
+    horizontalScrollBar()->setValue(0);
+    p->updateLayout();
+    Q_EMIT paletteChanged(p->palette);
+}
+
+void ScrollingSwatch::setSelected(int selected)
+{
+    if ( selected < 0 || selected >= p->palette.count() )
+        selected = -1;
+
+    if ( selected != p->selected )
+    {
+        p->updateIndex(p->selected);
+        Q_EMIT selectedChanged( p->selected = selected );
+        if ( selected != -1 )
+            Q_EMIT colorSelected( p->palette.colorAt(p->selected) );
+        p->updateIndex(p->selected);
+    }
+}
+
+void ScrollingSwatch::clearSelection()
+{
+    setSelected(-1);
+}
+
+void ScrollingSwatch::scrollToIndex(int index)
+{
+    QRect rect = indexRect(index);
+    if ( !rect.isValid() )
+        return;
+
+    QSize viewport = this->viewport()->size();
+    QScrollBar* vertical = verticalScrollBar();
+    if ( rect.top() < 0 )
+        vertical->setValue(vertical->value() + rect.top());
+    else if ( rect.bottom() >= viewport.height() )
+        vertical->setValue(vertical->value() + rect.bottom() - viewport.height() + 1);
+
+    QScrollBar* horizontal = horizontalScrollBar();
+    if ( rect.left() < 0 )
+        horizontal->setValue(horizontal->value() + rect.left());
+    else if ( rect.right() >= viewport.width() )
+        horizontal->setValue(horizontal->value() + rect.right() - viewport.width() + 1);
+}
+
+void ScrollingSwatch::removeSelected()
+{
+    if ( p->selected != -1 && !p->readonly )
+    {
+        int selected = p->selected;
+        p->edit(new RemoveColorCommand(&p->palette, selected));
+        setSelected(qMin(selected, p->palette.count() - 1));
+    }
+}
+
+bool ScrollingSwatch::viewportEvent(QEvent* event)
+{
+    if ( event->type() == QEvent::ToolTip )
+    {
+        QHelpEvent* help_ev = static_cast<QHelpEvent*>(event);
+        int index = p->indexAt(help_ev->pos());
+        if ( index != -1 )
+        {
+            QColor color = p->palette.colorAt(index);
+            QString text = detail::swatch_tooltip_text(color, p->palette.nameAt(index), false);
+            detail::SwatchToolTip::showText(help_ev->globalPos(), color, text, viewport(), p->indexRect(index));
+            event->accept();
+        }
+        else
+        {
+            detail::SwatchToolTip::hideText();
+            event->ignore();
+        }
+        return true;
+    }
+
+    return QAbstractScrollArea::viewportEvent(event);
+}
+
+void ScrollingSwatch::paintEvent(QPaintEvent* event)
+{
+    int count = p->palette.count();
+    if ( count == 0 || p->color_size.isEmpty() )
+        return;
+
+    QPainter painter(viewport());
+    const int width = p->color_size.width();
+    const int height = p->color_size.height();
+    QPoint offset = p->scrollOffset();
+
+    // Only the cells in the exposed area, including the ones whose borders reach into it
+    int margin = p->cellMargin();
+    QRect exposed = event->rect().adjusted(-margin, -margin, margin, margin).translated(offset);
+    int first_column = qMax(0, exposed.left() / width);
+    int last_column = qMin(p->columns - 1, exposed.right() / width);
+    int first_row = qMax(0, exposed.top() / height);
+    int last_row = qMin(p->rows - 1, exposed.bottom() / height);
+
+    const QVector<QPair<QColor,QString>> colors = p->palette.colors();
+    painter.setPen(p->border);
+    for ( int y = first_row; y <= last_row; y++ )
+    {
+        qint64 row_start = qint64(y) * p->columns;
+        for ( int x = first_column; x <= last_column && row_start + x < count; x++ )
+        {
+            painter.setBrush(colors[row_start + x].first);
+            painter.drawRect(QRect(x * width - offset.x(), y * height - offset.y(), width, height));
+        }
+    }
+
+    if ( p->drop_index != -1 )
+    {
+        // Also marked on the previous line when the drop is at the start of a line
+        QRectF line_end;
+        if ( p->drop_index % p->columns == 0 && p->drop_index != 0 )
+            line_end = p->indexRect(p->drop_index - 1);
+        detail::swatch_paint_drop_marker(painter, p->drop_color, p->drop_overwrite, p->columns == 1,
+                                         p->indexRect(p->drop_index), line_end);
+    }
+
+    if ( p->selected != -1 )
+        detail::swatch_paint_selection_marker(painter, p->indexRect(p->selected));
+}
+
+void ScrollingSwatch::resizeEvent(QResizeEvent* event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    p->updateLayout();
+}
+
+void ScrollingSwatch::scrollContentsBy(int dx, int dy)
+{
+    // Moves the pixels already painted, only the uncovered strip is repainted
+    viewport()->scroll(dx, dy);
+}
+
+void ScrollingSwatch::keyPressEvent(QKeyEvent* event)
+{
+    int count = p->palette.count();
+    if ( count == 0 )
+    {
+        QAbstractScrollArea::keyPressEvent(event);
+        return;
+    }
+
+    if ( p->undo_stack && !p->readonly )
+    {
+        if ( event->matches(QKeySequence::Undo) )
+        {
+            p->undo_stack->undo();
+            return;
+        }
+        else if ( event->matches(QKeySequence::Redo) )
+        {
+            p->undo_stack->redo();
+            return;
+        }
+    }
+
+    int selected = p->selected;
+    int columns = p->columns;
+    // Paging moves by the number of lines visible in the viewport
+    int page = qMax(1, viewport()->height() / qMax(1, p->color_size.height())) * columns;
+    if ( !detail::swatch_navigate(event, selected, count, columns, page) )
+    {
+        switch ( event->key() )
+        {
+            default:
+                QAbstractScrollArea::keyPressEvent(event);
+                return;
+
+            case Qt::Key_Delete:
+                removeSelected();
+                scrollToIndex(p->selected);
+                return;
+
+            case Qt::Key_Backspace:
+                if ( selected != -1 && !p->readonly )
+                {
+                    p->edit(new RemoveColorCommand(&p->palette, selected));
+                    selected = p->palette.count() == 0 ? -1 : qMax(selected - 1, 0);
+                }
+                break;
+        }
+    }
+    setSelected(selected);
+    scrollToIndex(p->selected);
+}
+
+void ScrollingSwatch::mousePressEvent(QMouseEvent* event)
+{
+    int index = p->indexAt(event->pos());
+    if ( event->button() == Qt::LeftButton )
+    {
+        setSelected(index);
+        p->drag_pos = event->pos();
+        p->drag_index = index;
+    }
+    else if ( event->button() == Qt::RightButton )
+    {
+        if ( index != -1 )
+            Q_EMIT rightClicked(index);
+    }
+}
+
+void ScrollingSwatch::mouseMoveEvent(QMouseEvent* event)
+{
+    if ( p->drag_index != -1 && (event->buttons() & Qt::LeftButton) &&
+        (p->drag_pos - event->pos()).manhattanLength() >= QApplication::startDragDistance() )
+    {
+        QColor color = p->palette.colorAt(p->drag_index);
+
+        QPixmap preview(24,24);
+        preview.fill(color);
+
+        ColorPalette dragged(QVector<QPair<QColor,QString>>{
+            qMakePair(color, p->palette.nameAt(p->drag_index))
+        });
+        QMimeData *mimedata = dragged.mimeData();
+        mimedata->setText(p->palette.nameAt(p->drag_index));
+
+        QDrag *drag = new QDrag(this);
+        drag->setMimeData(mimedata);
+        drag->setPixmap(preview);
+        Qt::DropActions actions = Qt::CopyAction;
+        if ( !p->readonly )
+            actions |= Qt::MoveAction;
+        drag->exec(actions);
+        p->drag_index = -1;
+    }
+}
+
+void ScrollingSwatch::mouseReleaseEvent(QMouseEvent* event)
+{
+    if ( event->button() == Qt::LeftButton )
+        p->drag_index = -1;
+}
+
+void ScrollingSwatch::mouseDoubleClickEvent(QMouseEvent* event)
+{
+    if ( event->button() == Qt::LeftButton )
+    {
+        int index = p->indexAt(event->pos());
+        if ( index != -1 )
+            Q_EMIT doubleClicked(index);
+    }
+}
+
+void ScrollingSwatch::dragEnterEvent(QDragEnterEvent* event)
+{
+    if ( p->readonly )
+        return;
+
+    p->readDrag(event);
+    if ( !p->drop_color.isValid() )
+        return;
+
+    p->drop_move = event->proposedAction() == Qt::MoveAction && event->source() == this;
+    event->setDropAction(p->drop_move ? Qt::MoveAction : Qt::CopyAction);
+    event->accept();
+    p->setDropPosition(event->pos());
+}
+
+void ScrollingSwatch::dragMoveEvent(QDragMoveEvent* event)
+{
+    if ( p->readonly || !p->drop_color.isValid() )
+        return;
+
+    p->drop_move = event->dropAction() == Qt::MoveAction && event->source() == this;
+    p->setDropPosition(event->pos());
+
+    if ( p->autoscrollStep(event->pos()) != 0 )
+    {
+        if ( !p->autoscroll_timer.isActive() )
+            p->autoscroll_timer.start();
+    }
+    else
+    {
+        p->autoscroll_timer.stop();
+    }
+}
+
+void ScrollingSwatch::dragLeaveEvent(QDragLeaveEvent* event)
+{
+    Q_UNUSED(event)
+    p->clearDrop();
+}
+
+void ScrollingSwatch::dropEvent(QDropEvent* event)
+{
+    if ( p->readonly || !p->drop_color.isValid() )
+        return;
+
+    p->setDropPosition(event->pos());
+
+    // Move unto self
+    if ( event->dropAction() == Qt::MoveAction && event->source() == this )
+    {
+        // Not moved => noop
+        if ( p->drop_index != p->drag_index && p->drop_index != p->drag_index + 1 )
+        {
+            // Index of the color after it has been removed from its old position
+            int to = p->drop_index > p->drag_index ? p->drop_index - 1 : p->drop_index;
+            p->edit(new MoveColorCommand(&p->palette, p->drag_index, to));
+            setSelected(to);
+        }
+    }
+    // Move into a color cell
+    else if ( p->drop_overwrite )
+    {
+        p->edit(new SetColorCommand(&p->palette, p->drop_index, p->drop_color, p->drop_name));
+    }
+    // Insert several colors
+    else if ( p->drop_colors.size() > 1 )
+    {
+        p->edit(new InsertColorsCommand(&p->palette, p->drop_index, p->drop_colors));
+        setSelected(p->drop_index);
+    }
+    // Insert the dropped color
+    else
+    {
+        p->edit(new InsertColorCommand(&p->palette, p->drop_index, p->drop_color, p->drop_name));
+    }
+
+    event->accept();
+    p->clearDrop();
+}
+
+QSize ScrollingSwatch::colorSize() const
+{
+    return p->color_size;
+}
+
+void ScrollingSwatch::setColorSize(const QSize& colorSize)
+{
+    if ( p->color_size != colorSize )
+    {
+        Q_EMIT colorSizeChanged(p->color_size = colorSize);
+        p->updateLayout();
+        updateGeometry();
+    }
+}
+
+QPen ScrollingSwatch::border() const
+{
+    return p->border;
+}
+
+void ScrollingSwatch::setBorder(const QPen& border)
+{
+    if ( border != p->border )
+    {
+        Q_EMIT borderChanged(p->border = border);
+        viewport()->update();
+    }
+}
+
+int ScrollingSwatch::forcedColumns() const
+{
+    return p->forced_columns;
+}
+
+void ScrollingSwatch::setForcedColumns(int forcedColumns)
+{
+    if ( forcedColumns <= 0 )
+        forcedColumns = 0;
+
+    if ( forcedColumns != p->forced_columns )
+    {
+        Q_EMIT forcedColumnsChanged(p->forced_columns = forcedColumns);
+        p->updateLayout();
+        updateGeometry();
+    }
+}
+
+bool ScrollingSwatch::readOnly() const
+{
+    return p->readonly;
+}
+
+void ScrollingSwatch::setReadOnly(bool readOnly)
+{
+    if ( readOnly != p->readonly )
+    {
+        Q_EMIT readOnlyChanged(p->readonly = readOnly);
+        viewport()->setAcceptDrops(!p->readonly);
+    }
+}
+
+QUndoStack* ScrollingSwatch::undoStack() const
+{
+    return p->undo_stack;
+}
+
+void ScrollingSwatch::setUndoStack(QUndoStack* undoStack)
+{
+    if ( undoStack != p->undo_stack )
+        Q_EMIT undoStackChanged(p->undo_stack = undoStack);
+}
+
+} // namespace color_widgets
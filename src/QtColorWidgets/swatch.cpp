@@ -21,6 +21,7 @@
  */
 #include "QtColorWidgets/swatch.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <QPainter>
 #include <QMouseEvent>
@@ -31,7 +32,16 @@
 #include <QDropEvent>
 #include <QDragEnterEvent>
 #include <QStyleOption>
-#include <QToolTip>
+#include <QPointer>
+#include <QUndoStack>
+#include <QRubberBand>
+#include <QClipboard>
+#include <QElapsedTimer>
+#include <QCache>
+#include <QSet>
+#include "QtColorWidgets/color_palette_commands.hpp"
+#include "swatch_helpers.hpp"
+#include "swatch_tooltip.hpp"
 
 namespace color_widgets {
 
@@ -39,7 +49,10 @@ class Swatch::Private
 {
 public:
     ColorPalette palette;    ///< Palette with colors and related metadata
+    ColorPaletteProxy proxy; ///< Order and filter of the cells, maps them to palette indexes
     int          selected;   ///< Current selection index (-1 for no selection)
+    QSet<int>    selection;  ///< All the selected indexes, including selected
+    int          anchor;     ///< Index range selections extend from
     QSize        color_size; ///< Preferred size for the color squares
     ColorSizePolicy size_policy;
     QPen         border;
@@ -49,14 +62,37 @@ public:
 
     QPoint  drag_pos;       ///< Point used to keep track of dragging
     int     drag_index;     ///< Index used by drags
+    QVector<int> drag_indexes; ///< Indexes being dragged, sorted
+    int     press_index;    ///< Selected index to keep alone if the press doesn't become a drag
+    QRubberBand* rubber_band; ///< Shown while selecting with a rubber band
+    bool    rubber_pending; ///< Whether moving the mouse starts a rubber band selection
+    QSet<int> rubber_base;  ///< Selection the rubber band adds to
     int     drop_index;     ///< Index for a requested drop
-    QColor  drop_color;     ///< Dropped color
+    QColor  drop_color;     ///< First dropped color
+    QVector<QPair<QColor,QString>> drop_colors; ///< Dropped colors, read once when the drag enters
     bool    drop_overwrite; ///< Whether the drop will overwrite an existing color
 
+    QPointer<QUndoStack> undo_stack; ///< Receives user edits, if set
+
+    QString search_text;        ///< Text typed so far for keyboardSearch()
+    QElapsedTimer search_timer; ///< Time since the last typed character
+
+    QPixmap grid;           ///< Cells and their borders in the visible area, without frame and markers
+    QRect   grid_area;      ///< Area of the widget covered by grid
+    QSize   grid_rowcols;   ///< Layout the grid has been rendered with
+    QRect   grid_clip;      ///< Frame contents the grid has been rendered with
+    bool    grid_valid;     ///< Whether the whole grid is up to date
+    QVector<int> dirty_cells; ///< Cells to redraw on a valid grid
+
+    QCache<int, QString> tooltips; ///< Tooltip text of the recently shown indexes
+    bool    tooltip_details;    ///< Whether tooltips show color space values
+
     Swatch* owner;
 
     Private(Swatch* owner)
-        : selected(-1),
+        : proxy(&palette),
+          selected(-1),
+          anchor(-1),
           color_size(16,16),
           size_policy(Hint),
           border(Qt::black, 1),
@@ -64,31 +100,393 @@ public:
           forced_columns(0),
           readonly(false),
           drag_index(-1),
+          press_index(-1),
+          rubber_band(nullptr),
+          rubber_pending(false),
           drop_index(-1),
           drop_overwrite(false),
+          grid_valid(false),
+          tooltips(256),
+          tooltip_details(false),
           owner(owner)
     {}
 
+    /**
+     * \brief Tooltip text for the color at \p index, computed on first use
+     *
+     * Changing a color drops only its text, other edits clear the cache.
+     */
+    QString tooltipText(int index)
+    {
+        if ( QString* text = tooltips.object(index) )
+            return *text;
+
+        QString text = detail::swatch_tooltip_text(palette.colorAt(index), palette.nameAt(index), tooltip_details);
+        tooltips.insert(index, new QString(text));
+        return text;
+    }
+
+    /**
+     * \brief Replaces the selection, repainting only the cells that changed
+     * \param current New current index, -1 or one of \p indexes
+     */
+    void select(const QSet<int>& indexes, int current)
+    {
+        bool selection_changed = indexes != selection;
+        if ( selection_changed )
+        {
+            QSet<int> changed = (indexes - selection).unite(selection - indexes);
+            selection = indexes;
+            if ( changed.size() > 64 )
+                owner->update();
+            else
+                for ( int index : changed )
+                    updateIndex(index);
+        }
+
+        if ( current != selected )
+        {
+            Q_EMIT owner->selectedChanged( selected = current );
+            if ( selected != -1 )
+                Q_EMIT owner->colorSelected( palette.colorAt(selected) );
+        }
+
+        if ( selection_changed )
+            Q_EMIT owner->selectionChanged();
+    }
+
+    /**
+     * \brief Selects the colors from the anchor to \p index
+     * \param add Whether to keep the colors already selected
+     */
+    void selectRange(int index, bool add)
+    {
+        if ( positionOf(anchor) == -1 )
+            anchor = positionOf(selected) != -1 ? selected : index;
+
+        // The range is between the cells, which are in palette order only without sorting
+        QSet<int> indexes = add ? selection : QSet<int>();
+        int anchor_position = positionOf(anchor);
+        int position = positionOf(index);
+        for ( int i = qMin(anchor_position, position), last = qMax(anchor_position, position); i <= last; i++ )
+            indexes.insert(sourceAt(i));
+        select(indexes, index);
+    }
+
+    /**
+     * \brief Selects \p count colors starting from palette index \p index
+     */
+    void selectSpan(int index, int count)
+    {
+        QSet<int> indexes;
+        for ( int i = index; i < index + count && i < palette.count(); i++ )
+            indexes.insert(i);
+        anchor = index;
+        select(indexes, indexes.empty() ? -1 : index);
+    }
+
+    /**
+     * \brief Adds or removes \p index from the selection
+     */
+    void toggle(int index)
+    {
+        QSet<int> indexes = selection;
+        int current = index;
+        if ( indexes.remove(index) )
+            current = indexes.empty() ? -1 : *std::min_element(indexes.begin(), indexes.end());
+        else
+            indexes.insert(index);
+        anchor = index;
+        select(indexes, current);
+    }
+
+    /**
+     * \brief Selects the colors intersecting \p rect in addition to rubber_base
+     */
+    void selectRect(const QRect& rect)
+    {
+        QSet<int> indexes = rubber_base;
+        QSize rowcols = this->rowcols();
+        if ( rowcols.isValid() )
+        {
+            QSizeF color_size = actualColorSize();
+            int first_column = qMax(0, int(rect.left() / color_size.width()));
+            int last_column = qMin(rowcols.width() - 1, int(rect.right() / color_size.width()));
+            int first_row = qMax(0, int(rect.top() / color_size.height()));
+            int last_row = qMin(rowcols.height() - 1, int(rect.bottom() / color_size.height()));
+            int count = proxy.count();
+            for ( int y = first_row; y <= last_row; y++ )
+                for ( int x = first_column, i = y * rowcols.width() + x; x <= last_column && i < count; x++, i++ )
+                    indexes.insert(sourceAt(i));
+        }
+
+        int current = selected;
+        if ( !indexes.contains(current) )
+            current = indexes.empty() ? -1 : *std::min_element(indexes.begin(), indexes.end());
+        select(indexes, current);
+    }
+
+    /**
+     * \brief Selected indexes in increasing order
+     */
+    QVector<int> selectedIndexes() const
+    {
+        QVector<int> indexes;
+        indexes.reserve(selection.size());
+        for ( int index : selection )
+            indexes.push_back(index);
+        std::sort(indexes.begin(), indexes.end());
+        return indexes;
+    }
+
+    /**
+     * \brief Palette with the colors at the given indexes
+     */
+    ColorPalette subPalette(const QVector<int>& indexes) const
+    {
+        QVector<QPair<QColor,QString>> colors;
+        colors.reserve(indexes.size());
+        for ( int index : indexes )
+            colors.push_back(qMakePair(palette.colorAt(index), palette.nameAt(index)));
+        ColorPalette result(colors, palette.name());
+        result.setDirty(false);
+        return result;
+    }
+
+    /**
+     * \brief Reads the dragged colors, once per drag
+     */
+    void readDrag(const QMimeData* data)
+    {
+        drop_colors = detail::swatch_drop_colors(data);
+        drop_color = drop_colors.empty() ? QColor() : drop_colors[0].first;
+    }
+
+    /**
+     * \brief Inserts \p colors before \p index and selects them
+     */
+    void insertColors(int index, const QVector<QPair<QColor,QString>>& colors)
+    {
+        if ( colors.size() == 1 )
+            edit(new InsertColorCommand(&palette, index, colors[0].first, colors[0].second));
+        else
+            edit(new InsertColorsCommand(&palette, index, colors));
+        selectSpan(index, colors.size());
+    }
+
+    /**
+     * \brief Marks the whole grid for redrawing, after the layout has changed
+     */
+    void invalidateGrid()
+    {
+        grid_valid = false;
+        dirty_cells.clear();
+        owner->update();
+    }
+
+    /**
+     * \brief Marks a single cell for redrawing
+     */
+    void invalidateCell(int index)
+    {
+        if ( !grid_valid )
+            return;
+        // The change can move the color or hide it
+        if ( !proxy.isIdentity() )
+        {
+            invalidateGrid();
+            return;
+        }
+        // Past this point redrawing everything is cheaper
+        if ( dirty_cells.size() >= 64 )
+            invalidateGrid();
+        else
+            dirty_cells.push_back(index);
+        updateIndex(index);
+    }
+
+    /**
+     * \brief Brings the grid up to date, redrawing only the dirty cells if possible
+     *
+     * Only the visible part of the widget is cached, as it can be much larger
+     * than the screen inside a scroll area.
+     * \returns \b false if the visible area is too large to be cached,
+     * the exposed cells should be painted directly
+     */
+    bool updateGrid(const QSize& rowcols, const QSizeF& color_size, const QRect& clip)
+    {
+        // Above this the pixmap costs more memory than it saves painting
+        static const qint64 max_grid_pixels = 4096 * 4096;
+
+        qreal dpr = owner->devicePixelRatioF();
+        QRect area = owner->visibleRegion().boundingRect() & clip;
+        if ( area.isEmpty() || qint64(area.width() * dpr) * qint64(area.height() * dpr) > max_grid_pixels )
+        {
+            grid = QPixmap();
+            grid_area = QRect();
+            grid_valid = false;
+            dirty_cells.clear();
+            return false;
+        }
+
+        if ( !grid_area.contains(area) || grid.devicePixelRatioF() != dpr ||
+             grid_rowcols != rowcols || grid_clip != clip )
+            grid_valid = false;
+
+        if ( !grid_valid )
+        {
+            grid = QPixmap(area.size() * dpr);
+            grid.setDevicePixelRatio(dpr);
+            grid.fill(Qt::transparent);
+            QPainter painter(&grid);
+            painter.translate(-area.topLeft());
+            painter.setClipRect(clip);
+            drawCells(painter, area, rowcols, color_size);
+            grid_area = area;
+            grid_rowcols = rowcols;
+            grid_clip = clip;
+            grid_valid = true;
+            dirty_cells.clear();
+        }
+        else if ( !dirty_cells.empty() )
+        {
+            QPainter painter(&grid);
+            painter.translate(-grid_area.topLeft());
+            int margin = cellMargin();
+            for ( int index : dirty_cells )
+            {
+                QRect area = cellRect(index, rowcols, color_size).toAlignedRect()
+                    .adjusted(-margin, -margin, margin, margin) & clip & grid_area;
+                if ( area.isEmpty() )
+                    continue;
+                painter.setClipRect(area);
+                painter.setCompositionMode(QPainter::CompositionMode_Source);
+                painter.fillRect(area, Qt::transparent);
+                painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+                // Neighbouring borders overlap the area, they are redrawn in the same order
+                drawCells(painter, area, rowcols, color_size);
+            }
+            dirty_cells.clear();
+        }
+        return true;
+    }
+
+    /**
+     * \brief Draws the cells reaching into \p area
+     */
+    void drawCells(QPainter& painter, const QRect& area, const QSize& rowcols, const QSizeF& color_size)
+    {
+        int margin = cellMargin();
+        QRect exposed = area.adjusted(-margin, -margin, margin, margin);
+        int first_column = qMax(0, int(exposed.left() / color_size.width()));
+        int last_column = qMin(rowcols.width() - 1, int(exposed.right() / color_size.width()));
+        int first_row = qMax(0, int(exposed.top() / color_size.height()));
+        int last_row = qMin(rowcols.height() - 1, int(exposed.bottom() / color_size.height()));
+
+        const QVector<QPair<QColor,QString>> colors = palette.colors();
+        bool identity = proxy.isIdentity();
+        int count = proxy.count();
+        painter.setPen(border);
+        for ( int y = first_row; y <= last_row; y++ )
+        {
+            for ( int x = first_column, i = y * rowcols.width() + x; x <= last_column && i < count; x++, i++ )
+            {
+                painter.setBrush(colors[identity ? i : proxy.mapToSource(i)].first);
+                painter.drawRect(cellRect(i, rowcols, color_size));
+            }
+        }
+    }
+
+    /**
+     * \brief Applies a user edit, through the undo stack if there is one
+     */
+    void edit(QUndoCommand* command)
+    {
+        if ( undo_stack )
+        {
+            undo_stack->push(command);
+        }
+        else
+        {
+            command->redo();
+            delete command;
+        }
+    }
+
     /**
      * \brief Number of rows/columns in the palette
      */
     QSize rowcols()
     {
-        int count = palette.count();
+        return layout().rowcols;
+    }
+
+    /**
+     * \brief Grid geometry and the values it has been computed from
+     */
+    struct Layout
+    {
+        QSize  rowcols;         ///< Number of columns and rows
+        QSizeF color_size;      ///< Actual size of a color square
+
+        QSize  widget_size;
+        int    count = -1;
+        int    columns = 0;
+        int    forced_rows = 0;
+        int    forced_columns = 0;
+        int    color_width = 0;
+    };
+    Layout cached_layout;
+
+    /**
+     * \brief Grid geometry, recomputed only when the size, the number of
+     * colors or the column settings change
+     */
+    const Layout& layout()
+    {
+        Layout& layout = cached_layout;
+        if ( layout.count != proxy.count() ||
+             layout.widget_size != owner->size() ||
+             layout.columns != palette.columns() ||
+             layout.forced_rows != forced_rows ||
+             layout.forced_columns != forced_columns ||
+             layout.color_width != color_size.width() )
+        {
+            layout.count = proxy.count();
+            layout.widget_size = owner->size();
+            layout.columns = palette.columns();
+            layout.forced_rows = forced_rows;
+            layout.forced_columns = forced_columns;
+            layout.color_width = color_size.width();
+
+            layout.rowcols = computeRowcols();
+            if ( layout.rowcols.isValid() )
+                layout.color_size = QSizeF(qreal(layout.widget_size.width()) / layout.rowcols.width(),
+                                           qreal(layout.widget_size.height()) / layout.rowcols.height());
+            else
+                layout.color_size = QSizeF();
+        }
+        return layout;
+    }
+
+    QSize computeRowcols() const
+    {
+        int count = proxy.count();
         if ( count == 0 )
             return QSize();
 
         if ( forced_rows )
-            return QSize(std::ceil( float(count) / forced_rows ), forced_rows);
+            return QSize((count + forced_rows - 1) / forced_rows, forced_rows);
 
         int columns = palette.columns();
 
         if ( forced_columns )
             columns = forced_columns;
-        else if ( columns == 0 )
-            columns = qMin(palette.count(), owner->width() / color_size.width());
+        else if ( columns == 0 && color_size.width() > 0 )
+            columns = qMin(count, owner->width() / color_size.width());
+        columns = qMax(columns, 1);
 
-        int rows = std::ceil( float(count) / columns );
+        int rows = (count + columns - 1) / columns;
 
         return QSize(columns, rows);
     }
@@ -98,50 +496,36 @@ public:
      */
     void dropEvent(QDropEvent* event)
     {
+        int old_drop_index = drop_index;
+
         // Find the output location
-        drop_index = owner->indexAt(event->pos());
+        drop_index = positionAt(event->pos());
+        int count = proxy.count();
         if ( drop_index == -1 )
-            drop_index = palette.count();
+            drop_index = count;
 
-        // Gather up the color
-        if ( event->mimeData()->hasColor() )
-        {
-            drop_color = event->mimeData()->colorData().value<QColor>();
-            drop_color.setAlpha(255);
-        }
-        else if ( event->mimeData()->hasText() )
+        drop_overwrite = false;
+        QRectF drop_rect = cellRect(drop_index);
+        if ( !proxy.isIdentity() )
         {
-            drop_color = QColor(event->mimeData()->text());
+            // The position of new colors depends on the sort, they are added at the end
+            if ( drop_index < count && drop_colors.size() <= 1 )
+                drop_overwrite = true;
+            else
+                drop_index = count;
         }
-
-        drop_overwrite = false;
-        QRectF drop_rect = indexRect(drop_index);
-        if ( drop_index < palette.count() && drop_rect.isValid() )
+        else if ( drop_index < count && drop_rect.isValid() )
         {
             // 1 column => vertical style
-            if ( palette.columns() == 1 || forced_columns == 1 )
-            {
-                // Dragged to the last quarter of the size of the square, add after
-                if ( event->posF().y() >= drop_rect.top() + drop_rect.height() * 3.0 / 4 )
-                    drop_index++;
-                // Dragged to the middle of the square, overwrite existing color
-                else if ( event->posF().x() > drop_rect.top() + drop_rect.height() / 4 &&
-                        ( event->dropAction() != Qt::MoveAction || event->source() != owner ) )
-                    drop_overwrite = true;
-            }
-            else
-            {
-                // Dragged to the last quarter of the size of the square, add after
-                if ( event->posF().x() >= drop_rect.left() + drop_rect.width() * 3.0 / 4 )
-                    drop_index++;
-                // Dragged to the middle of the square, overwrite existing color
-                else if ( event->posF().x() > drop_rect.left() + drop_rect.width() / 4 &&
-                        ( event->dropAction() != Qt::MoveAction || event->source() != owner ) )
-                    drop_overwrite = true;
-            }
+            bool vertical = palette.columns() == 1 || forced_columns == 1;
+            bool can_overwrite = ( event->dropAction() != Qt::MoveAction || event->source() != owner ) &&
+                                 drop_colors.size() <= 1;
+            drop_index += detail::swatch_drop_offset(event->posF(), drop_rect, vertical,
+                                                     can_overwrite, drop_overwrite);
         }
 
-        owner->update();
+        updateDrop(old_drop_index);
+        updateDrop(drop_index);
     }
 
     /**
@@ -149,11 +533,11 @@ public:
      */
     void clearDrop()
     {
+        updateDrop(drop_index);
         drop_index = -1;
         drop_color = QColor();
+        drop_colors.clear();
         drop_overwrite = false;
-
-        owner->update();
     }
 
     /**
@@ -161,49 +545,179 @@ public:
      */
     QSizeF actualColorSize()
     {
-        QSize rowcols = this->rowcols();
-        if ( !rowcols.isValid() )
-            return QSizeF();
-        return actualColorSize(rowcols);
+        return layout().color_size;
     }
 
     /**
-     * \brief Actual size of a color square
-     * \pre rowcols.isValid() and obtained via rowcols()
+     * \brief Palette index of the cell at \p position, -1 if there is no such cell
      */
-    QSizeF actualColorSize(const QSize& rowcols)
+    int sourceAt(int position) const
     {
-        return QSizeF (float(owner->width()) / rowcols.width(),
-                       float(owner->height()) / rowcols.height());
+        return proxy.mapToSource(position);
     }
 
+    /**
+     * \brief Cell showing the palette color at \p index, -1 if it's filtered out
+     */
+    int positionOf(int index) const
+    {
+        return proxy.mapFromSource(index);
+    }
+
+    /**
+     * \brief Palette index of the first cell after \p from_position whose name matches \p query
+     *
+     * Same as ColorPaletteNameIndex::next() but skipping the colors hidden
+     * by the filter and following the order of the cells.
+     */
+    int nextShown(const QString& query, int from_position) const
+    {
+        int count = proxy.count();
+        if ( count == 0 )
+            return -1;
+
+        from_position = qBound(-1, from_position, count - 1);
+        int best = -1;
+        int first = -1;
+        for ( int index : palette.nameIndex().matches(query) )
+        {
+            int position = positionOf(index);
+            if ( position == -1 )
+                continue;
+            if ( first == -1 || position < first )
+                first = position;
+            if ( position > from_position && (best == -1 || position < best) )
+                best = position;
+        }
+        if ( best == -1 )
+            best = first;
+
+        // Names containing the query characters in order
+        if ( best == -1 )
+        {
+            QString folded = query.toCaseFolded();
+            for ( int i = 1; i <= count && best == -1; i++ )
+            {
+                int position = (from_position + i) % count;
+                QString name = palette.nameAt(sourceAt(position)).toCaseFolded();
+                int matched = 0;
+                for ( int j = 0; j < name.size() && matched < folded.size(); j++ )
+                    if ( name[j] == folded[matched] )
+                        matched++;
+                if ( matched == folded.size() )
+                    best = position;
+            }
+        }
+
+        return sourceAt(best);
+    }
 
     /**
-     * \brief Rectangle corresponding to the color at the given index
+     * \brief Palette index where dropped colors are inserted
+     */
+    int insertIndex() const
+    {
+        return proxy.isIdentity() ? drop_index : palette.count();
+    }
+
+    /**
+     * \brief Cell at the given point in local coordinates, -1 if there is none
+     */
+    int positionAt(const QPoint& pt)
+    {
+        const Layout& layout = this->layout();
+        QSize rowcols = layout.rowcols;
+        if ( rowcols.isEmpty() || layout.widget_size.isEmpty() )
+            return -1;
+
+        // Same as dividing by the cell size, without rounding errors
+        QPoint point(
+            qBound<int>(0, qint64(pt.x()) * rowcols.width() / layout.widget_size.width(), rowcols.width() - 1),
+            qBound<int>(0, qint64(pt.y()) * rowcols.height() / layout.widget_size.height(), rowcols.height() - 1)
+        );
+
+        int position = point.y() * rowcols.width() + point.x();
+        if ( position >= layout.count )
+            return -1;
+        return position;
+    }
+
+    /**
+     * \brief Rectangle corresponding to the cell at the given position
      * \pre rowcols.isValid() and obtained via rowcols()
-     * \pre color_size obtained via rowlcols(rowcols)
+     * \pre color_size obtained via actualColorSize()
      */
-    QRectF indexRect(int index, const QSize& rowcols, const QSizeF& color_size)
+    QRectF cellRect(int position, const QSize& rowcols, const QSizeF& color_size)
     {
-        if ( index == -1 )
+        if ( position == -1 )
             return QRectF();
 
         return QRectF(
-            index % rowcols.width() * color_size.width(),
-            index / rowcols.width() * color_size.height(),
+            position % rowcols.width() * color_size.width(),
+            position / rowcols.width() * color_size.height(),
             color_size.width(),
             color_size.height()
         );
     }
+
     /**
-     * \brief Rectangle corresponding to the color at the given index
+     * \brief Rectangle corresponding to the cell at the given position
      */
-    QRectF indexRect(int index)
+    QRectF cellRect(int position)
     {
-        QSize rc = rowcols();
-        if ( index == -1 || !rc.isValid() )
+        const Layout& layout = this->layout();
+        if ( position == -1 || !layout.rowcols.isValid() )
             return QRectF();
-        return indexRect(index, rc, actualColorSize(rc));
+        return cellRect(position, layout.rowcols, layout.color_size);
+    }
+
+    /**
+     * \brief Rectangle of the cell showing the color at the given palette index
+     */
+    QRectF indexRect(int index)
+    {
+        return cellRect(positionOf(index));
+    }
+
+    /**
+     * \brief Pixels outside a cell painted by its border, selection or drop marker
+     */
+    int cellMargin() const
+    {
+        return detail::swatch_cell_margin(border);
+    }
+
+    /**
+     * \brief Repaints only the cell at the given position
+     */
+    void updateCell(int position)
+    {
+        QRectF rect = cellRect(position);
+        if ( rect.isValid() )
+        {
+            int margin = cellMargin();
+            owner->update(rect.toAlignedRect().adjusted(-margin, -margin, margin, margin));
+        }
+    }
+
+    /**
+     * \brief Repaints only the cell showing the color at the given palette index
+     */
+    void updateIndex(int index)
+    {
+        updateCell(positionOf(index));
+    }
+
+    /**
+     * \brief Repaints the area of the drop marker at the given position
+     */
+    void updateDrop(int position)
+    {
+        if ( position == -1 )
+            return;
+        // The marker can also be drawn at the end of the previous row
+        updateCell(position - 1);
+        updateCell(position);
     }
 };
 
@@ -213,9 +727,11 @@ Swatch::Swatch(QWidget* parent)
     connect(&p->palette, &ColorPalette::colorsChanged, this, &Swatch::paletteModified);
     connect(&p->palette, &ColorPalette::colorAdded, this, &Swatch::paletteModified);
     connect(&p->palette, &ColorPalette::colorRemoved, this, &Swatch::paletteModified);
-    connect(&p->palette, &ColorPalette::columnsChanged, this, (void(QWidget::*)())&QWidget::update);
-    connect(&p->palette, &ColorPalette::colorsUpdated, this, (void(QWidget::*)())&QWidget::update);
+    connect(&p->palette, &ColorPalette::columnsChanged, this, [this]{ p->invalidateGrid(); });
+    // Additions and removals move the following colors, a change only affects its cell
     connect(&p->palette, &ColorPalette::colorChanged, [this](int index){
+        p->invalidateCell(index);
+        p->tooltips.remove(index);
         if ( index == p->selected )
             Q_EMIT colorSelected( p->palette.colorAt(index) );
     });
@@ -272,21 +788,7 @@ QColor Swatch::selectedColor() const
 
 int Swatch::indexAt(const QPoint& pt)
 {
-    QSize rowcols = p->rowcols();
-    if ( rowcols.isEmpty() )
-        return -1;
-
-    QSizeF color_size = p->actualColorSize(rowcols);
-
-    QPoint point(
-        qBound<int>(0, pt.x() / color_size.width(), rowcols.width() - 1),
-        qBound<int>(0, pt.y() / color_size.height(), rowcols.height() - 1)
-    );
-
-    int index = point.y() * rowcols.width() + point.x();
-    if ( index >= p->palette.count() )
-        return -1;
-    return index;
+    return p->sourceAt(p->positionAt(pt));
 }
 
 QColor Swatch::colorAt(const QPoint& pt)
@@ -297,8 +799,10 @@ QColor Swatch::colorAt(const QPoint& pt)
 void Swatch::setPalette(const ColorPalette& palette)
 {
     clearSelection();
+    if ( p->undo_stack )
+        p->undo_stack->clear();
     p->palette = palette;
-    update();
+    p->invalidateGrid();
     Q_EMIT paletteChanged(p->palette);
 }
 
@@ -307,13 +811,8 @@ void Swatch::setSelected(int selected)
     if ( selected < 0 || selected >= p->palette.count() )
         selected = -1;
 
-    if ( selected != p->selected )
-    {
-        Q_EMIT selectedChanged( p->selected = selected );
-        if ( selected != -1 )
-            Q_EMIT colorSelected( p->palette.colorAt(p->selected) );
-        update();
-    }
+    p->anchor = selected;
+    p->select(selected == -1 ? QSet<int>() : QSet<int>{selected}, selected);
 }
 
 void Swatch::clearSelection()
@@ -321,14 +820,50 @@ void Swatch::clearSelection()
     setSelected(-1);
 }
 
+QVector<int> Swatch::selectedIndexes() const
+{
+    return p->selectedIndexes();
+}
+
+bool Swatch::isSelected(int index) const
+{
+    return p->selection.contains(index);
+}
+
+void Swatch::setSelectedIndexes(const QVector<int>& indexes)
+{
+    QSet<int> selection;
+    for ( int index : indexes )
+        if ( index >= 0 && index < p->palette.count() )
+            selection.insert(index);
+
+    int current = p->selected;
+    if ( !selection.contains(current) )
+        current = selection.empty() ? -1 : *std::min_element(selection.begin(), selection.end());
+    p->select(selection, current);
+}
+
+void Swatch::selectAll()
+{
+    // Colors hidden by the filter aren't selected
+    int count = p->proxy.count();
+    QSet<int> selection;
+    selection.reserve(count);
+    for ( int i = 0; i < count; i++ )
+        selection.insert(p->sourceAt(i));
+    p->select(selection, p->positionOf(p->selected) != -1 ? p->selected : p->sourceAt(count - 1));
+}
+
 void Swatch::paintEvent(QPaintEvent* event)
 {
-    Q_UNUSED(event)
     QSize rowcols = p->rowcols();
     if ( rowcols.isEmpty() )
         return;
 
-    QSizeF color_size = p->actualColorSize(rowcols);
+    QSizeF color_size = p->actualColorSize();
+    if ( color_size.isEmpty() )
+        return;
+
     QPainter painter(this);
 
     QStyleOptionFrame panel;
@@ -336,62 +871,42 @@ void Swatch::paintEvent(QPaintEvent* event)
     panel.lineWidth = 1;
     panel.midLineWidth = 0;
     panel.state |= QStyle::State_Sunken;
+    // The frame depends on focus and hover so it isn't cached
     style()->drawPrimitive(QStyle::PE_Frame, &panel, &painter, this);
     QRect r = style()->subElementRect(QStyle::SE_FrameContents, &panel, this);
-    painter.setClipRect(r);
 
-    int count = p->palette.count();
-        painter.setPen(p->border);
-    for ( int y = 0, i = 0; i < count; y++ )
+    // The painter is clipped to the exposed area so this only copies that,
+    // areas outside the visible region (eg: when grabbing the widget) are painted directly
+    QRect exposed_cells = event->rect() & r;
+    if ( p->updateGrid(rowcols, color_size, r) && p->grid_area.contains(exposed_cells) )
     {
-        for ( int x = 0; x < rowcols.width() && i < count; x++, i++ )
-        {
-            painter.setBrush(p->palette.colorAt(i));
-            painter.drawRect(p->indexRect(i, rowcols, color_size));
-        }
+        painter.drawPixmap(p->grid_area.topLeft(), p->grid);
+    }
+    else
+    {
+        painter.save();
+        painter.setClipRect(r);
+        p->drawCells(painter, exposed_cells, rowcols, color_size);
+        painter.restore();
     }
-
-    painter.setClipping(false);
 
     if ( p->drop_index != -1 )
     {
-        QRectF drop_area = p->indexRect(p->drop_index, rowcols, color_size);
-        if ( p->drop_overwrite )
-        {
-            painter.setBrush(p->drop_color);
-            painter.setPen(QPen(Qt::gray));
-            painter.drawRect(drop_area);
-        }
-        else if ( rowcols.width() == 1 )
-        {
-            // 1 column => vertical style
-            painter.setPen(QPen(p->drop_color, 2));
-            painter.setBrush(Qt::transparent);
-            painter.drawLine(drop_area.topLeft(), drop_area.topRight());
-        }
-        else
-        {
-            painter.setPen(QPen(p->drop_color, 2));
-            painter.setBrush(Qt::transparent);
-            painter.drawLine(drop_area.topLeft(), drop_area.bottomLeft());
-            // Draw also on the previous line when the first item of a line is selected
-            if ( p->drop_index % rowcols.width() == 0 && p->drop_index != 0 )
-            {
-                drop_area = p->indexRect(p->drop_index-1, rowcols, color_size);
-                drop_area.translate(color_size.width(), 0);
-                painter.drawLine(drop_area.topLeft(), drop_area.bottomLeft());
-            }
-        }
+        // Also marked on the previous line when the drop is at the start of a line
+        QRectF line_end;
+        if ( p->drop_index % rowcols.width() == 0 && p->drop_index != 0 )
+            line_end = p->cellRect(p->drop_index - 1, rowcols, color_size);
+        detail::swatch_paint_drop_marker(painter, p->drop_color, p->drop_overwrite, rowcols.width() == 1,
+                                         p->cellRect(p->drop_index, rowcols, color_size), line_end);
     }
 
-    if ( p->selected != -1 )
+    int margin = p->cellMargin();
+    QRectF exposed = event->rect().adjusted(-margin, -margin, margin, margin);
+    for ( int index : p->selection )
     {
-        QRectF rect = p->indexRect(p->selected, rowcols, color_size);
-        painter.setBrush(Qt::transparent);
-        painter.setPen(QPen(Qt::darkGray, 2));
-        painter.drawRect(rect);
-        painter.setPen(QPen(Qt::gray, 2, Qt::DotLine));
-        painter.drawRect(rect);
+        QRectF rect = p->cellRect(p->positionOf(index), rowcols, color_size);
+        if ( rect.isValid() && rect.intersects(exposed) )
+            detail::swatch_paint_selection_marker(painter, rect);
     }
 }
 
@@ -400,103 +915,194 @@ void Swatch::keyPressEvent(QKeyEvent* event)
     if ( p->palette.count() == 0 )
         QWidget::keyPressEvent(event);
 
-    int selected = p->selected;
-    int count = p->palette.count();
+    // Navigation moves between cells, which can be sorted or filtered
+    int selected = p->positionOf(p->selected);
+    int count = p->proxy.count();
     QSize rowcols = p->rowcols();
     int columns = rowcols.width();
     int rows = rowcols.height();
-    switch ( event->key() )
+    if ( event->matches(QKeySequence::SelectAll) )
     {
-        default:
-            QWidget::keyPressEvent(event);
+        selectAll();
+        return;
+    }
+    else if ( event->matches(QKeySequence::Copy) )
+    {
+        copySelected();
+        return;
+    }
+    else if ( event->matches(QKeySequence::Paste) )
+    {
+        paste();
+        return;
+    }
+
+    if ( p->undo_stack && !p->readonly )
+    {
+        if ( event->matches(QKeySequence::Undo) )
+        {
+            p->undo_stack->undo();
+            return;
+        }
+        else if ( event->matches(QKeySequence::Redo) )
+        {
+            p->undo_stack->redo();
             return;
+        }
+    }
 
-        case Qt::Key_Left:
-            if ( selected == -1 )
-                selected = count - 1;
-            else if ( selected > 0 )
-                selected--;
-            break;
-
-        case Qt::Key_Right:
-            if ( selected == -1 )
-                selected = 0;
-            else if ( selected < count - 1 )
-                selected++;
-            break;
-
-        case Qt::Key_Up:
-            if ( selected == -1 )
-                selected = count - 1;
-            else if ( selected >= columns )
-                selected -= columns;
-            break;
-
-        case Qt::Key_Down:
-            if ( selected == -1 )
-                selected = 0;
-            else if ( selected < count - columns )
-                selected += columns;
-            break;
-
-        case Qt::Key_Home:
-            if ( event->modifiers() & Qt::ControlModifier )
-                selected = 0;
-            else
-                selected -= selected % columns;
-            break;
+    // All the cells are visible, paging moves to the first or last line
+    if ( !detail::swatch_navigate(event, selected, count, columns, columns * rows) )
+    {
+        switch ( event->key() )
+        {
+            default:
+                if ( !event->text().isEmpty() && event->text()[0].isPrint() &&
+                     !(event->modifiers() & (Qt::ControlModifier|Qt::AltModifier|Qt::MetaModifier)) )
+                {
+                    keyboardSearch(event->text());
+                    return;
+                }
+                QWidget::keyPressEvent(event);
+                return;
+
+            case Qt::Key_Delete:
+                removeSelected();
+                return;
+
+            case Qt::Key_Backspace:
+                if ( p->selection.size() > 1 && !p->readonly )
+                {
+                    QVector<int> indexes = p->selectedIndexes();
+                    int first = count;
+                    for ( int index : indexes )
+                        first = qMin(first, p->positionOf(index));
+                    p->edit(new RemoveColorsCommand(&p->palette, indexes));
+                    count = p->proxy.count();
+                    selected = count == 0 ? -1 : qBound(0, first - 1, count - 1);
+                }
+                else if (selected != -1 && !p->readonly )
+                {
+                    p->edit(new RemoveColorCommand(&p->palette, p->selected));
+                    count = p->proxy.count();
+                    if ( count == 0 )
+                        selected = -1;
+                    else
+                        selected = qBound(0, selected - 1, count - 1);
+                }
+                break;
+        }
+    }
 
-        case Qt::Key_End:
-            if ( event->modifiers() & Qt::ControlModifier )
-                selected = count - 1;
-            else
-                selected += columns - (selected % columns) - 1;
-            break;
+    selected = p->sourceAt(selected);
+    if ( selected != -1 && (event->modifiers() & Qt::ShiftModifier) )
+        p->selectRange(selected, false);
+    else
+        setSelected(selected);
+}
 
-        case Qt::Key_Delete:
-            removeSelected();
-            return;
+void Swatch::removeSelected()
+{
+    if ( !p->selection.empty() && !p->readonly )
+    {
+        QVector<int> indexes = p->selectedIndexes();
+        int first = p->proxy.count();
+        for ( int index : indexes )
+            first = qMin(first, p->positionOf(index));
+        if ( indexes.size() == 1 )
+            p->edit(new RemoveColorCommand(&p->palette, indexes[0]));
+        else
+            p->edit(new RemoveColorsCommand(&p->palette, indexes));
+        // The next color in the view takes the place of the removed ones
+        setSelected(p->sourceAt(qMin(first, p->proxy.count() - 1)));
+    }
+}
 
-        case Qt::Key_Backspace:
-            if (selected != -1 && !p->readonly )
-            {
-                p->palette.eraseColor(selected);
-                if ( p->palette.count() == 0 )
-                    selected = -1;
-                else
-                    selected = qMax(selected - 1, 0);
-            }
-            break;
+void Swatch::keyboardSearch(const QString& search)
+{
+    if ( search.isEmpty() )
+        return;
 
-        case Qt::Key_PageUp:
-            if ( selected == -1 )
-                selected = 0;
-            else
-                selected = selected % columns;
-            break;
-        case Qt::Key_PageDown:
-            if ( selected == -1 )
-            {
-                selected = count - 1;
-            }
-            else
+    // Searching starts after the current color, in the order of the cells
+    int from = p->positionOf(p->selected);
+    if ( p->search_timer.isValid() && p->search_timer.elapsed() < QApplication::keyboardInputInterval() )
+    {
+        // A longer query can still match the current color
+        p->search_text += search;
+        if ( from != -1 )
+            from--;
+    }
+    else
+    {
+        p->search_text = search;
+    }
+    p->search_timer.start();
+
+    QString query = p->search_text;
+    // Typing the same character again cycles through the colors starting with it
+    if ( query.size() > 1 && query.count(query[0]) == query.size() )
+    {
+        query = query.left(1);
+        from = p->positionOf(p->selected);
+    }
+
+    int index = p->proxy.isIdentity() ? p->palette.nameIndex().next(query, from) : p->nextShown(query, from);
+    if ( index != -1 )
+        setSelected(index);
+}
+
+int Swatch::selectNearest(const QColor& color)
+{
+    if ( !color.isValid() )
+        return -1;
+
+    int index = -1;
+    const ColorPaletteIndex& search = p->palette.searchIndex();
+    if ( p->proxy.isIdentity() )
+    {
+        index = search.nearest(color);
+    }
+    else
+    {
+        // Colors hidden by the filter are skipped, asking for more of them as needed
+        for ( int k = 8; index == -1; k *= 4 )
+        {
+            for ( const ColorPaletteIndex::Match& match : search.nearest(color, k) )
             {
-                selected = columns * (rows-1) + selected % columns;
-                if ( selected >= count )
-                    selected -= columns;
+                if ( p->positionOf(match.index) != -1 )
+                {
+                    index = match.index;
+                    break;
+                }
             }
-            break;
+            if ( k >= p->palette.count() )
+                break;
+        }
     }
-    setSelected(selected);
+
+    if ( index != -1 )
+        setSelected(index);
+    return index;
 }
 
-void Swatch::removeSelected()
+void Swatch::copySelected()
+{
+    if ( !p->selection.empty() )
+        QApplication::clipboard()->setMimeData(p->subPalette(p->selectedIndexes()).mimeData());
+}
+
+void Swatch::paste()
 {
-    if (p->selected != -1 && !p->readonly )
+    const QMimeData* data = QApplication::clipboard()->mimeData();
+    if ( p->readonly || !data )
+        return;
+
+    QVector<QPair<QColor,QString>> colors = detail::swatch_drop_colors(data);
+    if ( !colors.empty() )
     {
-        int selected = p->selected;
-        p->palette.eraseColor(p->selected);
-        setSelected(qMin(selected, p->palette.count() - 1));
+        // Sorted views have no place for the new colors, they are appended to the palette
+        int index = p->selected == -1 || !p->proxy.isIdentity() ? p->palette.count() : p->selected + 1;
+        p->insertColors(index, colors);
     }
 }
 
@@ -504,9 +1110,43 @@ void Swatch::mousePressEvent(QMouseEvent *event)
 {
     if ( event->button() == Qt::LeftButton )
     {
-        setSelected(indexAt(event->pos()));
+        int index = indexAt(event->pos());
         p->drag_pos = event->pos();
-        p->drag_index = indexAt(event->pos());
+        p->drag_index = -1;
+        p->press_index = -1;
+        p->rubber_pending = false;
+
+        if ( index == -1 )
+        {
+            // Rubber band replacing the selection
+            clearSelection();
+            p->rubber_base.clear();
+            p->rubber_pending = true;
+        }
+        else if ( event->modifiers() & Qt::ShiftModifier )
+        {
+            p->selectRange(index, event->modifiers() & Qt::ControlModifier);
+        }
+        else if ( event->modifiers() & Qt::ControlModifier )
+        {
+            // Rubber band adding to the selection
+            p->toggle(index);
+            p->rubber_base = p->selection;
+            p->rubber_pending = true;
+        }
+        else if ( p->selection.size() > 1 && p->selection.contains(index) )
+        {
+            // Keep the selection in case the whole of it is dragged
+            p->anchor = index;
+            p->select(p->selection, index);
+            p->press_index = index;
+            p->drag_index = index;
+        }
+        else
+        {
+            setSelected(index);
+            p->drag_index = index;
+        }
     }
     else if ( event->button() == Qt::RightButton )
     {
@@ -518,17 +1158,42 @@ void Swatch::mousePressEvent(QMouseEvent *event)
 
 void Swatch::mouseMoveEvent(QMouseEvent *event)
 {
-    if ( p->drag_index != -1 &&  (event->buttons() & Qt::LeftButton) &&
-        (p->drag_pos - event->pos()).manhattanLength() >= QApplication::startDragDistance() )
+    if ( !(event->buttons() & Qt::LeftButton) )
+        return;
+
+    bool dragging = (p->drag_pos - event->pos()).manhattanLength() >= QApplication::startDragDistance();
+
+    if ( p->rubber_pending && (dragging || (p->rubber_band && p->rubber_band->isVisible())) )
+    {
+        if ( !p->rubber_band )
+            p->rubber_band = new QRubberBand(QRubberBand::Rectangle, this);
+        QRect rect = QRect(p->drag_pos, event->pos()).normalized();
+        p->rubber_band->setGeometry(rect);
+        p->rubber_band->show();
+        p->selectRect(rect);
+    }
+    else if ( p->drag_index != -1 && dragging )
     {
         QColor color = p->palette.colorAt(p->drag_index);
 
-        QPixmap preview(24,24);
-        preview.fill(color);
+        if ( p->selection.size() > 1 && p->selection.contains(p->drag_index) )
+            p->drag_indexes = p->selectedIndexes();
+        else
+            p->drag_indexes = {p->drag_index};
+        p->press_index = -1;
 
-        QMimeData *mimedata = new QMimeData;
-        mimedata->setColorData(color);
-        mimedata->setText(p->palette.nameAt(p->drag_index));
+        ColorPalette dragged = p->subPalette(p->drag_indexes);
+        QMimeData *mimedata = dragged.mimeData();
+        QPixmap preview(24,24);
+        if ( p->drag_indexes.size() > 1 )
+        {
+            preview = dragged.preview(QSize(48, 24));
+        }
+        else
+        {
+            preview.fill(color);
+            mimedata->setText(p->palette.nameAt(p->drag_index));
+        }
 
         QDrag *drag = new QDrag(this);
         drag->setMimeData(mimedata);
@@ -537,6 +1202,7 @@ void Swatch::mouseMoveEvent(QMouseEvent *event)
         if ( !p->readonly )
             actions |= Qt::MoveAction;
         drag->exec(actions);
+        p->drag_indexes.clear();
     }
 }
 
@@ -544,7 +1210,15 @@ void Swatch::mouseReleaseEvent(QMouseEvent *event)
 {
     if ( event->button() == Qt::LeftButton )
     {
+        // Clicked within a selection without dragging it
+        if ( p->press_index != -1 )
+            setSelected(p->press_index);
+        p->press_index = -1;
         p->drag_index = -1;
+        p->rubber_pending = false;
+        p->rubber_base.clear();
+        if ( p->rubber_band )
+            p->rubber_band->hide();
     }
 }
 
@@ -560,13 +1234,15 @@ void Swatch::mouseDoubleClickEvent(QMouseEvent *event)
 
 void Swatch::wheelEvent(QWheelEvent* event)
 {
+    int selected = p->positionOf(p->selected);
+    int count = p->proxy.count();
     if ( event->delta() > 0 )
-        p->selected = qMin(p->selected + 1, p->palette.count() - 1);
-    else if ( p->selected == -1 )
-            p->selected = p->palette.count() - 1;
-    else if ( p->selected > 0 )
-        p->selected--;
-    setSelected(p->selected);
+        selected = qMin(selected + 1, count - 1);
+    else if ( selected == -1 )
+        selected = count - 1;
+    else if ( selected > 0 )
+        selected--;
+    setSelected(p->sourceAt(selected));
 }
 
 void Swatch::dragEnterEvent(QDragEnterEvent *event)
@@ -574,6 +1250,7 @@ void Swatch::dragEnterEvent(QDragEnterEvent *event)
     if ( p->readonly )
         return;
 
+    p->readDrag(event->mimeData());
     p->dropEvent(event);
 
     if ( p->drop_color.isValid() && p->drop_index != -1 )
@@ -605,54 +1282,86 @@ void Swatch::dropEvent(QDropEvent *event)
     if ( p->readonly )
         return;
 
-    QString name;
-
-    // Gather up the color
-    if ( event->mimeData()->hasColor() && event->mimeData()->hasText() )
-            name = event->mimeData()->text();
-
     // Not a color, discard
     if ( !p->drop_color.isValid() || p->drop_index == -1 )
         return;
 
+    QString name = p->drop_colors[0].second;
+
     p->dropEvent(event);
 
+    // The order of a sorted view can't be changed by moving its colors
+    if ( event->dropAction() == Qt::MoveAction && event->source() == this && !p->proxy.isIdentity() )
+    {
+        // Noop, the colors would end up in the same cells
+    }
+    // Move several colors unto self
+    else if ( event->dropAction() == Qt::MoveAction && event->source() == this && p->drag_indexes.size() > 1 )
+    {
+        // Index of the first color after they have been removed from their old positions
+        int first = p->drop_index - (std::lower_bound(p->drag_indexes.begin(), p->drag_indexes.end(), p->drop_index) - p->drag_indexes.begin());
+        int count = p->drag_indexes.size();
+        p->edit(new MoveColorsCommand(&p->palette, p->drag_indexes, p->drop_index));
+        p->selectSpan(first, count);
+    }
     // Move unto self
-    if ( event->dropAction() == Qt::MoveAction && event->source() == this )
+    else if ( event->dropAction() == Qt::MoveAction && event->source() == this )
     {
         // Not moved => noop
         if ( p->drop_index != p->drag_index && p->drop_index != p->drag_index + 1 )
         {
-            // Erase the old color
-            p->palette.eraseColor(p->drag_index);
+            // Index of the color after it has been removed from its old position
             if ( p->drop_index > p->drag_index )
                 p->drop_index--;
-            p->selected = p->drop_index;
-            // Insert the dropped color
-            p->palette.insertColor(p->drop_index, p->drop_color, name);
+            // The drag carries the color and name of the moved entry
+            p->edit(new MoveColorCommand(&p->palette, p->drag_index, p->drop_index));
+            setSelected(p->drop_index);
         }
     }
+    // Insert several colors
+    else if ( p->drop_colors.size() > 1 )
+    {
+        p->insertColors(p->insertIndex(), p->drop_colors);
+    }
     // Move into a color cell
     else if ( p->drop_overwrite )
     {
-        p->palette.setColorAt(p->drop_index, p->drop_color, name);
+        p->edit(new SetColorCommand(&p->palette, p->sourceAt(p->drop_index), p->drop_color, name));
     }
     // Insert the dropped color
     else
     {
-        p->palette.insertColor(p->drop_index, p->drop_color, name);
+        p->edit(new InsertColorCommand(&p->palette, p->insertIndex(), p->drop_color, name));
     }
 
     // Finalize
     event->accept();
     p->drag_index = -1;
+    p->drag_indexes.clear();
     p->clearDrop();
 }
 
 void Swatch::paletteModified()
 {
-    if ( p->selected >= p->palette.count() )
-        clearSelection();
+    // Indexes may have moved
+    p->tooltips.clear();
+
+    // Drop the selected indexes past the end or hidden by the filter
+    QSet<int> selection = p->selection;
+    for ( auto it = selection.begin(); it != selection.end(); )
+    {
+        if ( p->positionOf(*it) == -1 )
+            it = selection.erase(it);
+        else
+            ++it;
+    }
+    if ( selection.size() != p->selection.size() )
+    {
+        int current = p->positionOf(p->selected) != -1 ? p->selected : -1;
+        if ( current == -1 && !selection.empty() )
+            current = *std::min_element(selection.begin(), selection.end());
+        p->select(selection, current);
+    }
 
     if ( p->size_policy != Hint )
     {
@@ -667,7 +1376,7 @@ void Swatch::paletteModified()
         }
     }
 
-    update();
+    p->invalidateGrid();
 }
 
 QSize Swatch::colorSize() const
@@ -745,6 +1454,81 @@ void Swatch::setReadOnly(bool readOnly)
     }
 }
 
+QUndoStack* Swatch::undoStack() const
+{
+    return p->undo_stack;
+}
+
+void Swatch::setUndoStack(QUndoStack* undoStack)
+{
+    if ( undoStack != p->undo_stack )
+        Q_EMIT undoStackChanged(p->undo_stack = undoStack);
+}
+
+bool Swatch::detailedToolTips() const
+{
+    return p->tooltip_details;
+}
+
+void Swatch::setDetailedToolTips(bool detailedToolTips)
+{
+    if ( detailedToolTips != p->tooltip_details )
+    {
+        p->tooltips.clear();
+        Q_EMIT detailedToolTipsChanged(p->tooltip_details = detailedToolTips);
+    }
+}
+
+const ColorPaletteProxy& Swatch::proxy() const
+{
+    return p->proxy;
+}
+
+ColorPaletteProxy::SortKey Swatch::sortKey() const
+{
+    return p->proxy.sortKey();
+}
+
+void Swatch::setSortKey(ColorPaletteProxy::SortKey sortKey)
+{
+    if ( sortKey != p->proxy.sortKey() )
+    {
+        p->proxy.setSortKey(sortKey);
+        paletteModified();
+        Q_EMIT sortKeyChanged(sortKey);
+    }
+}
+
+Qt::SortOrder Swatch::sortOrder() const
+{
+    return p->proxy.sortOrder();
+}
+
+void Swatch::setSortOrder(Qt::SortOrder sortOrder)
+{
+    if ( sortOrder != p->proxy.sortOrder() )
+    {
+        p->proxy.setSortOrder(sortOrder);
+        paletteModified();
+        Q_EMIT sortOrderChanged(sortOrder);
+    }
+}
+
+QString Swatch::filter() const
+{
+    return p->proxy.filter();
+}
+
+void Swatch::setFilter(const QString& filter)
+{
+    if ( filter != p->proxy.filter() )
+    {
+        p->proxy.setFilter(filter);
+        paletteModified();
+        Q_EMIT filterChanged(filter);
+    }
+}
+
 bool Swatch::event(QEvent* event)
 {
     if(event->type() == QEvent::ToolTip)
@@ -753,19 +1537,13 @@ bool Swatch::event(QEvent* event)
         int index = indexAt(help_ev->pos());
         if ( index != -1 )
         {
-            QColor color = p->palette.colorAt(index);
-            QString name = p->palette.nameAt(index);
-            QString message = color.name();
-            if ( !name.isEmpty() )
-                message = tr("%1 (%2)").arg(name).arg(message);
-            message = "<tt style='background-color:"+color.name()+";color:"+color.name()+";'>MM</tt> "+message.toHtmlEscaped();
-            QToolTip::showText(help_ev->globalPos(), message, this,
-                               p->indexRect(index).toRect());
+            detail::SwatchToolTip::showText(help_ev->globalPos(), p->palette.colorAt(index),
+                                            p->tooltipText(index), this, p->indexRect(index).toRect());
             event->accept();
         }
         else
         {
-            QToolTip::hideText();
+            detail::SwatchToolTip::hideText();
             event->ignore();
         }
         return true;
@@ -785,7 +1563,7 @@ void Swatch::setBorder(const QPen& border)
     {
         p->border = border;
         Q_EMIT borderChanged(border);
-        update();
+        p->invalidateGrid();
     }
 }
 
@@ -0,0 +1,172 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "swatch_helpers.hpp"
+#include <cmath>
+#include <QKeyEvent>
+#include <QMimeData>
+#include <QPainter>
+#include "QtColorWidgets/color_palette.hpp"
+
+namespace color_widgets {
+namespace detail {
+
+int swatch_cell_margin(const QPen& border)
+{
+    return std::ceil(qMax<qreal>(border.widthF(), 2));
+}
+
+QVector<QPair<QColor,QString>> swatch_drop_colors(const QMimeData* data)
+{
+    QVector<QPair<QColor,QString>> colors = ColorPalette::fromMimeData(data).colors();
+    if ( !colors.empty() && data->hasColor() && !data->hasFormat(ColorPalette::mimeType()) )
+        colors[0].first.setAlpha(255);
+    return colors;
+}
+
+int swatch_drop_offset(const QPointF& pos, const QRectF& cell, bool vertical,
+                       bool can_overwrite, bool& overwrite)
+{
+    overwrite = false;
+    qreal along = vertical ? pos.y() - cell.top() : pos.x() - cell.left();
+    qreal size = vertical ? cell.height() : cell.width();
+
+    // Dragged to the last quarter of the size of the square, add after
+    if ( along >= size * 3 / 4 )
+        return 1;
+    // Dragged to the middle of the square, overwrite existing color
+    if ( along > size / 4 && can_overwrite )
+        overwrite = true;
+    return 0;
+}
+
+void swatch_paint_drop_marker(QPainter& painter, const QColor& color, bool overwrite,
+                              bool vertical, const QRectF& cell, const QRectF& line_end)
+{
+    if ( overwrite )
+    {
+        painter.setBrush(color);
+        painter.setPen(QPen(Qt::gray));
+        painter.drawRect(cell);
+        return;
+    }
+
+    painter.setPen(QPen(color, 2));
+    painter.setBrush(Qt::transparent);
+    if ( vertical )
+    {
+        painter.drawLine(cell.topLeft(), cell.topRight());
+    }
+    else
+    {
+        painter.drawLine(cell.topLeft(), cell.bottomLeft());
+        if ( line_end.isValid() )
+            painter.drawLine(line_end.topRight(), line_end.bottomRight());
+    }
+}
+
+void swatch_paint_selection_marker(QPainter& painter, const QRectF& cell)
+{
+    painter.setBrush(Qt::transparent);
+    painter.setPen(QPen(Qt::darkGray, 2));
+    painter.drawRect(cell);
+    painter.setPen(QPen(Qt::gray, 2, Qt::DotLine));
+    painter.drawRect(cell);
+}
+
+bool swatch_navigate(const QKeyEvent* event, int& position, int count, int columns, int page)
+{
+    if ( count == 0 || columns <= 0 )
+        return false;
+
+    int selected = position;
+    switch ( event->key() )
+    {
+        default:
+            return false;
+
+        case Qt::Key_Left:
+            if ( selected == -1 )
+                selected = count - 1;
+            else if ( selected > 0 )
+                selected--;
+            break;
+
+        case Qt::Key_Right:
+            if ( selected == -1 )
+                selected = 0;
+            else if ( selected < count - 1 )
+                selected++;
+            break;
+
+        case Qt::Key_Up:
+            if ( selected == -1 )
+                selected = count - 1;
+            else if ( selected >= columns )
+                selected -= columns;
+            break;
+
+        case Qt::Key_Down:
+            if ( selected == -1 )
+                selected = 0;
+            else if ( selected < count - columns )
+                selected += columns;
+            break;
+
+        case Qt::Key_Home:
+            if ( event->modifiers() & Qt::ControlModifier || selected == -1 )
+                selected = 0;
+            else
+                selected -= selected % columns;
+            break;
+
+        case Qt::Key_End:
+            if ( event->modifiers() & Qt::ControlModifier || selected == -1 )
+                selected = count - 1;
+            else
+                selected = qMin(count - 1, selected + columns - (selected % columns) - 1);
+            break;
+
+        case Qt::Key_PageUp:
+            if ( selected == -1 )
+                selected = 0;
+            else if ( selected >= page )
+                selected -= page;
+            else
+                selected %= columns;
+            break;
+
+        case Qt::Key_PageDown:
+            if ( selected == -1 )
+                selected = count - 1;
+            else if ( selected < count - page )
+                selected += page;
+            else if ( selected < count - columns )
+                selected += (count - 1 - selected) / columns * columns;
+            break;
+    }
+
+    position = selected;
+    return true;
+}
+
+} // namespace detail
+} // namespace color_widgets
@@ -0,0 +1,87 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_SWATCH_HELPERS_HPP
+#define COLOR_WIDGETS_SWATCH_HELPERS_HPP
+
+#include <QColor>
+#include <QPair>
+#include <QPen>
+#include <QRectF>
+#include <QString>
+#include <QVector>
+
+class QKeyEvent;
+class QMimeData;
+class QPainter;
+
+namespace color_widgets {
+namespace detail {
+
+/**
+ * \brief Pixels outside a cell painted by its border, selection or drop marker
+ */
+int swatch_cell_margin(const QPen& border);
+
+/**
+ * \brief Colors carried by dragged or pasted mime data
+ *
+ * Plain color data isn't meant to carry the alpha to palettes, so it's
+ * made opaque unless it comes from a palette.
+ */
+QVector<QPair<QColor,QString>> swatch_drop_colors(const QMimeData* data);
+
+/**
+ * \brief Where a drop at \p pos lands relative to the cell \p cell
+ * \param vertical      Whether the cells are in a single column
+ * \param can_overwrite Whether the drop may replace the color in the cell
+ * \param[out] overwrite Set when the drop replaces the color in the cell
+ * \returns 1 if the colors go after the cell, 0 if before it or overwriting it
+ */
+int swatch_drop_offset(const QPointF& pos, const QRectF& cell, bool vertical,
+                       bool can_overwrite, bool& overwrite);
+
+/**
+ * \brief Paints the marker showing where dropped colors go
+ * \param cell      Cell at the drop position
+ * \param line_end  Last cell of the previous line, when the drop is at the start
+ *                  of a line its right side is marked as well. Can be invalid.
+ */
+void swatch_paint_drop_marker(QPainter& painter, const QColor& color, bool overwrite,
+                              bool vertical, const QRectF& cell, const QRectF& line_end);
+
+/**
+ * \brief Paints the marker around a selected cell
+ */
+void swatch_paint_selection_marker(QPainter& painter, const QRectF& cell);
+
+/**
+ * \brief Moves \p position for the navigation keys shared by the swatch widgets
+ * \param position  Position of the current cell, -1 if none, updated with the result
+ * \param page      Number of cells moved by Page Up and Page Down
+ * \returns \b false if \p event isn't a navigation key
+ */
+bool swatch_navigate(const QKeyEvent* event, int& position, int count, int columns, int page);
+
+} // namespace detail
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_SWATCH_HELPERS_HPP
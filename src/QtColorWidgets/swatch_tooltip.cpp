@@ -0,0 +1,255 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "swatch_tooltip.hpp"
+#include <QApplication>
+#include <QDesktopWidget>
+#include <QMouseEvent>
+#include <QStyleOption>
+#include <QStylePainter>
+#include <QToolTip>
+#include <QtMath>
+#include "color_space.hpp"
+
+namespace color_widgets {
+namespace detail {
+
+namespace {
+
+/// Space between the color sample and the text
+const int sample_spacing = 4;
+
+QString translate(const char* text)
+{
+    return QCoreApplication::translate("color_widgets::Swatch", text);
+}
+
+} // namespace
+
+QString swatch_tooltip_text(const QColor& color, const QString& name, bool details)
+{
+    QString text = color.name();
+    if ( !name.isEmpty() )
+        text = translate("%1 (%2)").arg(name, text);
+
+    if ( !details )
+        return text;
+
+    text += '\n';
+    text += translate("HSV %1°, %2%, %3%")
+        .arg(qMax(color.hsvHue(), 0))
+        .arg(qRound(color.hsvSaturationF() * 100))
+        .arg(qRound(color.valueF() * 100));
+
+    OkLab lab = oklab_from_color(color);
+    float hue = qRadiansToDegrees(std::atan2(lab.b, lab.a));
+    if ( hue < 0 )
+        hue += 360;
+    text += '\n';
+    text += translate("OKLCh %1, %2, %3°")
+        .arg(lab.l, 0, 'f', 3)
+        .arg(std::hypot(lab.a, lab.b), 0, 'f', 3)
+        .arg(qRound(hue));
+
+    text += '\n';
+    text += translate("Contrast %1:1 on white, %2:1 on black")
+        .arg(contrast_ratio(color, Qt::white), 0, 'f', 2)
+        .arg(contrast_ratio(color, Qt::black), 0, 'f', 2);
+
+    return text;
+}
+
+SwatchToolTip::SwatchToolTip()
+    : QWidget(nullptr, Qt::ToolTip | Qt::BypassGraphicsProxyWidget)
+{
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setPalette(QToolTip::palette());
+    setFont(QToolTip::font());
+}
+
+SwatchToolTip* SwatchToolTip::instance(bool create)
+{
+    static QPointer<SwatchToolTip> tooltip;
+    if ( !tooltip && create )
+    {
+        tooltip = new SwatchToolTip();
+        QObject::connect(qApp, &QCoreApplication::aboutToQuit, tooltip.data(), &QObject::deleteLater);
+    }
+    return tooltip;
+}
+
+void SwatchToolTip::showText(const QPoint& global_pos, const QColor& color, const QString& text,
+                             QWidget* widget, const QRect& rect)
+{
+    SwatchToolTip* tooltip = instance(true);
+    tooltip->setWidget(widget);
+    tooltip->rect = rect;
+
+    if ( text != tooltip->text || color != tooltip->color || tooltip->isHidden() )
+    {
+        if ( text != tooltip->text )
+        {
+            tooltip->text = text;
+            tooltip->lines = text.split('\n');
+
+            QFontMetrics metrics = tooltip->fontMetrics();
+            int text_width = 0;
+            for ( const QString& line : tooltip->lines )
+            {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+                text_width = qMax(text_width, metrics.horizontalAdvance(line));
+#else
+                text_width = qMax(text_width, metrics.width(line));
+#endif
+            }
+            int text_height = metrics.height() * tooltip->lines.size();
+            int margin = tooltip->frameMargin();
+            // The sample is a square as tall as the text
+            tooltip->resize(
+                margin * 2 + text_height + sample_spacing + text_width,
+                margin * 2 + text_height
+            );
+        }
+        tooltip->color = color;
+        tooltip->update();
+    }
+
+    tooltip->place(global_pos);
+    if ( tooltip->isHidden() )
+        tooltip->show();
+    tooltip->raise();
+}
+
+void SwatchToolTip::hideText()
+{
+    if ( SwatchToolTip* tooltip = instance(false) )
+    {
+        tooltip->hide();
+        tooltip->setWidget(nullptr);
+    }
+}
+
+void SwatchToolTip::setWidget(QWidget* widget)
+{
+    if ( widget == this->widget )
+        return;
+
+    if ( this->widget )
+    {
+        this->widget->removeEventFilter(this);
+        this->widget->setMouseTracking(widget_tracking);
+    }
+
+    this->widget = widget;
+
+    if ( widget )
+    {
+        // Needed to follow the cursor across the colors
+        widget_tracking = widget->hasMouseTracking();
+        widget->setMouseTracking(true);
+        widget->installEventFilter(this);
+    }
+}
+
+void SwatchToolTip::place(const QPoint& global_pos)
+{
+    QRect screen = QApplication::desktop()->availableGeometry(global_pos);
+    // Same offset as QToolTip
+    QPoint pos = global_pos + QPoint(2, 16);
+    if ( pos.x() + width() > screen.right() )
+        pos.setX(qMax(screen.left(), screen.right() - width()));
+    if ( pos.y() + height() > screen.bottom() )
+        pos.setY(global_pos.y() - 4 - height());
+    move(pos);
+}
+
+int SwatchToolTip::frameMargin() const
+{
+    return 1 + style()->pixelMetric(QStyle::PM_ToolTipLabelFrameWidth, nullptr, this);
+}
+
+void SwatchToolTip::paintEvent(QPaintEvent*)
+{
+    QStylePainter painter(this);
+    QStyleOptionFrame option;
+    option.initFrom(this);
+    painter.drawPrimitive(QStyle::PE_PanelTipLabel, option);
+
+    QFontMetrics metrics = fontMetrics();
+    int margin = frameMargin();
+    int side = metrics.height() * lines.size();
+
+    painter.setPen(palette().color(QPalette::ToolTipText));
+    painter.setBrush(color);
+    painter.drawRect(margin, margin, side - 1, side - 1);
+
+    int x = margin + side + sample_spacing;
+    int y = margin + metrics.ascent();
+    for ( const QString& line : lines )
+    {
+        painter.drawText(x, y, line);
+        y += metrics.height();
+    }
+}
+
+bool SwatchToolTip::eventFilter(QObject* object, QEvent* event)
+{
+    if ( object != widget )
+        return false;
+
+    switch ( event->type() )
+    {
+        case QEvent::MouseMove:
+        {
+            QMouseEvent* mouse_event = static_cast<QMouseEvent*>(event);
+            if ( rect.contains(mouse_event->pos()) )
+                break;
+            if ( mouse_event->buttons() != Qt::NoButton )
+            {
+                hideText();
+                break;
+            }
+            // Ask the widget about the color under the cursor right away
+            QHelpEvent help_event(QEvent::ToolTip, mouse_event->pos(), mouse_event->globalPos());
+            QCoreApplication::sendEvent(widget, &help_event);
+            if ( !help_event.isAccepted() )
+                hideText();
+            break;
+        }
+        case QEvent::Leave:
+        case QEvent::Hide:
+        case QEvent::FocusOut:
+        case QEvent::WindowDeactivate:
+        case QEvent::MouseButtonPress:
+        case QEvent::MouseButtonDblClick:
+        case QEvent::KeyPress:
+        case QEvent::Wheel:
+            hideText();
+            break;
+        default:
+            break;
+    }
+
+    return false;
+}
+
+} // namespace detail
+} // namespace color_widgets
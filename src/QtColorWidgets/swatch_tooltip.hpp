@@ -0,0 +1,80 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef COLOR_WIDGETS_SWATCH_TOOLTIP_HPP
+#define COLOR_WIDGETS_SWATCH_TOOLTIP_HPP
+
+#include <QWidget>
+#include <QPointer>
+#include <QStringList>
+
+namespace color_widgets {
+namespace detail {
+
+/**
+ * \brief Plain text description of a palette color, as shown in tooltips
+ * \param details Whether to add HSV, OKLCh and contrast ratio values
+ */
+QString swatch_tooltip_text(const QColor& color, const QString& name, bool details);
+
+/**
+ * \brief Lightweight replacement for QToolTip showing a color sample
+ *
+ * The text is drawn line by line without going through the rich text
+ * layout engine and the popup is reused between calls.
+ * While it's visible, moving the mouse out of the given rectangle sends
+ * a new QEvent::ToolTip to the widget so the popup follows the cursor
+ * without waiting for the tooltip delay.
+ */
+class SwatchToolTip : public QWidget
+{
+public:
+    /**
+     * \brief Shows the popup for \p widget, hidden when leaving \p rect
+     * \param rect Area in \p widget coordinates
+     */
+    static void showText(const QPoint& global_pos, const QColor& color, const QString& text,
+                         QWidget* widget, const QRect& rect);
+    static void hideText();
+
+protected:
+    void paintEvent(QPaintEvent* event) Q_DECL_OVERRIDE;
+    bool eventFilter(QObject* object, QEvent* event) Q_DECL_OVERRIDE;
+
+private:
+    SwatchToolTip();
+    static SwatchToolTip* instance(bool create);
+    void setWidget(QWidget* widget);
+    void place(const QPoint& global_pos);
+    int frameMargin() const;
+
+    QColor              color;
+    QString             text;
+    QStringList         lines;
+    QPointer<QWidget>   widget;
+    QRect               rect;
+    bool                widget_tracking = false; ///< Mouse tracking of widget before it was set
+};
+
+} // namespace detail
+} // namespace color_widgets
+
+#endif // COLOR_WIDGETS_SWATCH_TOOLTIP_HPP
@@ -0,0 +1,660 @@
+/**
+ * \file
+ *
+ * \author Mattia Basaglia
+ *
+ * \copyright Copyright (C) 2013-2017 Mattia Basaglia
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "QtColorWidgets/swatch_view.hpp"
+#include <limits>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QHelpEvent>
+#include <QMouseEvent>
+#include <QRubberBand>
+#include <QScrollBar>
+#include <QStyleOptionFocusRect>
+#include "swatch_helpers.hpp"
+#include "swatch_tooltip.hpp"
+
+namespace color_widgets {
+
+class SwatchView::Private
+{
+public:
+    QSize   color_size{16, 16};
+    QPen    border{Qt::black, 1};
+    int     forced_columns = 0;
+    int     color_role = Qt::DecorationRole;
+    int     name_role = Qt::DisplayRole;
+    int     model_column = 0;
+
+    int     columns = 1;            ///< Number of columns, updated by updateGeometries()
+
+    QRubberBand* rubber_band = nullptr;
+    QPoint  press_position;         ///< Position of the last press, in content coordinates
+    QMetaObject::Connection rows_removed;
+
+    SwatchView* owner;
+
+    explicit Private(SwatchView* owner)
+        : owner(owner)
+    {}
+
+    int count() const
+    {
+        return owner->model() ? owner->model()->rowCount(owner->rootIndex()) : 0;
+    }
+
+    QModelIndex index(int row) const
+    {
+        if ( !owner->model() )
+            return QModelIndex();
+        return owner->model()->index(row, model_column, owner->rootIndex());
+    }
+
+    /**
+     * \brief Whether \p index is shown as a cell
+     */
+    bool isCell(const QModelIndex& index) const
+    {
+        return index.isValid() && index.model() == owner->model() &&
+               index.column() == model_column && index.parent() == owner->rootIndex();
+    }
+
+    QColor color(const QModelIndex& index) const
+    {
+        QVariant value = index.data(color_role);
+        if ( value.userType() == QMetaType::QBrush )
+            return value.value<QBrush>().color();
+        return value.value<QColor>();
+    }
+
+    QPoint scrollOffset() const
+    {
+        return QPoint(owner->horizontalOffset(), owner->verticalOffset());
+    }
+
+    /**
+     * \brief Rectangle of the cell for \p row, in viewport coordinates
+     */
+    QRect cellRect(int row) const
+    {
+        if ( row < 0 )
+            return QRect();
+        QPoint offset = scrollOffset();
+        return QRect(
+            int(qint64(row % columns) * color_size.width() - offset.x()),
+            int(qint64(row / columns) * color_size.height() - offset.y()),
+            color_size.width(),
+            color_size.height()
+        );
+    }
+
+    int rowAt(const QPoint& pos) const
+    {
+        if ( color_size.isEmpty() )
+            return -1;
+
+        QPoint offset = scrollOffset();
+        qint64 x = qint64(pos.x()) + offset.x();
+        qint64 y = qint64(pos.y()) + offset.y();
+        if ( x < 0 || y < 0 || x / color_size.width() >= columns )
+            return -1;
+
+        qint64 row = y / color_size.height() * columns + x / color_size.width();
+        return row < count() ? int(row) : -1;
+    }
+
+    /**
+     * \brief Pixels outside a cell painted by its border or selection marker
+     */
+    int cellMargin() const
+    {
+        return detail::swatch_cell_margin(border);
+    }
+
+    /**
+     * \brief Area covered by the cells from \p first to \p last, in viewport coordinates
+     */
+    QRect rowsRect(int first, int last) const
+    {
+        QRect first_rect = cellRect(first);
+        QRect last_rect = cellRect(last);
+        if ( first / columns == last / columns )
+            return first_rect.united(last_rect);
+
+        // Spans multiple lines of the grid, so it covers their whole width
+        QPoint offset = scrollOffset();
+        return QRect(
+            QPoint(-offset.x(), first_rect.top()),
+            QPoint(int(qint64(columns) * color_size.width() - offset.x()), last_rect.bottom())
+        );
+    }
+
+    /**
+     * \brief Repaints the cells from \p first to \p last
+     */
+    void updateRows(int first, int last)
+    {
+        int margin = cellMargin();
+        QRect rect = rowsRect(first, last).adjusted(-margin, -margin, margin, margin);
+        rect &= owner->viewport()->rect();
+        if ( !rect.isEmpty() )
+            owner->viewport()->update(rect);
+    }
+
+    /**
+     * \brief Repaints the cells from \p first onwards, which move when rows are added or removed
+     */
+    void updateFrom(int first)
+    {
+        QRect rect = cellRect(first);
+        int margin = cellMargin();
+        QRect viewport = owner->viewport()->rect();
+        viewport.setTop(qMax(viewport.top(), rect.top() - margin));
+        if ( !viewport.isEmpty() )
+            owner->viewport()->update(viewport);
+    }
+};
+
+SwatchView::SwatchView(QWidget* parent)
+    : QAbstractItemView(parent), p(new Private(this))
+{
+    setEditTriggers(NoEditTriggers);
+    setSelectionMode(ExtendedSelection);
+    setHorizontalScrollMode(ScrollPerPixel);
+    setVerticalScrollMode(ScrollPerPixel);
+}
+
+SwatchView::~SwatchView()
+{
+    delete p;
+}
+
+QSize SwatchView::sizeHint() const
+{
+    int columns = p->forced_columns ? p->forced_columns : 16;
+    int frame = 2 * frameWidth();
+    return QSize(
+        columns * p->color_size.width() + frame + verticalScrollBar()->sizeHint().width(),
+        8 * p->color_size.height() + frame
+    );
+}
+
+QRect SwatchView::visualRect(const QModelIndex& index) const
+{
+    if ( !p->isCell(index) )
+        return QRect();
+    return p->cellRect(index.row());
+}
+
+void SwatchView::scrollTo(const QModelIndex& index, ScrollHint hint)
+{
+    QRect rect = visualRect(index);
+    if ( !rect.isValid() )
+        return;
+
+    QRect area = viewport()->rect();
+    QScrollBar* vertical = verticalScrollBar();
+    switch ( hint )
+    {
+        case PositionAtTop:
+            vertical->setValue(vertical->value() + rect.top());
+            break;
+        case PositionAtBottom:
+            vertical->setValue(vertical->value() + rect.bottom() - area.bottom());
+            break;
+        case PositionAtCenter:
+            vertical->setValue(vertical->value() + rect.center().y() - area.center().y());
+            break;
+        case EnsureVisible:
+            if ( rect.top() < area.top() )
+                vertical->setValue(vertical->value() + rect.top() - area.top());
+            else if ( rect.bottom() > area.bottom() )
+                vertical->setValue(vertical->value() + rect.bottom() - area.bottom());
+            break;
+    }
+
+    QScrollBar* horizontal = horizontalScrollBar();
+    if ( rect.left() < area.left() )
+        horizontal->setValue(horizontal->value() + rect.left() - area.left());
+    else if ( rect.right() > area.right() )
+        horizontal->setValue(horizontal->value() + rect.right() - area.right());
+}
+
+QModelIndex SwatchView::indexAt(const QPoint& point) const
+{
+    int row = p->rowAt(point);
+    return row == -1 ? QModelIndex() : p->index(row);
+}
+
+QColor SwatchView::colorAt(int row) const
+{
+    return p->color(p->index(row));
+}
+
+QColor SwatchView::currentColor() const
+{
+    QModelIndex current = currentIndex();
+    return p->isCell(current) ? p->color(current) : QColor();
+}
+
+QModelIndex SwatchView::moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers modifiers)
+{
+    int count = p->count();
+    if ( count == 0 )
+        return QModelIndex();
+
+    QModelIndex current = currentIndex();
+    if ( !p->isCell(current) )
+        return p->index(0);
+
+    int row = current.row();
+    int columns = p->columns;
+    int page = qMax(1, viewport()->height() / qMax(1, p->color_size.height())) * columns;
+
+    switch ( cursorAction )
+    {
+        case MoveLeft:
+        case MovePrevious:
+            if ( row > 0 )
+                row--;
+            break;
+        case MoveRight:
+        case MoveNext:
+            if ( row < count - 1 )
+                row++;
+            break;
+        case MoveUp:
+            if ( row >= columns )
+                row -= columns;
+            break;
+        case MoveDown:
+            if ( row < count - columns )
+                row += columns;
+            break;
+        case MoveHome:
+            if ( modifiers & Qt::ControlModifier )
+                row = 0;
+            else
+                row -= row % columns;
+            break;
+        case MoveEnd:
+            if ( modifiers & Qt::ControlModifier )
+                row = count - 1;
+            else
+                row = qMin(row - row % columns + columns - 1, count - 1);
+            break;
+        case MovePageUp:
+            row = row >= page ? row - page : row % columns;
+            break;
+        case MovePageDown:
+            row = qMin(row + page, count - 1);
+            break;
+    }
+
+    return p->index(row);
+}
+
+int SwatchView::horizontalOffset() const
+{
+    return horizontalScrollBar()->value();
+}
+
+int SwatchView::verticalOffset() const
+{
+    return verticalScrollBar()->value();
+}
+
+bool SwatchView::isIndexHidden(const QModelIndex& index) const
+{
+    return !p->isCell(index);
+}
+
+void SwatchView::setSelection(const QRect& rect, QItemSelectionModel::SelectionFlags command)
+{
+    if ( !selectionModel() )
+        return;
+
+    QItemSelection selection;
+    int count = p->count();
+    int width = p->color_size.width();
+    int height = p->color_size.height();
+    QRect area = rect.normalized().translated(p->scrollOffset());
+    if ( count > 0 && width > 0 && height > 0 && area.right() >= 0 && area.bottom() >= 0 )
+    {
+        int columns = p->columns;
+        int first_column = qMax(0, area.left() / width);
+        int last_column = qMin(columns - 1, area.right() / width);
+        int first_row = qMax(0, area.top() / height);
+        int last_row = qMin((count - 1) / columns, area.bottom() / height);
+
+        if ( first_row > last_row || first_column > last_column )
+        {
+            // Outside the cells
+        }
+        else if ( first_column == 0 && last_column == columns - 1 )
+        {
+            // Whole lines of the grid are a single range of rows
+            selection.select(p->index(first_row * columns),
+                             p->index(qMin(last_row * columns + columns - 1, count - 1)));
+        }
+        else
+        {
+            for ( int y = first_row; y <= last_row; y++ )
+            {
+                int first = y * columns + first_column;
+                int last = qMin(y * columns + last_column, count - 1);
+                if ( first <= last )
+                    selection.select(p->index(first), p->index(last));
+            }
+        }
+    }
+
+    selectionModel()->select(selection, command);
+}
+
+QRegion SwatchView::visualRegionForSelection(const QItemSelection& selection) const
+{
+    if ( p->color_size.isEmpty() )
+        return QRegion();
+
+    // Only the visible lines of the grid, selections can be much larger than the view
+    int columns = p->columns;
+    int first_visible = verticalOffset() / p->color_size.height() * columns;
+    int last_visible = (verticalOffset() + viewport()->height()) / p->color_size.height() * columns + columns - 1;
+
+    QRegion region;
+    for ( const QItemSelectionRange& range : selection )
+    {
+        if ( range.parent() != rootIndex() || range.left() > p->model_column || range.right() < p->model_column )
+            continue;
+
+        int first = qMax(range.top(), first_visible);
+        int last = qMin(range.bottom(), last_visible);
+        for ( int line = first - first % columns; line <= last; line += columns )
+            region += p->rowsRect(qMax(first, line), qMin(last, line + columns - 1));
+    }
+    return region;
+}
+
+void SwatchView::dataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles)
+{
+    // QAbstractItemView repaints the whole viewport for a range of indexes
+    if ( !roles.empty() && !roles.contains(p->color_role) && !roles.contains(p->name_role) )
+        return;
+    if ( topLeft.parent() != rootIndex() || topLeft.column() > p->model_column || bottomRight.column() < p->model_column )
+        return;
+    p->updateRows(topLeft.row(), bottomRight.row());
+}
+
+void SwatchView::rowsInserted(const QModelIndex& parent, int start, int end)
+{
+    QAbstractItemView::rowsInserted(parent, start, end);
+    if ( parent == rootIndex() )
+    {
+        updateGeometries();
+        p->updateFrom(start);
+    }
+}
+
+void SwatchView::setModel(QAbstractItemModel* model)
+{
+    disconnect(p->rows_removed);
+    QAbstractItemView::setModel(model);
+    if ( model )
+    {
+        // rowsAboutToBeRemoved() is too early, the row count is only updated after it
+        p->rows_removed = connect(model, &QAbstractItemModel::rowsRemoved, this,
+            [this](const QModelIndex& parent, int start, int) {
+                if ( parent == rootIndex() )
+                {
+                    updateGeometries();
+                    p->updateFrom(start);
+                }
+            });
+    }
+}
+
+void SwatchView::currentChanged(const QModelIndex& current, const QModelIndex& previous)
+{
+    QAbstractItemView::currentChanged(current, previous);
+    if ( p->isCell(current) )
+        Q_EMIT colorSelected(p->color(current));
+}
+
+void SwatchView::updateGeometries()
+{
+    QSize viewport = this->viewport()->size();
+    int count = p->count();
+
+    if ( p->forced_columns )
+        p->columns = p->forced_columns;
+    else
+        p->columns = qMax(1, viewport.width() / qMax(1, p->color_size.width()));
+    int rows = (count + p->columns - 1) / p->columns;
+
+    qint64 width = qint64(qMin(count, p->columns)) * p->color_size.width();
+    qint64 height = qint64(rows) * p->color_size.height();
+    const qint64 max_range = std::numeric_limits<int>::max();
+
+    QScrollBar* horizontal = horizontalScrollBar();
+    horizontal->setRange(0, qMin(max_range, qMax<qint64>(0, width - viewport.width())));
+    horizontal->setPageStep(viewport.width());
+    horizontal->setSingleStep(p->color_size.width());
+
+    QScrollBar* vertical = verticalScrollBar();
+    vertical->setRange(0, qMin(max_range, qMax<qint64>(0, height - viewport.height())));
+    vertical->setPageStep(viewport.height());
+    vertical->setSingleStep(p->color_size.height());
+
+    QAbstractItemView::updateGeometries();
+}
+
+void SwatchView::mousePressEvent(QMouseEvent* event)
+{
+    p->press_position = event->pos() + p->scrollOffset();
+    QAbstractItemView::mousePressEvent(event);
+}
+
+void SwatchView::mouseMoveEvent(QMouseEvent* event)
+{
+    QAbstractItemView::mouseMoveEvent(event);
+    if ( state() == DragSelectingState )
+    {
+        if ( !p->rubber_band )
+            p->rubber_band = new QRubberBand(QRubberBand::Rectangle, viewport());
+        p->rubber_band->setGeometry(QRect(p->press_position - p->scrollOffset(), event->pos()).normalized());
+        p->rubber_band->show();
+    }
+}
+
+void SwatchView::mouseReleaseEvent(QMouseEvent* event)
+{
+    QAbstractItemView::mouseReleaseEvent(event);
+    if ( p->rubber_band )
+        p->rubber_band->hide();
+}
+
+bool SwatchView::viewportEvent(QEvent* event)
+{
+    if ( event->type() == QEvent::ToolTip )
+    {
+        QHelpEvent* help_ev = static_cast<QHelpEvent*>(event);
+        QModelIndex index = indexAt(help_ev->pos());
+        if ( index.isValid() )
+        {
+            QColor color = p->color(index);
+            QString text = detail::swatch_tooltip_text(color, index.data(p->name_role).toString(), false);
+            detail::SwatchToolTip::showText(help_ev->globalPos(), color, text, viewport(), visualRect(index));
+            event->accept();
+        }
+        else
+        {
+            detail::SwatchToolTip::hideText();
+            event->ignore();
+        }
+        return true;
+    }
+
+    return QAbstractItemView::viewportEvent(event);
+}
+
+void SwatchView::paintEvent(QPaintEvent* event)
+{
+    int count = p->count();
+    if ( count == 0 || p->color_size.isEmpty() )
+        return;
+
+    QPainter painter(viewport());
+    const int width = p->color_size.width();
+    const int height = p->color_size.height();
+    const int columns = p->columns;
+    QPoint offset = p->scrollOffset();
+
+    // Only the cells in the exposed area, including the ones whose borders reach into it
+    int margin = p->cellMargin();
+    QRect exposed = event->rect().adjusted(-margin, -margin, margin, margin).translated(offset);
+    int first_column = qMax(0, exposed.left() / width);
+    int last_column = qMin(columns - 1, exposed.right() / width);
+    int first_row = qMax(0, exposed.top() / height);
+    int last_row = qMin((count - 1) / columns, exposed.bottom() / height);
+
+    QItemSelectionModel* selection = selectionModel();
+    QVector<QRect> selected;
+    painter.setPen(p->border);
+    for ( int y = first_row; y <= last_row; y++ )
+    {
+        qint64 row_start = qint64(y) * columns;
+        for ( int x = first_column; x <= last_column && row_start + x < count; x++ )
+        {
+            QModelIndex index = p->index(row_start + x);
+            QRect rect(x * width - offset.x(), y * height - offset.y(), width, height);
+            painter.setBrush(p->color(index));
+            painter.drawRect(rect);
+            if ( selection && selection->isSelected(index) )
+                selected.push_back(rect);
+        }
+    }
+
+    // Drawn last so the following cells don't cover them
+    for ( const QRect& rect : selected )
+        detail::swatch_paint_selection_marker(painter, rect);
+
+    QModelIndex current = currentIndex();
+    if ( hasFocus() && p->isCell(current) )
+    {
+        QStyleOptionFocusRect option;
+        option.initFrom(this);
+        option.rect = visualRect(current).adjusted(margin, margin, -margin, -margin);
+        option.backgroundColor = p->color(current);
+        if ( option.rect.intersects(event->rect()) )
+            style()->drawPrimitive(QStyle::PE_FrameFocusRect, &option, &painter, this);
+    }
+}
+
+QSize SwatchView::colorSize() const
+{
+    return p->color_size;
+}
+
+void SwatchView::setColorSize(const QSize& colorSize)
+{
+    if ( p->color_size != colorSize )
+    {
+        Q_EMIT colorSizeChanged(p->color_size = colorSize);
+        updateGeometries();
+        viewport()->update();
+    }
+}
+
+QPen SwatchView::border() const
+{
+    return p->border;
+}
+
+void SwatchView::setBorder(const QPen& border)
+{
+    if ( border != p->border )
+    {
+        Q_EMIT borderChanged(p->border = border);
+        viewport()->update();
+    }
+}
+
+int SwatchView::forcedColumns() const
+{
+    return p->forced_columns;
+}
+
+void SwatchView::setForcedColumns(int forcedColumns)
+{
+    if ( forcedColumns < 0 )
+        forcedColumns = 0;
+
+    if ( forcedColumns != p->forced_columns )
+    {
+        Q_EMIT forcedColumnsChanged(p->forced_columns = forcedColumns);
+        updateGeometries();
+        viewport()->update();
+    }
+}
+
+int SwatchView::colorRole() const
+{
+    return p->color_role;
+}
+
+void SwatchView::setColorRole(int colorRole)
+{
+    if ( colorRole != p->color_role )
+    {
+        Q_EMIT colorRoleChanged(p->color_role = colorRole);
+        viewport()->update();
+    }
+}
+
+int SwatchView::nameRole() const
+{
+    return p->name_role;
+}
+
+void SwatchView::setNameRole(int nameRole)
+{
+    if ( nameRole != p->name_role )
+        Q_EMIT nameRoleChanged(p->name_role = nameRole);
+}
+
+int SwatchView::modelColumn() const
+{
+    return p->model_column;
+}
+
+void SwatchView::setModelColumn(int modelColumn)
+{
+    if ( modelColumn < 0 )
+        modelColumn = 0;
+
+    if ( modelColumn != p->model_column )
+    {
+        Q_EMIT modelColumnChanged(p->model_column = modelColumn);
+        viewport()->update();
+    }
+}
+
+} // namespace color_widgets